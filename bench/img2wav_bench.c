@@ -0,0 +1,218 @@
+#include "../src/img2wav.h"
+
+#define BENCH_RUNS  3//!< Runs per configuration, the fastest one is reported
+#define BENCH_IMAGE "img2wav_bench.ppm"
+#define BENCH_WAV   "img2wav_bench.wav"
+
+/** Matrix every stage is measured over */
+static const int bench_sizes[]   = {128, 512};
+static const float bench_rates[] = {44100.0f, 96000.0f};
+static const float bench_times[] = {1.0f, 4.0f};
+static const int bench_depths[]  = {8, 16, 24, 32};
+
+/** Engines rendered by get_freqs() */
+static const struct {
+    const char *name;
+    enum synth_engine engine;
+} bench_engines[] = {{"fft", SYNTH_FFT}, {"osc", SYNTH_OSC}, {"table", SYNTH_TABLE}, {"sinf", SYNTH_SINF}, {"additive", SYNTH_ADDITIVE}};
+
+#define BENCH_COUNT(a) (sizeof(a) / sizeof(*(a)))
+
+/** One measured configuration */
+struct bench_row {
+    const char *stage;  //!< Function being measured
+    const char *variant;//!< Engine or bit depth, "-" when the stage has none
+    int width;          //!< Image width, 0 when the stage doesn't read an image
+    int height;         //!< Image height, 0 when the stage doesn't read an image
+    float sample_rate;  //!< Output sample rate, 0 when the stage doesn't produce audio
+    float time_s;       //!< Output length in seconds, 0 when the stage doesn't produce audio
+    double seconds;     //!< Fastest of BENCH_RUNS runs
+    double samples;     //!< Samples or pixels processed by one run
+    double bytes;       //!< Bytes read or written by one run
+};
+
+/** Print a row as CSV or as one element of a JSON array */
+void bench_print(const struct bench_row *r, int json, int first) {
+    const double per_s = r->samples / r->seconds;
+    const double mb_s  = r->bytes / r->seconds / 1e6;
+    if (json) {
+        printf("%s\n  {\"stage\": \"%s\", \"variant\": \"%s\", \"width\": %d, \"height\": %d, \"sample_rate\": %.0f, "
+               "\"time_s\": %g, \"seconds\": %.6f, \"samples_per_s\": %.0f, \"mb_per_s\": %.1f, \"peak_rss_kb\": %ld}",
+               first ? "" : ",", r->stage, r->variant, r->width, r->height, r->sample_rate, r->time_s, r->seconds, per_s, mb_s, peak_rss_kb());
+    } else {
+        printf("%s,%s,%d,%d,%.0f,%g,%.6f,%.0f,%.1f,%ld\n", r->stage, r->variant, r->width, r->height, r->sample_rate, r->time_s, r->seconds, per_s, mb_s, peak_rss_kb());
+    }
+    fflush(stdout);
+}
+
+/** Write a binary ppm with some structure so that columns have a realistic mix of dark and bright pixels */
+int write_image(const char *path, int size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return 0;
+
+    fprintf(file, "P6\n%d %d\n255\n", size, size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const uint8_t px[3] = {(uint8_t) (x ^ y), (uint8_t) (x * y >> 4), (uint8_t) ((x + y) * 3)};
+            fwrite(px, 1, 3, file);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+/** Fastest of BENCH_RUNS get_pixels() calls */
+double bench_pixels(const char *path) {
+    const struct decode_config dc = {.luma = LUMA_BT601, .column_major = 1};
+    double best                   = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        int width, height;
+        const double start = now();
+        uint8_t *pixels    = get_pixels(path, &width, &height, &dc);
+        const double t     = now() - start;
+        if (!pixels) return 0.0;
+        free(pixels);
+        if (t < best) best = t;
+    }
+
+    return best;
+}
+
+/** Fastest of BENCH_RUNS get_freqs() calls of one engine */
+double bench_freqs(const uint8_t *pixels, int size, float sample_rate, float time_s, enum synth_engine engine) {
+    const synth_config cfg = {.engine = engine, .simd = "auto", .interp = TABLE_LINEAR, .threads = 1, .column_major = 1, .depth = 8, .phase = PHASE_RESTART};
+    double best            = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        int n;
+        const double start = now();
+        float *freqs       = get_freqs(pixels, sample_rate, time_s, size, size, cfg, &n);
+        const double t     = now() - start;
+        if (!freqs) return 0.0;
+        free(freqs);
+        if (t < best) best = t;
+    }
+
+    return best;
+}
+
+/** Fastest of BENCH_RUNS normalize() calls, the signal is restored outside of the timed region */
+double bench_normalize(const float *signal, float *work, size_t n) {
+    double best = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        memcpy(work, signal, n * sizeof(*work));
+        const double start = now();
+        normalize(work, n);
+        const double t = now() - start;
+        if (t < best) best = t;
+    }
+
+    return best;
+}
+
+/** Fastest of BENCH_RUNS wav_write() or wav_read() calls */
+double bench_wav(wav_config cfg, float **data, int read) {
+    double best = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        const double start = now();
+        const size_t n     = read ? wav_read(cfg, BENCH_WAV, data) : wav_write(cfg, BENCH_WAV, data);
+        const double t     = now() - start;
+        if (n != cfg.ns) return 0.0;
+        if (t < best) best = t;
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const int json = argc > 1 && strcmp(argv[1], "--json") == 0;
+    if (argc > 1 && !json) {
+        fprintf(stderr, "Usage: img2wav_bench [--json]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (json)
+        printf("[");
+    else
+        printf("stage,variant,width,height,sample_rate,time_s,seconds,samples_per_s,mb_per_s,peak_rss_kb\n");
+
+    int first = 1;
+    int ok    = 1;
+    for (size_t s = 0; ok && s < BENCH_COUNT(bench_sizes); s++) {
+        const int size = bench_sizes[s];
+        ok             = write_image(BENCH_IMAGE, size);
+
+        struct bench_row row = {.stage = "get_pixels", .variant = "-", .width = size, .height = size};
+        row.seconds          = ok ? bench_pixels(BENCH_IMAGE) : 0.0;
+        row.samples          = (double) size * size;
+        row.bytes            = (double) size * size * 3;
+        ok                   = ok && row.seconds > 0.0;
+        if (ok) bench_print(&row, json, first), first = 0;
+
+        const struct decode_config dc = {.luma = LUMA_BT601, .column_major = 1};
+        int width, height;
+        uint8_t *pixels = ok ? get_pixels(BENCH_IMAGE, &width, &height, &dc) : NULL;
+        ok              = pixels != NULL;
+
+        for (size_t r = 0; ok && r < BENCH_COUNT(bench_rates); r++) {
+            for (size_t t = 0; ok && t < BENCH_COUNT(bench_times); t++) {
+                for (size_t e = 0; ok && e < BENCH_COUNT(bench_engines); e++) {
+                    // the per sample sin() reference is orders of magnitude slower, one configuration is enough
+                    if (bench_engines[e].engine == SYNTH_ADDITIVE && (s > 0 || r > 0 || t > 0)) continue;
+
+                    struct bench_row row = {.stage = "get_freqs", .variant = bench_engines[e].name, .width = size, .height = size, .sample_rate = bench_rates[r], .time_s = bench_times[t]};
+                    row.samples          = (double) (int) (bench_rates[r] * bench_times[t]);
+                    row.bytes            = row.samples * sizeof(float);
+                    row.seconds          = bench_freqs(pixels, size, bench_rates[r], bench_times[t], bench_engines[e].engine);
+                    ok                   = row.seconds > 0.0;
+                    if (ok) bench_print(&row, json, first), first = 0;
+                }
+            }
+        }
+        free(pixels);
+    }
+    remove(BENCH_IMAGE);
+
+    for (size_t r = 0; ok && r < BENCH_COUNT(bench_rates); r++) {
+        for (size_t t = 0; ok && t < BENCH_COUNT(bench_times); t++) {
+            const size_t n = (size_t) (bench_rates[r] * bench_times[t]);
+            float *signal  = malloc(n * sizeof(*signal));
+            float *work    = malloc(n * sizeof(*work));
+            ok             = signal && work;
+            for (size_t i = 0; ok && i < n; i++)
+                signal[i] = 2.0f * sinf(2.0f * (float) M_PI * 440.0f * i / bench_rates[r]);
+
+            if (ok) {
+                struct bench_row row = {.stage = "normalize", .variant = "-", .sample_rate = bench_rates[r], .time_s = bench_times[t]};
+                row.seconds          = bench_normalize(signal, work, n);
+                row.samples          = (double) n;
+                row.bytes            = (double) n * sizeof(float);
+                bench_print(&row, json, first), first = 0;
+                normalize(signal, n);
+            }
+
+            for (size_t d = 0; ok && d < BENCH_COUNT(bench_depths); d++) {
+                char depth[4];
+                snprintf(depth, sizeof(depth), "%d", bench_depths[d]);
+                const wav_config cfg = {.nc = 1, .ns = (uint32_t) n, .sr = (uint32_t) bench_rates[r], .bd = (uint16_t) bench_depths[d]};
+
+                // wav_write() runs first so wav_read() always finds a file of the same configuration
+                for (int read = 0; ok && read <= 1; read++) {
+                    struct bench_row row = {.stage = read ? "wav_read" : "wav_write", .variant = depth, .sample_rate = bench_rates[r], .time_s = bench_times[t]};
+                    row.seconds          = bench_wav(cfg, read ? &work : &signal, read);
+                    row.samples          = (double) n;
+                    row.bytes            = (double) n * (bench_depths[d] / 8);
+                    ok                   = row.seconds > 0.0;
+                    if (ok) bench_print(&row, json, first), first = 0;
+                }
+            }
+            free(signal);
+            free(work);
+        }
+    }
+    remove(BENCH_WAV);
+
+    if (json) printf("\n]\n");
+    if (!ok) fprintf(stderr, "img2wav_bench: a stage failed\n");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WAV_IMPLEMENTATION
+#include "../src/wav.h"
+
+#define BENCH_SAMPLES (1 << 22)//!< Samples per channel written by every run
+#define BENCH_RUNS    3        //!< Runs per configuration, the fastest one is reported
+#define BENCH_PATH    "wav_bench.wav"
+
+/** Wall clock time in seconds */
+double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Encode like wav.h used to, one fwrite per sample per channel */
+size_t write_per_sample(wav_config cfg, FILE *file, float *const *data) {
+    size_t n = 0;
+    for (size_t i = 0; i < cfg.ns; i++) {
+        for (size_t ch = 0; ch < cfg.nc; ch++) {
+            if (cfg.bd == 24) {
+                const int32_t v = lround(data[ch][i] * 0x7FFFFF) & 0xFFFFFF;
+                n += fwrite(&v, 3, 1, file);
+            } else {
+                int32_t v = (int32_t) (data[ch][i] * 32768.0f);
+                if (v < -32768) v = -32768;
+                if (v > 32767) v = 32767;
+                n += fwrite(&v, sizeof(int16_t), 1, file);
+            }
+        }
+    }
+    return n / cfg.nc;
+}
+
+/** Fastest of BENCH_RUNS writes of cfg in MB/s of encoded audio */
+double bench_write(wav_config cfg, float *const *data, int per_sample) {
+    double best = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        FILE *file = fopen(BENCH_PATH, "wb");
+        if (!file) return 0.0;
+
+        const double start = now();
+        wav_write_header(cfg, file);
+        const size_t n = per_sample ? write_per_sample(cfg, file, data) : wav_write_samples(cfg, file, data, cfg.ns);
+        wav_write_pad(cfg, file);
+        fclose(file);
+        const double elapsed = now() - start;
+
+        if (n != cfg.ns) return 0.0;
+        if (elapsed < best) best = elapsed;
+    }
+
+    return (double) cfg.ns * cfg.nc * (cfg.bd / 8) / best / 1e6;
+}
+
+/** Fastest of BENCH_RUNS in memory encodes, or decodes, of cfg one block at a time in MB/s, the kernel or the generic loop */
+double bench_kernel(wav_config cfg, float **data, int decode, int generic) {
+    const size_t per_block = wav_block_samples(cfg);
+    const wav_encoder enc  = generic ? wav_encode_block : wav_get_encoder(cfg);
+    const wav_decoder dec  = generic ? wav_decode_block : wav_get_decoder(cfg);
+    uint8_t *block         = malloc(per_block * cfg.nc * (cfg.bd / 8));
+    if (!block) return 0.0;
+    enc(cfg, data, 0, per_block, 1.0f, block);
+
+    double best = 1e30;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        const double start = now();
+        for (size_t i = 0; i < cfg.ns; i += per_block) {
+            const size_t count = (cfg.ns - i < per_block) ? cfg.ns - i : per_block;
+            if (decode)
+                dec(cfg, block, count, data, i);
+            else
+                enc(cfg, data, i, count, 1.0f, block);
+        }
+        const double elapsed = now() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    free(block);
+
+    return (double) cfg.ns * cfg.nc * (cfg.bd / 8) / best / 1e6;
+}
+
+int main() {
+    float *data[2];
+    for (size_t ch = 0; ch < 2; ch++) {
+        data[ch] = malloc(BENCH_SAMPLES * sizeof(*data[ch]));
+        if (!data[ch]) return EXIT_FAILURE;
+        for (size_t i = 0; i < BENCH_SAMPLES; i++)
+            data[ch][i] = 0.8 * sin(2.0 * M_PI * 440.0 * (ch + 1) * i / 48000.0);
+    }
+
+    printf("channels,bit_depth,encoder,mb_per_s\n");
+    const int depths[] = {8, 16, 24, 32};
+    for (int nc = 1; nc <= 2; nc++) {
+        for (int d = 0; d < 4; d++) {
+            wav_config cfg = {.nc = nc, .ns = BENCH_SAMPLES, .sr = 48000, .bd = depths[d]};
+            printf("%d,%d,block,%.1f\n", nc, depths[d], bench_write(cfg, data, 0));
+            if (depths[d] == 16 || depths[d] == 24)
+                printf("%d,%d,per_sample,%.1f\n", nc, depths[d], bench_write(cfg, data, 1));
+            printf("%d,%d,encode_kernel,%.1f\n", nc, depths[d], bench_kernel(cfg, data, 0, 0));
+            printf("%d,%d,encode_generic,%.1f\n", nc, depths[d], bench_kernel(cfg, data, 0, 1));
+            printf("%d,%d,decode_kernel,%.1f\n", nc, depths[d], bench_kernel(cfg, data, 1, 0));
+            printf("%d,%d,decode_generic,%.1f\n", nc, depths[d], bench_kernel(cfg, data, 1, 1));
+        }
+    }
+
+    remove(BENCH_PATH);
+    free(data[0]);
+    free(data[1]);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,382 @@
+/* aio.h - double buffered writer thread for img2wav
+
+   Features:
+       + Blocks of deinterleaved samples are written on a background thread while the next ones are filled
+       + Bounded queue of depth blocks, the producer only waits once every block is queued
+       + Time the producer waited for a block and time the writer spent writing are counted
+       + The same writer and its buffers are reused by every aio_begin() call
+       + Cross platform windows/unix/linux
+
+    Limitations:
+       + One producer per writer, blocks are written in the order they are submitted
+       + A depth of 1 writes on the calling thread in aio_submit(), there is nothing to overlap
+
+    DOCUMENTATION
+    =============
+    // Define AIO_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define AIO_IMPLEMENTATION
+    #include "aio.h"
+
+    // Create a writer queueing depth blocks, depth 2 is double buffered.
+    aio *a = aio_new(depth);
+
+    // Start a run of blocks of nc channels of up to ns samples, each written with fn(user, data, ns, scale).
+    aio_begin(a, nc, ns, fn, user);
+
+    // Fill the next free block and queue it, the previous ones are written in the meantime.
+    float *const *block = aio_acquire(a);
+    aio_submit(a, count, scale);
+
+    // Wait for every queued block, returns the samples fn wrote.
+    size_t written = aio_end(a);
+
+    aio_free(a);
+*/
+#ifndef AIO_H
+#define AIO_H
+#include <stddef.h>
+#include <stdint.h>
+
+/** Writes a block of ns samples of every channel scaled by scale, returns the number of samples written */
+typedef size_t (*aio_write_fn)(void *user, float *const *data, size_t ns, float scale);
+
+typedef struct aio aio;
+
+/** Counters of a writer, summed over every block it wrote */
+typedef struct aio_stats {
+    uint64_t blocks;//!< Blocks written
+    double stall_s; //!< Time the producer waited in aio_acquire() and aio_end()
+    double write_s; //!< Time spent in the write function
+} aio_stats;
+
+/**
+ * @brief Create a writer
+ *
+ * @param depth Number of blocks queued, values below 1 are treated as 1, 1 writes without a thread
+ * @return Writer or NULL if its thread couldn't be created
+ */
+aio *aio_new(int depth);
+
+/**
+ * @brief Number of blocks a writer queues
+ *
+ * @param a Writer
+ * @return Depth the writer was created with
+ */
+int aio_depth(const aio *a);
+
+/**
+ * @brief Start a run of blocks, the buffers are grown to fit them
+ *
+ * @param a Writer with no run in progress
+ * @param nc Number of channels of every block
+ * @param ns Most samples per channel of a block
+ * @param fn Function writing every block of the run
+ * @param user Pointer passed to fn
+ * @return 1 on success, 0 if the buffers couldn't be allocated
+ */
+int aio_begin(aio *a, int nc, size_t ns, aio_write_fn fn, void *user);
+
+/**
+ * @brief Take the next free block, waiting for the writer if every block is queued
+ *
+ * @param a Writer with a run in progress
+ * @return Pointers to the ns samples of every channel of the block
+ */
+float *const *aio_acquire(aio *a);
+
+/**
+ * @brief Queue the block taken by the last aio_acquire()
+ *
+ * Once a write fell short the remaining blocks of the run are dropped.
+ *
+ * @param a Writer with a run in progress
+ * @param ns Number of samples per channel of the block
+ * @param scale Factor passed to the write function
+ */
+void aio_submit(aio *a, size_t ns, float scale);
+
+/**
+ * @brief Wait for every queued block and end the run
+ *
+ * @param a Writer with a run in progress
+ * @return Number of samples per channel written by the run
+ */
+size_t aio_end(aio *a);
+
+/**
+ * @brief Counters of a writer
+ *
+ * @param a Writer
+ * @return Counters of every run so far
+ */
+aio_stats aio_get_stats(const aio *a);
+
+/**
+ * @brief Stop the thread and deallocate a writer
+ *
+ * @param a Writer to free with no run in progress, may be NULL
+ */
+void aio_free(aio *a);
+
+#ifdef AIO_IMPLEMENTATION
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+typedef HANDLE aio_thread;
+typedef CRITICAL_SECTION aio_mutex;
+typedef CONDITION_VARIABLE aio_cond;
+    #define aio_mutex_init(m)    InitializeCriticalSection(m)
+    #define aio_mutex_destroy(m) DeleteCriticalSection(m)
+    #define aio_lock(m)          EnterCriticalSection(m)
+    #define aio_unlock(m)        LeaveCriticalSection(m)
+    #define aio_cond_init(c)     InitializeConditionVariable(c)
+    #define aio_cond_destroy(c)  ((void) (c))
+    #define aio_wait(c, m)       SleepConditionVariableCS((c), (m), INFINITE)
+    #define aio_broadcast(c)     WakeAllConditionVariable(c)
+#else
+    #include <pthread.h>
+typedef pthread_t aio_thread;
+typedef pthread_mutex_t aio_mutex;
+typedef pthread_cond_t aio_cond;
+    #define aio_mutex_init(m)    pthread_mutex_init((m), NULL)
+    #define aio_mutex_destroy(m) pthread_mutex_destroy(m)
+    #define aio_lock(m)          pthread_mutex_lock(m)
+    #define aio_unlock(m)        pthread_mutex_unlock(m)
+    #define aio_cond_init(c)     pthread_cond_init((c), NULL)
+    #define aio_cond_destroy(c)  pthread_cond_destroy(c)
+    #define aio_wait(c, m)       pthread_cond_wait((c), (m))
+    #define aio_broadcast(c)     pthread_cond_broadcast(c)
+#endif
+
+/** Samples and write arguments of one queued block */
+struct aio_block {
+    float **data;//!< Samples of every channel, nc pointers into the writer's buffer
+    size_t ns;   //!< Samples per channel to write
+    float scale; //!< Factor passed to the write function
+};
+
+struct aio {
+    int depth;              //!< Number of blocks
+    aio_thread thread;      //!< Writer thread, only started for a depth above 1
+    aio_mutex lock;         //!< Guards head, tail, queued, quit and the counters
+    aio_cond cond;          //!< Signaled when a block is queued, a block is written or the writer stops
+    struct aio_block *slots;//!< Ring of depth blocks
+    float **channels;       //!< Channel pointers of every block, depth * nc of them
+    float *buffer;          //!< Samples of every block
+    size_t cap;             //!< Floats in buffer
+    int nc;                 //!< Channels the channel pointers have room for, per block
+    int head;               //!< Next block handed out by aio_acquire()
+    int tail;               //!< Next block to write
+    int queued;             //!< Blocks submitted and not written yet
+    int quit;               //!< Set when the writer is freed
+    int failed;             //!< A write of the current run fell short
+    size_t written;         //!< Samples written by the current run
+    aio_write_fn fn;        //!< Write function of the current run
+    void *user;             //!< Pointer passed to fn
+    aio_stats stats;        //!< Counters of every run
+};
+
+/** Wall clock time in seconds (internal use only) */
+double aio_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/** Write one block and record the result, called with the lock released (internal use only) */
+void aio_write_block(aio *a, const struct aio_block *b, int failed, size_t *written, double *elapsed) {
+    const double start = aio_now();
+    *written           = failed ? 0 : a->fn(a->user, b->data, b->ns, b->scale);
+    *elapsed           = aio_now() - start;
+}
+
+#ifdef _WIN32
+DWORD WINAPI aio_main(LPVOID arg) {
+#else
+void *aio_main(void *arg) {
+#endif
+    aio *a = arg;
+    aio_lock(&a->lock);
+    for (;;) {
+        while (!a->quit && a->queued == 0)
+            aio_wait(&a->cond, &a->lock);
+        if (a->queued == 0) break;
+
+        // the producer never hands out a queued block, so it's safe to write without the lock
+        const struct aio_block *b = &a->slots[a->tail];
+        const int failed          = a->failed;
+        size_t written;
+        double elapsed;
+        aio_unlock(&a->lock);
+        aio_write_block(a, b, failed, &written, &elapsed);
+        aio_lock(&a->lock);
+
+        a->written += written;
+        if (written != b->ns) a->failed = 1;
+        a->stats.blocks += !failed;
+        a->stats.write_s += elapsed;
+        a->tail = (a->tail + 1) % a->depth;
+        a->queued--;
+        aio_broadcast(&a->cond);
+    }
+    aio_unlock(&a->lock);
+
+    return 0;
+}
+
+aio *aio_new(int depth) {
+    aio *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+
+    a->depth = depth < 1 ? 1 : depth;
+    a->slots = calloc(a->depth, sizeof(*a->slots));
+    if (!a->slots) {
+        free(a);
+        return NULL;
+    }
+
+    aio_mutex_init(&a->lock);
+    aio_cond_init(&a->cond);
+    if (a->depth > 1) {
+        #ifdef _WIN32
+        a->thread    = CreateThread(NULL, 0, aio_main, a, 0, NULL);
+        const int ok = a->thread != NULL;
+        #else
+        const int ok = pthread_create(&a->thread, NULL, aio_main, a) == 0;
+        #endif
+        // write on the calling thread when the writer didn't start
+        if (!ok) a->depth = 1;
+    }
+
+    return a;
+}
+
+int aio_depth(const aio *a) {
+    return a->depth;
+}
+
+int aio_begin(aio *a, int nc, size_t ns, aio_write_fn fn, void *user) {
+    const size_t cap = (size_t) a->depth * nc * ns;
+    if (cap > a->cap) {
+        float *buffer = realloc(a->buffer, cap * sizeof(*buffer));
+        if (!buffer) return 0;
+        a->buffer = buffer;
+        a->cap    = cap;
+    }
+    if (nc > a->nc) {
+        float **channels = realloc(a->channels, (size_t) a->depth * nc * sizeof(*channels));
+        if (!channels) return 0;
+        a->channels = channels;
+        a->nc       = nc;
+    }
+
+    for (int i = 0; i < a->depth; i++) {
+        a->slots[i].data = a->channels + (size_t) i * nc;
+        for (int ch = 0; ch < nc; ch++)
+            a->slots[i].data[ch] = a->buffer + ((size_t) i * nc + ch) * ns;
+    }
+    a->head    = a->tail = 0;
+    a->failed  = 0;
+    a->written = 0;
+    a->fn      = fn;
+    a->user    = user;
+
+    return 1;
+}
+
+float *const *aio_acquire(aio *a) {
+    if (a->depth == 1) return a->slots[0].data;
+
+    aio_lock(&a->lock);
+    if (a->queued == a->depth) {
+        const double start = aio_now();
+        while (a->queued == a->depth)
+            aio_wait(&a->cond, &a->lock);
+        a->stats.stall_s += aio_now() - start;
+    }
+    float *const *data = a->slots[a->head].data;
+    aio_unlock(&a->lock);
+
+    return data;
+}
+
+void aio_submit(aio *a, size_t ns, float scale) {
+    struct aio_block *b = &a->slots[a->head];
+    b->ns               = ns;
+    b->scale            = scale;
+
+    if (a->depth == 1) {
+        size_t written;
+        double elapsed;
+        aio_write_block(a, b, a->failed, &written, &elapsed);
+        a->stats.blocks += !a->failed;
+        a->stats.write_s += elapsed;
+        a->written += written;
+        if (written != ns) a->failed = 1;
+        return;
+    }
+
+    aio_lock(&a->lock);
+    a->head = (a->head + 1) % a->depth;
+    a->queued++;
+    aio_broadcast(&a->cond);
+    aio_unlock(&a->lock);
+}
+
+size_t aio_end(aio *a) {
+    aio_lock(&a->lock);
+    if (a->queued > 0) {
+        const double start = aio_now();
+        while (a->queued > 0)
+            aio_wait(&a->cond, &a->lock);
+        a->stats.stall_s += aio_now() - start;
+    }
+    const size_t written = a->written;
+    aio_unlock(&a->lock);
+
+    return written;
+}
+
+aio_stats aio_get_stats(const aio *a) {
+    return a->stats;
+}
+
+void aio_free(aio *a) {
+    if (!a) return;
+
+    if (a->depth > 1) {
+        aio_lock(&a->lock);
+        a->quit = 1;
+        aio_broadcast(&a->cond);
+        aio_unlock(&a->lock);
+        #ifdef _WIN32
+        WaitForSingleObject(a->thread, INFINITE);
+        CloseHandle(a->thread);
+        #else
+        pthread_join(a->thread, NULL);
+        #endif
+    }
+
+    aio_mutex_destroy(&a->lock);
+    aio_cond_destroy(&a->cond);
+    free(a->slots);
+    free(a->channels);
+    free(a->buffer);
+    free(a);
+}
+
+#undef aio_mutex_init
+#undef aio_mutex_destroy
+#undef aio_lock
+#undef aio_unlock
+#undef aio_cond_init
+#undef aio_cond_destroy
+#undef aio_wait
+#undef aio_broadcast
+#endif
+#endif
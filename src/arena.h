@@ -0,0 +1,314 @@
+/* arena.h - bump allocator for the buffers of one conversion in img2wav
+
+   Features:
+       + An allocation is a pointer bump inside a large block, 64 byte aligned for SIMD loads
+       + arena_reset() makes the whole arena available again without returning memory to the OS
+       + Blocks added while an arena grows are merged into one block on reset, so converting
+         images of similar sizes settles on a single block and never calls malloc again
+       + The last allocation can be grown in place or released, the pattern stb_image allocates in
+
+    Limitations:
+       + Memory other than the last allocation is only reclaimed by arena_reset()
+       + Not thread safe, use one arena per thread
+
+    DOCUMENTATION
+    =============
+    // Define ARENA_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define ARENA_IMPLEMENTATION
+    #include "arena.h"
+
+    // Create an arena, the first block holds at least size bytes. 0 allocates the first block on first use.
+    arena *a = arena_new(size);
+
+    // Make sure the next size bytes of allocations fit in the current block
+    arena_reserve(a, size);
+
+    // Allocate, grow the last allocation or release it. Pointers stay valid until arena_reset().
+    void *p = arena_alloc(a, size);
+    p = arena_realloc(a, p, old_size, new_size);
+    arena_release(a, p);
+
+    // Forget every allocation and keep the memory for the next conversion
+    arena_reset(a);
+
+    arena_free(a);
+*/
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+typedef struct arena arena;
+
+/**
+ * @brief Create an arena
+ *
+ * @param size Bytes of the first block, 0 allocates it on the first allocation
+ * @return Arena or NULL if it couldn't be allocated
+ */
+arena *arena_new(size_t size);
+
+/**
+ * @brief Make sure the next allocations of size bytes in total don't need another block
+ *
+ * An empty arena replaces a smaller block instead of adding one, so sizing the arena
+ * right after arena_reset() keeps it at one block.
+ *
+ * @param a Arena
+ * @param size Bytes about to be allocated
+ * @return 1 on success, 0 on failure
+ */
+int arena_reserve(arena *a, size_t size);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * @param a Arena
+ * @param size Bytes to allocate
+ * @return 64 byte aligned memory valid until arena_reset(), NULL on failure
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * @brief Resize an allocation of an arena
+ *
+ * The last allocation grows or shrinks in place when its block has room, any other one is copied.
+ *
+ * @param a Arena
+ * @param p Allocation to resize, NULL allocates
+ * @param old_size Current size of p
+ * @param size New size of p
+ * @return Resized allocation, NULL on failure in which case p is left as it was
+ */
+void *arena_realloc(arena *a, void *p, size_t old_size, size_t size);
+
+/**
+ * @brief Give back an allocation
+ *
+ * Only the last allocation is reclaimed right away, the memory of others stays used until arena_reset().
+ *
+ * @param a Arena
+ * @param p Allocation to release, may be NULL
+ */
+void arena_release(arena *a, void *p);
+
+/**
+ * @brief Check whether memory was allocated from an arena
+ *
+ * @param a Arena
+ * @param p Pointer to check
+ * @return 1 if p points into a block of a, 0 otherwise
+ */
+int arena_owns(const arena *a, const void *p);
+
+/**
+ * @brief Forget every allocation, merging the blocks into one that holds all of them
+ *
+ * @param a Arena
+ */
+void arena_reset(arena *a);
+
+/**
+ * @brief Bytes held by the blocks of an arena
+ *
+ * @param a Arena
+ * @return Sum of the sizes of every block
+ */
+size_t arena_capacity(const arena *a);
+
+/**
+ * @brief Number of blocks an arena allocated from the system since arena_new()
+ *
+ * @param a Arena
+ * @return Number of calls to malloc()
+ */
+size_t arena_blocks(const arena *a);
+
+/**
+ * @brief Deallocate an arena and every block of it
+ *
+ * @param a Arena to free, may be NULL
+ */
+void arena_free(arena *a);
+
+#ifdef ARENA_IMPLEMENTATION
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN     64               //!< Alignment of every allocation
+#define ARENA_MIN_BLOCK ((size_t) 1 << 20)//!< Smallest block added when an arena runs out of room
+
+/** Memory an arena allocates from, blocks are chained newest first */
+struct arena_block {
+    struct arena_block *next;//!< Previous block
+    unsigned char *data;     //!< First aligned byte
+    size_t size;             //!< Usable bytes from data
+    size_t used;             //!< Bytes allocated from data
+};
+
+struct arena {
+    struct arena_block *head;//!< Block allocations are taken from
+    size_t capacity;         //!< Sum of the sizes of every block
+    size_t blocks;           //!< Blocks allocated since arena_new()
+    unsigned char *last;     //!< Last allocation, the only one that can grow in place or be released
+};
+
+/** Round size up to ARENA_ALIGN, 0 if that overflows */
+size_t arena_round(size_t size) {
+    return size > SIZE_MAX - (ARENA_ALIGN - 1) ? 0 : (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+/** Allocate a block of size usable bytes */
+struct arena_block *arena_block_new(arena *a, size_t size) {
+    if (size > SIZE_MAX - sizeof(struct arena_block) - ARENA_ALIGN) return NULL;
+    struct arena_block *b = malloc(sizeof(*b) + ARENA_ALIGN + size);
+    if (!b) return NULL;
+
+    const uintptr_t data = ((uintptr_t) (b + 1) + ARENA_ALIGN - 1) & ~(uintptr_t) (ARENA_ALIGN - 1);
+    b->data              = (unsigned char *) data;
+    b->size              = size;
+    b->used              = 0;
+    a->blocks++;
+
+    return b;
+}
+
+/** Put a new block of at least size bytes in front, growing geometrically so a growing arena needs few blocks */
+int arena_grow(arena *a, size_t size) {
+    size_t n = a->capacity > ARENA_MIN_BLOCK ? a->capacity : ARENA_MIN_BLOCK;
+    if (n < size) n = size;
+
+    struct arena_block *b = arena_block_new(a, n);
+    if (!b) return 0;
+    b->next = a->head;
+    a->head = b;
+    a->last = NULL;// allocations of older blocks can't grow into the new one
+    a->capacity += n;
+
+    return 1;
+}
+
+arena *arena_new(size_t size) {
+    arena *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    if (size > 0 && !arena_reserve(a, size)) {
+        free(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+int arena_reserve(arena *a, size_t size) {
+    size = arena_round(size);
+    if (size == 0) return 0;
+
+    struct arena_block *b = a->head;
+    if (b && b->size - b->used >= size) return 1;
+    if (b && !b->next && b->used == 0) {
+        // nothing lives in the only block, swap it for a larger one
+        a->capacity -= b->size;
+        a->head = NULL;
+        free(b);
+    }
+
+    return arena_grow(a, size);
+}
+
+void *arena_alloc(arena *a, size_t size) {
+    size = arena_round(size > 0 ? size : 1);
+    if (size == 0) return NULL;
+
+    struct arena_block *b = a->head;
+    if (!b || b->size - b->used < size) {
+        if (!arena_grow(a, size)) return NULL;
+        b = a->head;
+    }
+
+    unsigned char *p = b->data + b->used;
+    b->used += size;
+    a->last = p;
+
+    return p;
+}
+
+void *arena_realloc(arena *a, void *p, size_t old_size, size_t size) {
+    if (!p) return arena_alloc(a, size);
+
+    struct arena_block *b = a->head;
+    if (p == a->last) {
+        // the last allocation always sits at the end of the head block
+        const size_t offset = (size_t) ((unsigned char *) p - b->data);
+        const size_t n      = arena_round(size > 0 ? size : 1);
+        if (n != 0 && n <= b->size - offset) {
+            b->used = offset + n;
+            return p;
+        }
+    }
+
+    void *q = arena_alloc(a, size);
+    if (q) memcpy(q, p, old_size < size ? old_size : size);
+
+    return q;
+}
+
+void arena_release(arena *a, void *p) {
+    if (!p || p != a->last) return;
+
+    a->head->used = (size_t) (a->last - a->head->data);
+    a->last       = NULL;
+}
+
+int arena_owns(const arena *a, const void *p) {
+    const unsigned char *c = p;
+    for (const struct arena_block *b = a->head; b; b = b->next)
+        if (c >= b->data && c < b->data + b->size) return 1;
+
+    return 0;
+}
+
+void arena_reset(arena *a) {
+    a->last = NULL;
+    if (!a->head) return;
+
+    if (a->head->next) {
+        // one block holding everything the last conversion needed, if that fails keep the newest block
+        struct arena_block *merged = arena_block_new(a, a->capacity);
+        struct arena_block *b      = merged ? a->head : a->head->next;
+        while (b) {
+            struct arena_block *next = b->next;
+            free(b);
+            b = next;
+        }
+        if (merged) a->head = merged;
+        a->head->next = NULL;
+        a->capacity   = a->head->size;
+    }
+    a->head->used = 0;
+}
+
+size_t arena_capacity(const arena *a) {
+    return a->capacity;
+}
+
+size_t arena_blocks(const arena *a) {
+    return a->blocks;
+}
+
+void arena_free(arena *a) {
+    if (!a) return;
+
+    struct arena_block *b = a->head;
+    while (b) {
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
+
+#undef ARENA_ALIGN
+#undef ARENA_MIN_BLOCK
+#endif
+#endif
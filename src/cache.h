@@ -0,0 +1,592 @@
+/* cache.h - on-disk cache of finished wav files for img2wav
+
+   Features:
+       + Entries are whole files named after a 64-bit key, so a hit is a plain file copy
+       + Streaming xxHash64 to build keys from decoded pixels and synthesis parameters
+       + Least recently used entries are evicted once the entries pass a size cap
+       + The last use of an entry is its file modification time, so the order survives across runs
+       + Entries are written to a temporary file and renamed, a failed conversion never leaves half an entry
+       + Thread safe, one cache can be shared by every converter of a batch
+       + Cross platform windows/unix/linux
+
+    Limitations:
+       + Processes sharing a directory only see the entries that existed when they opened it
+       + Keys are 64-bit, two different conversions hashing to the same key would share an entry
+
+    DOCUMENTATION
+    =============
+    // Define CACHE_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define CACHE_IMPLEMENTATION
+    #include "cache.h"
+
+    // Open a cache directory, creating it if needed, whose entries add up to at most max_bytes
+    cache *c = cache_open("cache", max_bytes);
+
+    // Hash everything the file depends on into a key
+    cache_hash h;
+    cache_hash_init(&h, 0);
+    cache_hash_update(&h, pixels, size);
+    cache_hash_update(&h, &params, sizeof(params));
+    const uint64_t key = cache_hash_digest(&h);
+
+    // A hit opens the entry for reading, copy it wherever the file goes
+    FILE *hit = cache_get(c, key);
+    if (hit) {
+        cache_copy(hit, out);
+        fclose(hit);
+    } else {
+        // On a miss write the file to a temporary path of the cache, then move it in.
+        // Entries past the size cap are evicted, least recently used first.
+        char temp[CACHE_PATH_MAX];
+        cache_temp(c, key, temp, sizeof(temp));
+        write_the_file(temp);
+        cache_put(c, key, temp);
+    }
+
+    // Hits, misses, evictions and the size of the entries
+    cache_stats st = cache_get_stats(c);
+
+    cache_free(c);
+*/
+#ifndef CACHE_H
+#define CACHE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CACHE_PATH_MAX 4096//!< Longest path of an entry or a temporary file
+
+typedef struct cache cache;
+
+/** State of a streaming xxHash64 */
+struct cache_hash {
+    uint64_t v[4];     //!< Accumulators of the 32 byte stripes
+    uint64_t seed;     //!< Seed of the hash
+    uint64_t total;    //!< Bytes hashed so far
+    uint8_t buffer[32];//!< Bytes of the stripe being filled
+    size_t length;     //!< Bytes in buffer
+};
+typedef struct cache_hash cache_hash;
+
+/** Counters of a cache */
+struct cache_stats {
+    uint64_t hits;     //!< Lookups that found an entry
+    uint64_t misses;   //!< Lookups that didn't
+    uint64_t evictions;//!< Entries removed to stay under the size cap
+    uint64_t entries;  //!< Entries in the cache
+    uint64_t bytes;    //!< Size of every entry
+};
+typedef struct cache_stats cache_stats;
+
+/**
+ * @brief Start a hash
+ *
+ * @param h Hash to initialize
+ * @param seed Seed, different seeds give unrelated hashes of the same data
+ */
+void cache_hash_init(cache_hash *h, uint64_t seed);
+
+/**
+ * @brief Add bytes to a hash
+ *
+ * @param h Hash
+ * @param data Bytes to add
+ * @param n Number of bytes
+ */
+void cache_hash_update(cache_hash *h, const void *data, size_t n);
+
+/**
+ * @brief Hash of every byte added so far, the hash can still be updated afterwards
+ *
+ * @param h Hash
+ * @return xxHash64 of the bytes
+ */
+uint64_t cache_hash_digest(const cache_hash *h);
+
+/**
+ * @brief Open a cache directory
+ *
+ * The directory is created if it doesn't exist and the entries it already holds are loaded,
+ * ordered by their modification times.
+ *
+ * @param dir Directory of the entries
+ * @param max_bytes Size cap of the entries
+ * @return Cache or NULL on failure
+ */
+cache *cache_open(const char *dir, uint64_t max_bytes);
+
+/**
+ * @brief Look up an entry and mark it as the most recently used
+ *
+ * @param c Cache
+ * @param key Key of the entry
+ * @return Entry opened for reading, NULL on a miss
+ */
+FILE *cache_get(cache *c, uint64_t key);
+
+/**
+ * @brief Path of a new temporary file in the cache directory, to be moved in with cache_put()
+ *
+ * @param c Cache
+ * @param key Key of the entry the file will become
+ * @param path Destination of the path
+ * @param size Size of path, CACHE_PATH_MAX always fits
+ * @return 1 on success, 0 if the path doesn't fit
+ */
+int cache_temp(cache *c, uint64_t key, char *path, size_t size);
+
+/**
+ * @brief Move a finished file into the cache and evict the least recently used entries past the size cap
+ *
+ * A file larger than the cap is removed instead.
+ *
+ * @param c Cache
+ * @param key Key of the entry
+ * @param temp Temporary file of cache_temp()
+ * @return 1 if the file became an entry, 0 otherwise, temp is gone either way
+ */
+int cache_put(cache *c, uint64_t key, const char *temp);
+
+/**
+ * @brief Copy the rest of a stream to another one
+ *
+ * @param in Stream to read
+ * @param out Stream to write
+ * @return 1 on success, 0 on failure
+ */
+int cache_copy(FILE *in, FILE *out);
+
+/**
+ * @brief Counters of a cache
+ *
+ * @param c Cache
+ * @return Hits, misses and evictions since cache_open() and the current entries
+ */
+cache_stats cache_get_stats(cache *c);
+
+/**
+ * @brief Deallocate a cache, the entries stay on disk
+ *
+ * @param c Cache to free, may be NULL
+ */
+void cache_free(cache *c);
+
+#ifdef CACHE_IMPLEMENTATION
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <direct.h>
+    #include <process.h>
+    #include <sys/utime.h>
+typedef CRITICAL_SECTION cache_mutex;
+    #define cache_mutex_init(m)    InitializeCriticalSection(m)
+    #define cache_mutex_destroy(m) DeleteCriticalSection(m)
+    #define cache_lock(m)          EnterCriticalSection(m)
+    #define cache_unlock(m)        LeaveCriticalSection(m)
+    #define cache_getpid()         _getpid()
+    #define cache_touch(path)      _utime((path), NULL)
+#else
+    #include <dirent.h>
+    #include <pthread.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+    #include <utime.h>
+typedef pthread_mutex_t cache_mutex;
+    #define cache_mutex_init(m)    pthread_mutex_init((m), NULL)
+    #define cache_mutex_destroy(m) pthread_mutex_destroy(m)
+    #define cache_lock(m)          pthread_mutex_lock(m)
+    #define cache_unlock(m)        pthread_mutex_unlock(m)
+    #define cache_getpid()         getpid()
+    #define cache_touch(path)      utime((path), NULL)
+#endif
+
+#define CACHE_P1         0x9E3779B185EBCA87ull
+#define CACHE_P2         0xC2B2AE3D27D4EB4Full
+#define CACHE_P3         0x165667B19E3779F9ull
+#define CACHE_P4         0x85EBCA77C2B2AE63ull
+#define CACHE_P5         0x27D4EB2F165667C5ull
+#define CACHE_EXTENSION  ".wav"//!< Extension of the entries, they are plain wav files
+#define CACHE_NAME_SIZE  20    //!< 16 hex digits of the key and the extension
+#define CACHE_COPY_BLOCK 65536 //!< Bytes moved by every fread and fwrite of cache_copy()
+
+/** One file of the cache */
+struct cache_entry {
+    uint64_t key; //!< Key the file is named after
+    uint64_t size;//!< Size of the file in bytes
+    uint64_t used;//!< Order of the last use, larger is more recent
+};
+
+struct cache {
+    char dir[CACHE_PATH_MAX];   //!< Directory of the entries
+    uint64_t max_bytes;         //!< Size cap of the entries
+    struct cache_entry *entries;//!< Every known entry, unordered
+    size_t n;                   //!< Number of entries
+    size_t cap;                 //!< Capacity of entries
+    uint64_t clock;             //!< Last use handed out, after the modification times of the loaded entries
+    uint64_t temps;             //!< Temporary files handed out, makes their names unique
+    cache_stats st;             //!< Counters, st.entries mirrors n
+    cache_mutex lock;           //!< Guards everything above
+};
+
+uint64_t cache_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t cache_read_64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t cache_read_32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/** Mix 8 bytes into an accumulator */
+uint64_t cache_round(uint64_t acc, uint64_t input) {
+    acc += input * CACHE_P2;
+    acc = cache_rotl(acc, 31);
+    return acc * CACHE_P1;
+}
+
+/** Fold an accumulator into the hash of a long input */
+uint64_t cache_merge(uint64_t h, uint64_t v) {
+    h ^= cache_round(0, v);
+    return h * CACHE_P1 + CACHE_P4;
+}
+
+void cache_hash_init(cache_hash *h, uint64_t seed) {
+    memset(h, 0, sizeof(*h));
+    h->seed = seed;
+    h->v[0] = seed + CACHE_P1 + CACHE_P2;
+    h->v[1] = seed + CACHE_P2;
+    h->v[2] = seed;
+    h->v[3] = seed - CACHE_P1;
+}
+
+void cache_hash_update(cache_hash *h, const void *data, size_t n) {
+    const uint8_t *p = data;
+    if (n == 0) return;
+    h->total += n;
+
+    if (h->length > 0) {
+        const size_t k = (n < 32 - h->length) ? n : 32 - h->length;
+        memcpy(h->buffer + h->length, p, k);
+        h->length += k;
+        p += k;
+        n -= k;
+        if (h->length < 32) return;
+        for (int i = 0; i < 4; i++)
+            h->v[i] = cache_round(h->v[i], cache_read_64(h->buffer + 8 * i));
+        h->length = 0;
+    }
+
+    // whole stripes straight from the input
+    for (; n >= 32; p += 32, n -= 32)
+        for (int i = 0; i < 4; i++)
+            h->v[i] = cache_round(h->v[i], cache_read_64(p + 8 * i));
+
+    memcpy(h->buffer, p, n);
+    h->length = n;
+}
+
+uint64_t cache_hash_digest(const cache_hash *h) {
+    uint64_t d;
+    if (h->total >= 32) {
+        d = cache_rotl(h->v[0], 1) + cache_rotl(h->v[1], 7) + cache_rotl(h->v[2], 12) + cache_rotl(h->v[3], 18);
+        for (int i = 0; i < 4; i++)
+            d = cache_merge(d, h->v[i]);
+    } else {
+        d = h->seed + CACHE_P5;
+    }
+    d += h->total;
+
+    const uint8_t *p = h->buffer;
+    size_t n         = h->length;
+    for (; n >= 8; p += 8, n -= 8) {
+        d ^= cache_round(0, cache_read_64(p));
+        d = cache_rotl(d, 27) * CACHE_P1 + CACHE_P4;
+    }
+    if (n >= 4) {
+        d ^= (uint64_t) cache_read_32(p) * CACHE_P1;
+        d = cache_rotl(d, 23) * CACHE_P2 + CACHE_P3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; p++, n--) {
+        d ^= *p * CACHE_P5;
+        d = cache_rotl(d, 11) * CACHE_P1;
+    }
+
+    d ^= d >> 33;
+    d *= CACHE_P2;
+    d ^= d >> 29;
+    d *= CACHE_P3;
+    d ^= d >> 32;
+
+    return d;
+}
+
+/** Path of the entry of a key, 0 if it doesn't fit */
+int cache_path(const cache *c, uint64_t key, char *path, size_t size) {
+    const int n = snprintf(path, size, "%s/%016llx" CACHE_EXTENSION, c->dir, (unsigned long long) key);
+    return n > 0 && (size_t) n < size;
+}
+
+/** Parse the key of an entry's file name, 0 if the name isn't one of an entry */
+int cache_parse_name(const char *name, uint64_t *key) {
+    if (strlen(name) != CACHE_NAME_SIZE || strcmp(name + 16, CACHE_EXTENSION) != 0) return 0;
+
+    uint64_t k = 0;
+    for (int i = 0; i < 16; i++) {
+        const char ch = name[i];
+        const int d   = (ch >= '0' && ch <= '9') ? ch - '0' : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10 : -1;
+        if (d < 0) return 0;
+        k = k << 4 | (uint64_t) d;
+    }
+    *key = k;
+
+    return 1;
+}
+
+/** Index of the entry of a key, c->n if there is none */
+size_t cache_find(const cache *c, uint64_t key) {
+    size_t i = 0;
+    while (i < c->n && c->entries[i].key != key) i++;
+
+    return i;
+}
+
+/** Add an entry, the caller checked there is none for its key */
+int cache_add(cache *c, uint64_t key, uint64_t size, uint64_t used) {
+    if (c->n == c->cap) {
+        const size_t cap            = c->cap ? c->cap * 2 : 64;
+        struct cache_entry *entries = realloc(c->entries, cap * sizeof(*entries));
+        if (!entries) return 0;
+        c->entries = entries;
+        c->cap     = cap;
+    }
+    c->entries[c->n++] = (struct cache_entry){key, size, used};
+    c->st.entries      = c->n;
+    c->st.bytes += size;
+
+    return 1;
+}
+
+/** Forget entry i, the file is left alone */
+void cache_drop(cache *c, size_t i) {
+    c->st.bytes -= c->entries[i].size;
+    c->entries[i] = c->entries[--c->n];
+    c->st.entries = c->n;
+}
+
+/** Remove the least recently used entries other than the one of keep, which may be NULL, until the entries fit under the cap */
+void cache_evict(cache *c, const uint64_t *keep) {
+    while (c->st.bytes > c->max_bytes) {
+        size_t lru = c->n;
+        for (size_t i = 0; i < c->n; i++)
+            if ((!keep || c->entries[i].key != *keep) && (lru == c->n || c->entries[i].used < c->entries[lru].used)) lru = i;
+        if (lru == c->n) break;
+
+        char path[CACHE_PATH_MAX];
+        if (cache_path(c, c->entries[lru].key, path, sizeof(path))) remove(path);
+        cache_drop(c, lru);
+        c->st.evictions++;
+    }
+}
+
+/** Load the entries of the cache directory, their last use is their modification time */
+int cache_scan(cache *c) {
+#ifdef _WIN32
+    char pattern[CACHE_PATH_MAX];
+    const int n = snprintf(pattern, sizeof(pattern), "%s\\*" CACHE_EXTENSION, c->dir);
+    if (n <= 0 || (size_t) n >= sizeof(pattern)) return 0;
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    if (find == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+    int ok = 1;
+    do {
+        uint64_t key;
+        if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !cache_parse_name(entry.cFileName, &key)) continue;
+        const uint64_t size = (uint64_t) entry.nFileSizeHigh << 32 | entry.nFileSizeLow;
+        const uint64_t used = (uint64_t) entry.ftLastWriteTime.dwHighDateTime << 32 | entry.ftLastWriteTime.dwLowDateTime;
+        ok                  = cache_add(c, key, size, used);
+        if (used > c->clock) c->clock = used;
+    } while (ok && FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR *d = opendir(c->dir);
+    if (!d) return 0;
+    int ok = 1;
+    for (struct dirent *entry; ok && (entry = readdir(d));) {
+        uint64_t key;
+        char path[CACHE_PATH_MAX];
+        struct stat st;
+        if (!cache_parse_name(entry->d_name, &key) || !cache_path(c, key, path, sizeof(path))) continue;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    #if defined(__linux__)
+        // nanoseconds tell apart the entries used within the same second
+        const uint64_t used = st.st_mtime > 0 ? (uint64_t) st.st_mtime * 1000000000u + (uint64_t) st.st_mtim.tv_nsec : 0;
+    #else
+        const uint64_t used = st.st_mtime > 0 ? (uint64_t) st.st_mtime : 0;
+    #endif
+        ok                  = cache_add(c, key, (uint64_t) st.st_size, used);
+        if (used > c->clock) c->clock = used;
+    }
+    closedir(d);
+#endif
+
+    return ok;
+}
+
+cache *cache_open(const char *dir, uint64_t max_bytes) {
+    cache *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+
+    const size_t len = strlen(dir);
+    if (len == 0 || len + 1 + CACHE_NAME_SIZE + 32 >= sizeof(c->dir)) {
+        free(c);
+        return NULL;
+    }
+    memcpy(c->dir, dir, len + 1);
+    c->max_bytes = max_bytes;
+
+#ifdef _WIN32
+    const int made = _mkdir(dir) == 0 || errno == EEXIST;
+#else
+    const int made = mkdir(dir, 0777) == 0 || errno == EEXIST;
+#endif
+    if (!made || !cache_scan(c)) {
+        free(c->entries);
+        free(c);
+        return NULL;
+    }
+    cache_mutex_init(&c->lock);
+
+    // entries left over from a larger cap go first
+    cache_lock(&c->lock);
+    cache_evict(c, NULL);
+    cache_unlock(&c->lock);
+
+    return c;
+}
+
+FILE *cache_get(cache *c, uint64_t key) {
+    char path[CACHE_PATH_MAX];
+    FILE *file = NULL;
+
+    cache_lock(&c->lock);
+    const size_t i = cache_find(c, key);
+    if (i < c->n && cache_path(c, key, path, sizeof(path))) {
+        // an entry removed by another process is forgotten
+        file = fopen(path, "rb");
+        if (file) {
+            c->entries[i].used = ++c->clock;
+            cache_touch(path);
+        } else {
+            cache_drop(c, i);
+        }
+    }
+    if (file)
+        c->st.hits++;
+    else
+        c->st.misses++;
+    cache_unlock(&c->lock);
+
+    return file;
+}
+
+int cache_temp(cache *c, uint64_t key, char *path, size_t size) {
+    cache_lock(&c->lock);
+    const unsigned long long id = ++c->temps;
+    cache_unlock(&c->lock);
+
+    const int n = snprintf(path, size, "%s/%016llx.%d.%llu.tmp", c->dir, (unsigned long long) key, (int) cache_getpid(), id);
+    return n > 0 && (size_t) n < size;
+}
+
+int cache_put(cache *c, uint64_t key, const char *temp) {
+    char path[CACHE_PATH_MAX];
+    FILE *file    = fopen(temp, "rb");
+    uint64_t size = 0;
+    int ok        = file && fseek(file, 0, SEEK_END) == 0;
+#ifdef _WIN32
+    if (ok) size = (uint64_t) _ftelli64(file);
+#else
+    if (ok) size = (uint64_t) ftello(file);
+#endif
+    if (file) fclose(file);
+    ok = ok && size <= c->max_bytes && cache_path(c, key, path, sizeof(path));
+
+    cache_lock(&c->lock);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp, path) == 0;
+#endif
+    if (ok) {
+        // the same conversion may have finished on another thread first
+        const size_t i = cache_find(c, key);
+        if (i < c->n) cache_drop(c, i);
+        ok = cache_add(c, key, size, ++c->clock);
+        cache_evict(c, &key);
+    }
+    cache_unlock(&c->lock);
+    if (!ok) remove(temp);
+
+    return ok;
+}
+
+int cache_copy(FILE *in, FILE *out) {
+    char *block = malloc(CACHE_COPY_BLOCK);
+    if (!block) return 0;
+
+    int ok = 1;
+    for (size_t n; ok && (n = fread(block, 1, CACHE_COPY_BLOCK, in)) > 0;)
+        ok = fwrite(block, 1, n, out) == n;
+    ok = ok && !ferror(in);
+    free(block);
+
+    return ok;
+}
+
+cache_stats cache_get_stats(cache *c) {
+    cache_lock(&c->lock);
+    const cache_stats st = c->st;
+    cache_unlock(&c->lock);
+
+    return st;
+}
+
+void cache_free(cache *c) {
+    if (!c) return;
+
+    cache_mutex_destroy(&c->lock);
+    free(c->entries);
+    free(c);
+}
+
+#undef cache_mutex_init
+#undef cache_mutex_destroy
+#undef cache_lock
+#undef cache_unlock
+#undef cache_getpid
+#undef cache_touch
+#undef CACHE_P1
+#undef CACHE_P2
+#undef CACHE_P3
+#undef CACHE_P4
+#undef CACHE_P5
+#undef CACHE_EXTENSION
+#undef CACHE_NAME_SIZE
+#undef CACHE_COPY_BLOCK
+#endif
+#endif
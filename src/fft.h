@@ -0,0 +1,157 @@
+/* fft.h - in-place radix-2 complex fast fourier transform for img2wav
+
+   Features:
+       + Iterative radix-2 decimation in time, no recursion
+       + Precomputed twiddle and bit reversal tables per transform size
+       + Split real/imaginary float arrays
+
+    Limitations:
+       + Transform size must be a power of two
+       + Results are unnormalized in both directions
+
+    DOCUMENTATION
+    =============
+    // Define FFT_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define FFT_IMPLEMENTATION
+    #include "fft.h"
+
+    // Transforms are executed through a plan that owns the tables for one size.
+    fft_plan *plan = fft_plan_new(1024);
+
+    // re and im hold 1024 values each and are transformed in place.
+    // Pass FFT_FORWARD for exp(-i...) and FFT_INVERSE for exp(+i...)
+    fft_execute(plan, re, im, FFT_INVERSE);
+
+    // An inverse transform is scaled by n, divide by plan->n to normalize
+    fft_plan_free(plan);
+*/
+#ifndef FFT_H
+#define FFT_H
+#include <stddef.h>
+
+#define FFT_FORWARD 0//!< Transform with exp(-2 pi i k n / N)
+#define FFT_INVERSE 1//!< Transform with exp(+2 pi i k n / N)
+
+/** Precomputed tables for a transform of size n */
+struct fft_plan {
+    size_t n;     //!< Transform size
+    float *cos_t; //!< cos(2 pi k / n) for k in [0, n / 2)
+    float *sin_t; //!< sin(2 pi k / n) for k in [0, n / 2)
+    size_t *rev;  //!< Bit reversed index of every k in [0, n)
+};
+typedef struct fft_plan fft_plan;
+
+/**
+ * @brief Create the tables for a transform of size n
+ *
+ * @param n Transform size, must be a power of two
+ * @return Transform plan or NULL if n is invalid or allocation failed
+ */
+fft_plan *fft_plan_new(size_t n);
+
+/**
+ * @brief Deallocate a transform plan
+ *
+ * @param plan Plan to free, may be NULL
+ */
+void fft_plan_free(fft_plan *plan);
+
+/**
+ * @brief Transform complex data in place
+ *
+ * @param plan Plan created for the size of re and im
+ * @param re Real part of the data, plan->n values
+ * @param im Imaginary part of the data, plan->n values
+ * @param direction Either FFT_FORWARD or FFT_INVERSE
+ */
+void fft_execute(const fft_plan *plan, float *re, float *im, int direction);
+
+#ifdef FFT_IMPLEMENTATION
+#include <math.h>
+#include <stdlib.h>
+
+#define FFT_TWO_PI 6.28318530717958647692
+
+fft_plan *fft_plan_new(size_t n) {
+    if (n < 2 || (n & (n - 1)) != 0) return NULL;
+
+    fft_plan *plan = calloc(1, sizeof(*plan));
+    if (!plan) return NULL;
+
+    plan->n     = n;
+    plan->cos_t = malloc(sizeof(*plan->cos_t) * (n / 2));
+    plan->sin_t = malloc(sizeof(*plan->sin_t) * (n / 2));
+    plan->rev   = malloc(sizeof(*plan->rev) * n);
+    if (!plan->cos_t || !plan->sin_t || !plan->rev) {
+        fft_plan_free(plan);
+        return NULL;
+    }
+
+    // twiddles are computed in double so large transforms don't accumulate error
+    for (size_t k = 0; k < n / 2; k++) {
+        const double theta = FFT_TWO_PI * (double) k / (double) n;
+        plan->cos_t[k]     = (float) cos(theta);
+        plan->sin_t[k]     = (float) sin(theta);
+    }
+
+    unsigned bits = 0;
+    while (((size_t) 1 << bits) < n) bits++;
+
+    for (size_t k = 0; k < n; k++) {
+        size_t r = 0;
+        for (unsigned b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        plan->rev[k] = r;
+    }
+
+    return plan;
+}
+
+void fft_plan_free(fft_plan *plan) {
+    if (!plan) return;
+    free(plan->cos_t);
+    free(plan->sin_t);
+    free(plan->rev);
+    free(plan);
+}
+
+void fft_execute(const fft_plan *plan, float *re, float *im, int direction) {
+    const size_t n   = plan->n;
+    const float sign = (direction == FFT_INVERSE) ? 1.0f : -1.0f;
+
+    for (size_t k = 0; k < n; k++) {
+        const size_t r = plan->rev[k];
+        if (r > k) {
+            float t = re[k];
+            re[k]   = re[r];
+            re[r]   = t;
+            t       = im[k];
+            im[k]   = im[r];
+            im[r]   = t;
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half   = len / 2;
+        const size_t stride = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t j = 0; j < half; j++) {
+                const float wr = plan->cos_t[j * stride];
+                const float wi = sign * plan->sin_t[j * stride];
+                const size_t a = i + j;
+                const size_t b = a + half;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b]          = re[a] - tr;
+                im[b]          = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+#undef FFT_TWO_PI
+#endif
+#endif
@@ -5,14 +5,23 @@
 #endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
 
-#define _USE_MATH_DEFINES
-#include <math.h>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <signal.h>
+    #include <sys/stat.h>
+#endif
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "img2wav.h"
+#include "pool.h"
 
-#include "wav.h"
+#define SERVE_IMPLEMENTATION
+#include "serve.h"
 
 #define check_error(error, description, retval)                                 \
     do {                                                                        \
@@ -22,140 +31,863 @@
         }                                                                       \
     } while (0);
 
-/** Remaps a value from a source range to a target range. */
-float map(float src, float src_min, float src_max, float target_min, float target_max) {
-    return target_min + ((target_max - target_min) * (src - src_min)) / (src_max - src_min);
+struct batch_item {
+    char *input;   //!< Input image path
+    char *output;  //!< Output wav path
+    int samples;   //!< Number of samples written, 0 on failure
+    double seconds;//!< Time spent converting the image
+};
+
+/** Images converted by a single process */
+struct batch {
+    struct batch_item *items;  //!< Images in manifest or directory order
+    size_t n;                  //!< Number of images
+    size_t cap;                //!< Capacity of items
+    img2wav_ctx **conv;        //!< Context of every worker
+    const struct options *opts;//!< Command line options shared by every image
+};
+
+/** Allocate a copy of the first n characters of a string */
+char *copy_string(const char *src, size_t n) {
+    char *dst = malloc(n + 1);
+    check_error(!dst, "malloc(): Failed to allocate string", NULL);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+
+    return dst;
+}
+
+/** Check if a path is an existing directory */
+int is_directory(const char *path) {
+#ifdef _WIN32
+    const DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+/** Check if a file name has the extension of an image stb_image can load */
+int is_image(const char *name) {
+    static const char *extensions[] = {"jpg", "jpeg", "png", "bmp", "tga", "gif", "psd", "hdr", "pic", "pnm", "ppm", "pgm"};
+    const char *dot                 = strrchr(name, '.');
+    if (!dot) return 0;
+
+    char ext[8];
+    size_t n = 0;
+    for (const char *p = dot + 1; *p; p++) {
+        if (n == sizeof(ext) - 1) return 0;
+        ext[n++] = (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    }
+    ext[n] = '\0';
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(*extensions); i++)
+        if (strcmp(ext, extensions[i]) == 0) return 1;
+
+    return 0;
 }
 
-/** Find absolute maximum value in array */
-float find_max(float *src, size_t n) {
-    float max = 0.0f;
-    for (size_t i = 0; i < n; i++)
-        if (fabs(src[i]) > max)
-            max = src[i];
+/**
+ * @brief Path of the wav file of an image, the image's name with a .wav extension
+ *
+ * @param input Input image path
+ * @param dir Directory of the wav file, NULL uses the directory of the image
+ * @return Allocated output path
+ */
+char *batch_output(const char *input, const char *dir) {
+    const char *name = input;
+    for (const char *p = input; *p; p++)
+        if (*p == '/' || *p == '\\') name = p + 1;
+
+    const char *dot  = strrchr(name, '.');
+    const size_t len = dot ? (size_t) (dot - name) : strlen(name);
+    const char *base = dir ? dir : input;
+    size_t base_len  = dir ? strlen(dir) : (size_t) (name - input);
+
+    char *output = malloc(base_len + len + 6);
+    check_error(!output, "malloc(): Failed to allocate output path", NULL);
+
+    memcpy(output, base, base_len);
+    if (dir && base_len > 0 && dir[base_len - 1] != '/' && dir[base_len - 1] != '\\') output[base_len++] = '/';
+    memcpy(output + base_len, name, len);
+    memcpy(output + base_len + len, ".wav", 5);
 
-    return fabs(max);
+    return output;
 }
 
-/** Normalize values in array to be [-1.0, 1.0] */
-void normalize(float *src, size_t n) {
-    float max = find_max(src, n);
-    if (max > 1.0)
-        for (size_t i = 0; i < n; i++)
-            src[i] /= max;
+/** Append an image to a batch, output may be NULL to derive it from the input */
+int batch_add(struct batch *b, const char *input, size_t input_len, const char *output) {
+    if (b->n == b->cap) {
+        const size_t cap         = b->cap ? b->cap * 2 : 64;
+        struct batch_item *items = realloc(b->items, cap * sizeof(*items));
+        check_error(!items, "realloc(): Failed to allocate batch", 0);
+        b->items = items;
+        b->cap   = cap;
+    }
+
+    check_error(output && strcmp(output, "-") == 0, "Batch images can't be written to stdout", 0);
+
+    struct batch_item *item = &b->items[b->n];
+    memset(item, 0, sizeof(*item));
+    item->input  = copy_string(input, input_len);
+    item->output = !item->input ? NULL : output ? copy_string(output, strlen(output)) : batch_output(item->input, b->opts->out_dir);
+    if (!item->output) {
+        free(item->input);
+        return 0;
+    }
+    b->n++;
+
+    return 1;
 }
 
 /**
- * @brief Convert an image into a Width x Height sized array of greyscale values between [0, 255].
- * 
- * @param path Path to the image to convert
- * @param width Pointer to a variable that stores the width of an image
- * @param height Pointer to a variable that stores the height of an image
- * @return An array of pixels x by y in size containing values [0, 255]
-*/
-int *get_pixels(const char *path, int *width, int *height) {
-    int n;
-    unsigned char *data = stbi_load(path, width, height, &n, 3);
-    check_error(!data, "stbi_load(): Failed to open file", NULL);
-    check_error(n != 3, "stbi_load(): Image stride must be 3 (RGB)", NULL);
-
-    const size_t x = *width;
-    const size_t y = *height;
-
-    int *pixels = malloc(x * y * sizeof(*pixels));
-    check_error(!pixels, "malloc(): Failed to allocate pixels", NULL);
-
-    for (int i = 0; i < y; i++) {
-        int col = 0;
-        for (int j = 0; j < x * n; j += n) {
-            const int r = data[i * (x * n) + j];
-            const int g = data[i * (x * n) + j + 1];
-            const int b = data[i * (x * n) + j + 2];
-
-            // convert the image to gray scale using Luma BT.601
-            pixels[i * x + col] = (r * 0.299 + g * 0.587 + b * 0.114);
-            col++;
+ * @brief Read the images of a manifest
+ *
+ * Every line holds an image path, optionally followed by a tab and the wav path.
+ * Empty lines and lines starting with # are ignored.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int batch_read_manifest(struct batch *b, const char *path) {
+    FILE *file = fopen(path, "r");
+    check_error(!file, "fopen(): Failed to open manifest", 0);
+
+    char line[4096];
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file)) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' '))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+
+        char *tab = strchr(line, '\t');
+        if (tab) *tab = '\0';
+        ok = batch_add(b, line, strlen(line), (tab && tab[1]) ? tab + 1 : NULL);
+    }
+    fclose(file);
+
+    return ok;
+}
+
+/** Order batch items by input path */
+int batch_compare(const void *a, const void *b) {
+    return strcmp(((const struct batch_item *) a)->input, ((const struct batch_item *) b)->input);
+}
+
+/**
+ * @brief Read every image of a directory, sorted by name
+ *
+ * @return 1 on success, 0 on failure
+ */
+int batch_read_dir(struct batch *b, const char *dir) {
+    const size_t dir_len = strlen(dir);
+    const int slash      = dir_len > 0 && dir[dir_len - 1] != '/' && dir[dir_len - 1] != '\\';
+    int ok               = 1;
+    char path[4096];
+
+#ifdef _WIN32
+    check_error(dir_len + 3 > sizeof(path), "Directory path is too long", 0);
+    snprintf(path, sizeof(path), "%s%s*", dir, slash ? "\\" : "");
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(path, &entry);
+    check_error(find == INVALID_HANDLE_VALUE, "FindFirstFileA(): Failed to open directory", 0);
+    do {
+        const char *name = entry.cFileName;
+        if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !is_image(name)) continue;
+#else
+    DIR *d = opendir(dir);
+    check_error(!d, "opendir(): Failed to open directory", 0);
+    for (struct dirent *entry; ok && (entry = readdir(d));) {
+        const char *name = entry->d_name;
+        if (!is_image(name)) continue;
+#endif
+        const int n = snprintf(path, sizeof(path), "%s%s%s", dir, slash ? "/" : "", name);
+        ok          = n > 0 && (size_t) n < sizeof(path) && batch_add(b, path, n, NULL);
+#ifdef _WIN32
+    } while (ok && FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    }
+    closedir(d);
+#endif
+
+    // directory order is arbitrary, sort it so the summary is reproducible
+    if (b->n > 1) qsort(b->items, b->n, sizeof(*b->items), batch_compare);
+
+    return ok;
+}
+
+/** Convert one image of a batch with the context of the worker */
+void batch_image(void *ctx, int worker, size_t task) {
+    struct batch *b         = ctx;
+    struct batch_item *item = &b->items[task];
+    const double start      = now();
+
+    item->samples = convert(b->conv[worker], b->opts, item->input, item->output);
+    item->seconds = now() - start;
+}
+
+/**
+ * @brief Convert every image of a manifest or directory and print their throughput
+ *
+ * Images are spread over opts->jobs workers, each one keeps its context across images
+ * so threads, fft plans, oscillator banks and output buffers are only allocated once.
+ *
+ * @param opts Command line options
+ * @return 1 if every image was converted, 0 otherwise
+ */
+int batch_run(const struct options *opts) {
+    struct batch b = {NULL, 0, 0, NULL, opts};
+    int ok         = is_directory(opts->batch) ? batch_read_dir(&b, opts->batch) : batch_read_manifest(&b, opts->batch);
+
+    pool *images = ok ? pool_new(opts->jobs > 0 ? opts->jobs : pool_cpu_count()) : NULL;
+    const int n  = images ? pool_size(images) : 0;
+    b.conv       = calloc(n > 0 ? n : 1, sizeof(*b.conv));
+    ok           = ok && images && b.conv;
+    for (int w = 0; ok && w < n; w++)
+        ok = (b.conv[w] = img2wav_ctx_new(opts->synth.threads)) != NULL;
+
+    // every context shares one cache, so an image converted twice is rendered once
+    cache *shared = (ok && opts->cache_dir) ? cache_open(opts->cache_dir, opts->cache_size) : NULL;
+    if (ok && opts->cache_dir && !shared) fprintf(stderr, "cache_open(): Failed to open %s\n", opts->cache_dir);
+    ok = ok && (!opts->cache_dir || shared);
+    for (int w = 0; ok && w < n; w++)
+        img2wav_ctx_set_cache(b.conv[w], shared);
+
+    if (ok) {
+        const double start = now();
+        pool_run(images, b.n, NULL, batch_image, &b);
+        const double wall = now() - start;
+
+        size_t failed = 0;
+        double total  = 0.0;
+        for (size_t i = 0; i < b.n; i++) {
+            const struct batch_item *item = &b.items[i];
+            if (item->samples > 0) {
+                printf("%s -> %s: %d samples in %.3f s (%.2f Msamples/s)\n", item->input, item->output,
+                       item->samples, item->seconds, item->samples / (item->seconds * 1e6));
+                total += item->samples;
+            } else {
+                printf("%s -> %s: failed\n", item->input, item->output);
+                failed++;
+            }
         }
+        printf("batch: %zu images, %zu failed, %.0f samples in %.3f s (%.2f images/s, %.2f Msamples/s)\n",
+               b.n, failed, total, wall, b.n / wall, total / (wall * 1e6));
+        if (opts->stats) stats_print(stderr, b.conv, n, wall);
+        ok = failed == 0;
+    }
+
+    for (int w = 0; b.conv && w < n; w++)
+        img2wav_ctx_free(b.conv[w]);
+    for (size_t i = 0; i < b.n; i++) {
+        free(b.items[i].input);
+        free(b.items[i].output);
     }
+    free(b.items);
+    free(b.conv);
+    pool_free(images);
+    cache_free(shared);
 
-    stbi_image_free(data);
+    return ok;
+}
 
-    return pixels;
+/** Print the command line usage */
+void usage(void) {
+    printf("img2wav - Convert an image to the frequency spectrum of an audio file\n"
+           "Usage: img2wav [options] [sample_rate] [time_s] in.jpg out.wav\n"
+           "       in.jpg - reads the image from stdin, out.wav - writes the wav file to stdout\n"
+           "       img2wav [options] --batch manifest|directory [sample_rate] [time_s]\n"
+           "       img2wav [options] --serve socket\n"
+           "Options:\n"
+           "  --engine fft|osc|table|sinf|gpu|additive\n"
+           "                             Synthesis engine, additive is the per sample sin() reference and fft\n"
+           "                             plays the rows that sit on a frequency bin with one inverse FFT per column (default: osc)\n"
+           "  --fft-size N               Frame size of the fft engine, a power of two (default: the smallest whose bins hold the rows)\n"
+           "  --simd auto|scalar|sse|avx2|avx512|neon\n"
+           "                             Kernel of the osc engine (default: auto, the fastest the CPU supports)\n"
+           "  --table-size N             Wavetable size of the table engine, a power of two, larger is more precise (default: 4096)\n"
+           "  --interp linear|cubic      Wavetable interpolation of the table engine, cubic allows far smaller tables (default: linear)\n"
+           "  --phase restart|continuous Restart every row at each column or keep one oscillator per row for the whole\n"
+           "                             signal, continuous avoids clicks at column edges so shorter time_s stay clean\n"
+           "                             (default: restart)\n"
+           "  --crossfade F              Fraction of each column cross-faded from the previous one, in [0, 1] (default: 0)\n"
+           "  --min-freq HZ              Frequency of the first row of the image (default: 0, 20 with --freq-scale log)\n"
+           "  --max-freq HZ|nyquist      Frequency one row past the last row of the image, rows at or above half the\n"
+           "                             sample rate are dropped before synthesis instead of aliasing (default: nyquist)\n"
+           "  --freq-scale linear|log|mel\n"
+           "                             Spacing of the rows between --min-freq and --max-freq, log gives every octave as\n"
+           "                             many rows and mel follows the pitch resolution of the ear (default: linear)\n"
+           "  --threads N                Number of threads rendering columns, 0 uses every processor (default: 1)\n"
+           "  --stream                   Write columns as they are synthesized, memory no longer grows with time_s\n"
+           "  --ring N                   Number of columns buffered by --stream (default: 4 per thread)\n"
+           "  --peak exact|bound         Normalize by the largest sample or by the largest column amplitude sum,\n"
+           "                             bound needs no second pass with --stream but is quieter (default: exact)\n"
+           "  --io-depth N               Blocks of --stream columns queued for the writer thread while the next ones\n"
+           "                             are rendered, 1 writes on the rendering thread (default: 2)\n"
+           "  --io-block BYTES           Bytes of the wav file encoded before each write (default: 65536)\n"
+           "  --luma bt601|bt709         Coefficients converting RGB images to luma (default: bt601)\n"
+           "  --gray                     Decode colour images to one channel with stb_image, faster but ignores --luma\n"
+           "  --depth 8|16               Bits per pixel kept from the image, 16 keeps the precision of 16 bit and HDR images (default: 8)\n"
+           "  --channels mono|rgb|tiles  Channels of the wav file, rgb renders the red, green and blue planes and tiles\n"
+           "                             cuts the image into --tiles strips side by side, the channels render\n"
+           "                             concurrently with --threads threads each (default: mono)\n"
+           "  --tiles N                  Number of channels of --channels tiles, between 1 and 64 (default: 2)\n"
+           "  --container auto|wav|rf64|w64\n"
+           "                             Container of the wav file, auto writes RIFF and switches to RF64 once the\n"
+           "                             data passes 4 GiB, w64 is Sony Wave64 (default: auto)\n"
+           "  --batch PATH               Convert every image of a directory or of a manifest, one image per line\n"
+           "                             optionally followed by a tab and the wav path\n"
+           "  --out-dir DIR              Directory of the wav files of --batch (default: next to each image)\n"
+           "  --jobs N                   Number of images of --batch or requests of --serve converted at once, each with\n"
+           "                             --threads threads, 0 uses every processor (default: 1)\n"
+           "  --cache DIR                Keep finished wav files in DIR and copy them instead of rendering an image\n"
+           "                             again with the same pixels and options\n"
+           "  --cache-size MB            Size cap of --cache, least recently used files are evicted past it (default: 1024)\n"
+           "  --preview                  Write the first --ring columns downscaled to --preview-rows rows within milliseconds,\n"
+           "                             then the rest as it is synthesized, normalized like --peak bound. The first\n"
+           "                             columns are rewritten at full quality at the end unless writing to stdout\n"
+           "  --preview-rows N           Rows of the first columns of --preview (default: 64)\n"
+           "  --incremental              Keep the hash and peak of every column next to the wav file in out.wav.cols\n"
+           "                             and only render the columns that changed since the last run\n"
+           "  --serve PATH               Convert the images of requests on a Unix socket until SIGINT or SIGTERM, a request\n"
+           "                             is a line of [options] sample_rate time_s followed by the image, the reply is the\n"
+           "                             wav file or a line starting with ERR\n"
+           "  --queue N                  Most requests of --serve waiting for a worker, the others get ERR busy (default: 64)\n"
+           "  --serve-batch N            Most waiting requests of --serve a worker takes at once, mono requests with the\n"
+           "                             same options and image size share one synthesis pass (default: 8)\n"
+           "  --stats                    Print the time spent in every stage, pixel, sample and cache counters and\n"
+           "                             the work of every thread as JSON on stderr\n");
 }
 
 /**
- * @brief Convert pixel data to frequency data for use in generating audio files
- * 
- * @param pixels Single channel pixel data of values between [0, 255]
- * @param sample_rate Desired sample rate of the frequencies
- * @param time_s Length in seconds of the transmission time
- * @param width Width of the pixel data
- * @param height Height of the pixel data
- * @param size Pointer to the number of generated amplitudes
- * @return Array of amplitudes corresponding to the frequencies generated
-*/
-float *get_freqs(const int *pixels, float sample_rate, float time_s, int width, int height, int *size) {
-    const float two_pi   = M_PI * 2.0;
-    const float fs       = sample_rate;
-    const int target     = (fs * time_s) / width;
-    const float max_freq = 48000.0;// maximum displayed frequency in the spectrogram
-    const float scale    = max_freq / height;
-    *size                = time_s * fs;
-
-    float *result = calloc(*size, sizeof(*result));
-    check_error(!result, "calloc(): Failed to allocate result", NULL);
-
-    float *rp = result;
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            if (pixels[y * width + x] < 10) continue;// skip nonexistant pixels
-
-            const float heat = pixels[y * width + x];
-            const float A    = map(heat, 0.0f, 255.0f, 0.001f, 1.0f);
-            int t            = 0;
-            while (t < target) {
-                // do (height - y) * scale to flip the image upside down
-                const float fc = y * scale;
-                rp[t] += A * sin(two_pi * (fc / fs) * t);
-                t++;
+ * @brief Parse a command line over the current options
+ *
+ * Options that aren't given keep their value, so a request of --serve starts from the options of the server.
+ *
+ * @return 1 on success, 0 if the command line is invalid
+ */
+int parse_options(int argc, char **argv, struct options *opts) {
+    const char *positional[4];
+    int np = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg   = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--engine") == 0) {
+            check_error(!value, "--engine requires a value", 0);
+            if (strcmp(value, "fft") == 0)
+                opts->synth.engine = SYNTH_FFT;
+            else if (strcmp(value, "osc") == 0)
+                opts->synth.engine = SYNTH_OSC;
+            else if (strcmp(value, "additive") == 0)
+                opts->synth.engine = SYNTH_ADDITIVE;
+            else if (strcmp(value, "table") == 0)
+                opts->synth.engine = SYNTH_TABLE;
+            else if (strcmp(value, "sinf") == 0)
+                opts->synth.engine = SYNTH_SINF;
+            else if (strcmp(value, "gpu") == 0)
+                opts->synth.engine = SYNTH_GPU;
+            else
+                check_error(1, "--engine must be either fft, osc, table, sinf, gpu or additive", 0);
+            i++;
+        } else if (strcmp(arg, "--fft-size") == 0) {
+            check_error(!value, "--fft-size requires a value", 0);
+            const int n = atoi(value);
+            check_error(n < 2 || (n & (n - 1)) != 0, "--fft-size must be a power of two", 0);
+            opts->synth.fft_size = n;
+            i++;
+        } else if (strcmp(arg, "--table-size") == 0) {
+            check_error(!value, "--table-size requires a value", 0);
+            const int n = atoi(value);
+            check_error(n < 16 || n > (1 << TABLE_MAX_BITS) || (n & (n - 1)) != 0, "--table-size must be a power of two between 16 and 2^24", 0);
+            opts->synth.table_size = n;
+            i++;
+        } else if (strcmp(arg, "--interp") == 0) {
+            check_error(!value, "--interp requires a value", 0);
+            if (strcmp(value, "linear") == 0)
+                opts->synth.interp = TABLE_LINEAR;
+            else if (strcmp(value, "cubic") == 0)
+                opts->synth.interp = TABLE_CUBIC;
+            else
+                check_error(1, "--interp must be either linear or cubic", 0);
+            i++;
+        } else if (strcmp(arg, "--phase") == 0) {
+            check_error(!value, "--phase requires a value", 0);
+            if (strcmp(value, "restart") == 0)
+                opts->synth.phase = PHASE_RESTART;
+            else if (strcmp(value, "continuous") == 0)
+                opts->synth.phase = PHASE_CONTINUOUS;
+            else
+                check_error(1, "--phase must be either restart or continuous", 0);
+            i++;
+        } else if (strcmp(arg, "--crossfade") == 0) {
+            check_error(!value, "--crossfade requires a value", 0);
+            opts->synth.crossfade = atof(value);
+            check_error(!(opts->synth.crossfade >= 0.0f && opts->synth.crossfade <= 1.0f), "--crossfade must be between 0 and 1", 0);
+            i++;
+        } else if (strcmp(arg, "--min-freq") == 0) {
+            check_error(!value, "--min-freq requires a value", 0);
+            opts->synth.min_freq = atof(value);
+            check_error(!(opts->synth.min_freq >= 0.0f), "--min-freq must not be negative", 0);
+            i++;
+        } else if (strcmp(arg, "--max-freq") == 0) {
+            check_error(!value, "--max-freq requires a value", 0);
+            opts->synth.max_freq = strcmp(value, "nyquist") == 0 ? 0.0f : atof(value);
+            check_error(!(opts->synth.max_freq > 0.0f) && strcmp(value, "nyquist") != 0, "--max-freq must be greater than 0 or nyquist", 0);
+            i++;
+        } else if (strcmp(arg, "--freq-scale") == 0) {
+            check_error(!value, "--freq-scale requires a value", 0);
+            if (strcmp(value, "linear") == 0)
+                opts->synth.mapping = FREQ_LINEAR;
+            else if (strcmp(value, "log") == 0)
+                opts->synth.mapping = FREQ_LOG;
+            else if (strcmp(value, "mel") == 0)
+                opts->synth.mapping = FREQ_MEL;
+            else
+                check_error(1, "--freq-scale must be either linear, log or mel", 0);
+            i++;
+        } else if (strcmp(arg, "--threads") == 0) {
+            check_error(!value, "--threads requires a value", 0);
+            opts->synth.threads = atoi(value);
+            check_error(opts->synth.threads < 0, "--threads must not be negative", 0);
+            i++;
+        } else if (strcmp(arg, "--preview") == 0) {
+            opts->preview = 1;
+        } else if (strcmp(arg, "--preview-rows") == 0) {
+            check_error(!value, "--preview-rows requires a value", 0);
+            opts->preview_rows = atoi(value);
+            check_error(opts->preview_rows < 1, "--preview-rows must be at least 1", 0);
+            i++;
+        } else if (strcmp(arg, "--incremental") == 0) {
+            opts->incremental = 1;
+        } else if (strcmp(arg, "--stream") == 0) {
+            opts->stream = 1;
+        } else if (strcmp(arg, "--ring") == 0) {
+            check_error(!value, "--ring requires a value", 0);
+            opts->ring = atoi(value);
+            check_error(opts->ring < 1, "--ring must be greater than 0", 0);
+            i++;
+        } else if (strcmp(arg, "--peak") == 0) {
+            check_error(!value, "--peak requires a value", 0);
+            if (strcmp(value, "exact") == 0)
+                opts->peak = PEAK_EXACT;
+            else if (strcmp(value, "bound") == 0)
+                opts->peak = PEAK_BOUND;
+            else
+                check_error(1, "--peak must be either exact or bound", 0);
+            i++;
+        } else if (strcmp(arg, "--io-depth") == 0) {
+            check_error(!value, "--io-depth requires a value", 0);
+            opts->io_depth = atoi(value);
+            check_error(opts->io_depth < 1, "--io-depth must be at least 1", 0);
+            i++;
+        } else if (strcmp(arg, "--io-block") == 0) {
+            check_error(!value, "--io-block requires a value", 0);
+            const long block = atol(value);
+            check_error(block < 1 || block > (1L << 30), "--io-block must be between 1 and 1073741824", 0);
+            opts->io_block = (size_t) block;
+            i++;
+        } else if (strcmp(arg, "--simd") == 0) {
+            check_error(!value, "--simd requires a value", 0);
+            opts->synth.simd = value;
+            i++;
+        } else if (strcmp(arg, "--luma") == 0) {
+            check_error(!value, "--luma requires a value", 0);
+            if (strcmp(value, "bt601") == 0)
+                opts->decode.luma = LUMA_BT601;
+            else if (strcmp(value, "bt709") == 0)
+                opts->decode.luma = LUMA_BT709;
+            else
+                check_error(1, "--luma must be either bt601 or bt709", 0);
+            i++;
+        } else if (strcmp(arg, "--gray") == 0) {
+            opts->decode.gray = 1;
+        } else if (strcmp(arg, "--depth") == 0) {
+            check_error(!value, "--depth requires a value", 0);
+            opts->synth.depth = atoi(value);
+            check_error(opts->synth.depth != 8 && opts->synth.depth != 16, "--depth must be either 8 or 16", 0);
+            i++;
+        } else if (strcmp(arg, "--channels") == 0) {
+            check_error(!value, "--channels requires a value", 0);
+            if (strcmp(value, "mono") == 0)
+                opts->channels = CHANNELS_MONO;
+            else if (strcmp(value, "rgb") == 0)
+                opts->channels = CHANNELS_RGB;
+            else if (strcmp(value, "tiles") == 0)
+                opts->channels = CHANNELS_TILES;
+            else
+                check_error(1, "--channels must be either mono, rgb or tiles", 0);
+            i++;
+        } else if (strcmp(arg, "--tiles") == 0) {
+            check_error(!value, "--tiles requires a value", 0);
+            opts->tiles = atoi(value);
+            check_error(opts->tiles < 1 || opts->tiles > CHANNELS_MAX, "--tiles must be between 1 and 64", 0);
+            i++;
+        } else if (strcmp(arg, "--container") == 0) {
+            check_error(!value, "--container requires a value", 0);
+            if (strcmp(value, "auto") == 0)
+                opts->container = WAV_AUTO;
+            else if (strcmp(value, "wav") == 0)
+                opts->container = WAV_RIFF;
+            else if (strcmp(value, "rf64") == 0)
+                opts->container = WAV_RF64;
+            else if (strcmp(value, "w64") == 0)
+                opts->container = WAV_W64;
+            else
+                check_error(1, "--container must be either auto, wav, rf64 or w64", 0);
+            i++;
+        } else if (strcmp(arg, "--batch") == 0) {
+            check_error(!value, "--batch requires a value", 0);
+            opts->batch = value;
+            i++;
+        } else if (strcmp(arg, "--out-dir") == 0) {
+            check_error(!value, "--out-dir requires a value", 0);
+            opts->out_dir = value;
+            i++;
+        } else if (strcmp(arg, "--cache") == 0) {
+            check_error(!value, "--cache requires a value", 0);
+            opts->cache_dir = value;
+            i++;
+        } else if (strcmp(arg, "--cache-size") == 0) {
+            check_error(!value, "--cache-size requires a value", 0);
+            const double mb = atof(value);
+            check_error(!(mb > 0.0 && mb < 1e12), "--cache-size must be greater than 0", 0);
+            opts->cache_size = (uint64_t) (mb * (1 << 20));
+            i++;
+        } else if (strcmp(arg, "--stats") == 0) {
+            opts->stats = 1;
+        } else if (strcmp(arg, "--jobs") == 0) {
+            check_error(!value, "--jobs requires a value", 0);
+            opts->jobs = atoi(value);
+            check_error(opts->jobs < 0, "--jobs must not be negative", 0);
+            i++;
+        } else if (strcmp(arg, "--serve") == 0) {
+            check_error(!value, "--serve requires a value", 0);
+            opts->serve = value;
+            i++;
+        } else if (strcmp(arg, "--queue") == 0) {
+            check_error(!value, "--queue requires a value", 0);
+            opts->queue = atoi(value);
+            check_error(opts->queue < 1, "--queue must be at least 1", 0);
+            i++;
+        } else if (strcmp(arg, "--serve-batch") == 0) {
+            check_error(!value, "--serve-batch requires a value", 0);
+            opts->serve_batch = atoi(value);
+            check_error(opts->serve_batch < 1 || opts->serve_batch > CHANNELS_MAX, "--serve-batch must be between 1 and 64", 0);
+            i++;
+        } else {
+            check_error(np == 4, "Too many arguments", 0);
+            positional[np++] = arg;
+        }
+    }
+    if (opts->serve) {
+#ifdef _WIN32
+        check_error(1, "--serve listens on a Unix domain socket and isn't supported on Windows", 0);
+#endif
+        check_error(np != 0, "--serve reads the sample rate, time and image of every request from its connection", 0);
+        check_error(opts->batch || opts->incremental, "--serve can't be combined with --batch or --incremental", 0);
+    } else if (opts->batch) {
+        check_error(np != 2, "Expected --batch manifest|directory [sample_rate] [time_s]", 0);
+    } else {
+        check_error(np != 4, "Expected [sample_rate] [time_s] in.jpg out.wav", 0);
+        check_error(opts->incremental && strcmp(positional[3], "-") == 0, "--incremental patches the wav file in place and can't write to stdout", 0);
+    }
+    check_error(opts->incremental && opts->stream, "--incremental keeps the signal in memory and can't be combined with --stream", 0);
+    check_error(opts->incremental && opts->cache_dir, "--incremental can't be combined with --cache", 0);
+    check_error(opts->preview && (opts->incremental || opts->cache_dir), "--preview can't be combined with --incremental or --cache", 0);
+    check_error(opts->synth.max_freq > 0.0f && opts->synth.max_freq <= opts->synth.min_freq, "--max-freq must be greater than --min-freq", 0);
+    check_error(opts->synth.mapping == FREQ_LOG && opts->synth.max_freq > 0.0f && opts->synth.max_freq <= FREQ_LOG_MIN && opts->synth.min_freq <= 0.0f,
+                "--max-freq must be greater than 20 with --freq-scale log", 0);
+    if (opts->serve) return 1;
+
+    opts->sample_rate = atof(positional[0]);
+    check_error(opts->sample_rate == 0.0, "Sample rate must be greater than 0", 0);
+
+    opts->time_s = atof(positional[1]);
+    check_error(opts->time_s == 0.0, "Transmission time must be greater than 0", 0);
+
+    opts->input  = opts->batch ? NULL : positional[2];
+    opts->output = opts->batch ? NULL : positional[3];
+
+    return 1;
+}
+
+/**
+ * @brief Parse the command line into options
+ *
+ * @return 1 on success, 0 if the command line is invalid
+ */
+int parse_args(int argc, char **argv, struct options *opts) {
+    options_default(opts);
+
+    return parse_options(argc, argv, opts);
+}
+
+#ifndef _WIN32
+#define SERVE_LINE_MAX  4096       //!< Longest request line of --serve
+#define SERVE_ARGS_MAX  256        //!< Most options of a request line of --serve
+#define SERVE_IMAGE_MAX (256 << 20)//!< Largest encoded image of a request of --serve in bytes
+
+/** One connection of --serve, a request line of options, sample rate and time followed by the image */
+struct serve_request {
+    FILE *in;                 //!< Connection read until the client shuts down its side
+    FILE *out;                //!< Connection the wav file or an error line is written to
+    char line[SERVE_LINE_MAX];//!< Request line, the options point into it
+    struct options opts;      //!< Options of the server with the ones of the request line on top
+    struct image_source src;  //!< Encoded image
+    int width;                //!< Width of the image
+    int height;               //!< Height of the image
+    int batchable;            //!< Mono and synthesized, it can share a pass with requests of the same key
+    uint64_t key;             //!< convert_options_key() of the request
+    const char *error;        //!< Reason written back instead of a wav file, NULL if there is none
+    int batch;                //!< Number of requests synthesized together with this one
+    int written;              //!< Number of samples written, 0 on failure
+    double start;             //!< now() when a worker took the connection
+};
+
+/** Contexts and requests of every worker of --serve */
+struct daemon {
+    const struct options *opts;     //!< Command line options of the server
+    img2wav_ctx **conv;             //!< Context of every worker, kept warm across requests
+    struct serve_request *requests; //!< opts->serve_batch requests of every worker
+    cache *cache;                   //!< Cache shared by every context, NULL if there is none
+};
+
+static server *serve_signal_server;//!< Server stopped by SIGINT and SIGTERM
+
+void serve_signal(int sig) {
+    (void) sig;
+    if (serve_signal_server) server_stop(serve_signal_server);
+}
+
+/**
+ * @brief Read the request line and the image of a connection
+ *
+ * @param r Request, closed with serve_request_close() even on failure
+ * @param fd Connection taken from the server
+ * @param server Command line options of the server
+ * @return 1 on success, 0 with r->error set otherwise
+ */
+int serve_request_open(struct serve_request *r, int fd, const struct options *server) {
+    memset(r, 0, sizeof(*r));
+    r->start = now();
+    r->error = "internal error";
+
+    const int copy = dup(fd);
+    r->in          = fdopen(fd, "rb");
+    r->out         = copy >= 0 ? fdopen(copy, "wb") : NULL;
+    if (!r->in) close(fd);
+    if (copy >= 0 && !r->out) close(copy);
+    check_error(!r->in || !r->out, "fdopen(): Failed to open the connection", 0);
+
+    r->error = "request line missing or too long";
+    check_error(!fgets(r->line, sizeof(r->line), r->in) || !strchr(r->line, '\n'), "fgets(): Failed to read the request line", 0);
+
+    // the request writes to its connection, "-" stands for it
+    char *argv[SERVE_ARGS_MAX], *save = NULL;
+    int argc      = 0;
+    argv[argc++]  = "img2wav";
+    for (char *arg = strtok_r(r->line, " \t\r\n", &save); arg; arg = strtok_r(NULL, " \t\r\n", &save)) {
+        r->error = "too many options";
+        check_error(argc == SERVE_ARGS_MAX - 2, "Too many options in the request line", 0);
+        argv[argc++] = arg;
+    }
+    argv[argc++] = "-";
+    argv[argc++] = "-";
+
+    r->opts       = *server;
+    r->opts.serve = NULL;
+    r->error      = "invalid options, expected [options] sample_rate time_s";
+    if (!parse_options(argc, argv, &r->opts)) return 0;
+
+    r->error = "option not allowed over --serve";
+    check_error(r->opts.batch || r->opts.cache_dir != server->cache_dir || r->opts.cache_size != server->cache_size,
+                "--batch and --cache are options of the server", 0);
+    // threads are started once by the server
+    r->opts.synth.threads = server->synth.threads;
+    r->opts.jobs          = 1;
+    r->opts.stats         = 0;
+    r->opts.out           = r->out;
+
+    r->error = "image missing or too large";
+    check_error(!source_read(&r->src, r->in, SERVE_IMAGE_MAX) || r->src.length == 0, "source_read()", 0);
+
+    int channels;
+    r->error = "unknown image format";
+    check_error(!source_info(&r->src, &r->width, &r->height, &channels), "source_info(): Failed to read the image size", 0);
+    r->error = NULL;
+
+    // the same options on the same size give the same synthesis setup, only the pixels differ
+    r->key       = convert_options_key(&r->opts, r->width, r->height);
+    r->batchable = r->opts.channels == CHANNELS_MONO && !r->opts.preview && (int) ((r->opts.sample_rate * r->opts.time_s) / r->width) > 0;
+
+    return 1;
+}
+
+/**
+ * @brief Answer a request and close its connection
+ *
+ * A request that failed gets an error line, which follows the part of the wav file already sent if it failed during the conversion.
+ *
+ * @param r Request opened with serve_request_open()
+ * @param worker Index of the worker, for the log line
+ */
+void serve_request_close(struct serve_request *r, int worker) {
+    if (!r->error && r->written == 0) r->error = "conversion failed";
+    if (r->error && r->out) fprintf(r->out, "ERR %s\n", r->error);
+
+    if (r->error)
+        printf("serve: worker %d: failed, %s\n", worker, r->error);
+    else
+        printf("serve: worker %d: %dx%d -> %d samples in %.3f s, batch of %d\n", worker, r->width, r->height, r->written,
+               now() - r->start, r->batch);
+
+    source_close(&r->src);
+    if (r->in) fclose(r->in);
+    if (r->out) fclose(r->out);
+}
+
+/** Loop of a worker of --serve, takes every request waiting and converts those of the same options together */
+void serve_worker(server *s, void *ctx, int worker) {
+    struct daemon *d           = ctx;
+    img2wav_ctx *c             = d->conv[worker];
+    struct serve_request *reqs = d->requests + (size_t) worker * d->opts->serve_batch;
+    struct serve_request *group[CHANNELS_MAX];
+    struct convert_item items[CHANNELS_MAX];
+
+    int fd;
+    while ((fd = server_next(s, 1)) >= 0) {
+        int n = 0;
+        do {
+            serve_request_open(&reqs[n++], fd, d->opts);
+        } while (n < d->opts->serve_batch && (fd = server_next(s, 0)) >= 0);
+
+        // with a cache every request is looked up on its own
+        for (int i = 0; i < n; i++) {
+            struct serve_request *r = &reqs[i];
+            if (r->error || r->batch) continue;
+
+            int m      = 0;
+            group[m++] = r;
+            for (int j = i + 1; r->batchable && !d->cache && j < n; j++)
+                if (!reqs[j].error && reqs[j].batchable && reqs[j].key == r->key) group[m++] = &reqs[j];
+
+            if (m > 1) {
+                for (int j = 0; j < m; j++)
+                    items[j] = (struct convert_item) {&group[j]->opts, &group[j]->src, 0};
+                convert_batch(c, items, m);
+                for (int j = 0; j < m; j++)
+                    group[j]->batch = m, group[j]->written = items[j].written;
+            } else {
+                r->batch   = 1;
+                r->written = convert_source(c, &r->opts, &r->src, "-", r->start);
             }
         }
-        rp += target;
+
+        for (int i = 0; i < n; i++)
+            serve_request_close(&reqs[i], worker);
     }
+}
 
-    return result;
+/**
+ * @brief Convert the images of requests on a Unix socket until SIGINT or SIGTERM
+ *
+ * opts->jobs workers each keep a context, so threads, fft plans, oscillator banks and wavetables
+ * are set up once for every request. Requests past opts->queue waiting ones are turned away.
+ *
+ * @param opts Command line options, the defaults of every request
+ * @return 1 if the server ran and stopped cleanly, 0 otherwise
+ */
+int serve_run(const struct options *opts) {
+    const int workers = opts->jobs > 0 ? opts->jobs : pool_cpu_count();
+    struct daemon d   = {opts, calloc(workers, sizeof(*d.conv)), calloc((size_t) workers * opts->serve_batch, sizeof(*d.requests)), NULL};
+    int ok            = d.conv && d.requests;
+    for (int w = 0; ok && w < workers; w++)
+        ok = (d.conv[w] = img2wav_ctx_new(opts->synth.threads)) != NULL;
+
+    cache *shared = (ok && opts->cache_dir) ? cache_open(opts->cache_dir, opts->cache_size) : NULL;
+    if (ok && opts->cache_dir && !shared) fprintf(stderr, "cache_open(): Failed to open %s\n", opts->cache_dir);
+    ok = ok && (!opts->cache_dir || shared);
+    d.cache = shared;
+    for (int w = 0; ok && w < workers; w++)
+        img2wav_ctx_set_cache(d.conv[w], shared);
+
+    server *s = ok ? server_open(opts->serve, opts->queue, "ERR busy\n") : NULL;
+    ok        = s != NULL;
+    if (ok) {
+        // a client that hangs up fails its own request instead of the server
+        serve_signal_server = s;
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, serve_signal);
+        signal(SIGTERM, serve_signal);
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        printf("serve: listening on %s with %d workers\n", opts->serve, workers);
+
+        const double start = now();
+        ok                 = server_run(s, workers, serve_worker, &d);
+        const double wall  = now() - start;
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        serve_signal_server   = NULL;
+        const server_stats st = server_get_stats(s);
+        printf("serve: %llu requests, %llu turned away in %.3f s\n", (unsigned long long) st.accepted, (unsigned long long) st.rejected, wall);
+        if (opts->stats) stats_print(stderr, d.conv, workers, wall);
+    }
+
+    server_free(s);
+    for (int w = 0; d.conv && w < workers; w++)
+        img2wav_ctx_free(d.conv[w]);
+    free(d.conv);
+    free(d.requests);
+    cache_free(shared);
+
+    return ok;
 }
+#endif
 
 int main(int argc, char **argv) {
-    if (argc < 5) {
-        printf("img2wav - Convert an image to the frequency spectrum of an audio file\n"
-               "Usage: img2wav [sample_rate] [time_s] in.jpg out.wav\n");
+    if (argc < 3) {
+        usage();
 
         return EXIT_FAILURE;
     }
 
-    const float sample_rate = atof(argv[1]);
-    check_error(sample_rate == 0.0, "Sample rate must be greater than 0", EXIT_FAILURE);
-
-    const float time_s = atof(argv[2]);
-    check_error(time_s == 0.0, "Transmission time must be greater than 0", EXIT_FAILURE);
+    struct options opts;
+    check_error(!parse_args(argc, argv, &opts), "parse_args()", EXIT_FAILURE);
 
-    int x, y;
-    int *pixels = get_pixels(argv[3], &x, &y);
-    check_error(!pixels, "get_pixels()", EXIT_FAILURE);
+    if (opts.batch) {
+        check_error(!batch_run(&opts), "batch_run()", EXIT_FAILURE);
 
-    int n;
-    float *freqs = get_freqs(pixels, sample_rate, time_s, x, y, &n);
-    check_error(!freqs, "get_freqs()", EXIT_FAILURE);
-
-    /* Wav files expect amplitudes between [-1.0, 1.0] */
-    normalize(freqs, n);
+        return EXIT_SUCCESS;
+    }
+#ifndef _WIN32
+    if (opts.serve) {
+        check_error(!serve_run(&opts), "serve_run()", EXIT_FAILURE);
 
-    wav_config cfg = {1, n, sample_rate, 24};
-    check_error(wav_write(cfg, argv[4], &freqs) != n * cfg.nc, "wav_write()", EXIT_FAILURE);
+        return EXIT_SUCCESS;
+    }
+#endif
 
-    free(pixels);
-    free(freqs);
+    const double start = now();
+    const int n        = opts.time_s * opts.sample_rate;
+    img2wav_ctx *c     = img2wav_ctx_new(opts.synth.threads);
+    cache *shared      = NULL;
+    int ok             = c != NULL;
+    if (ok && opts.cache_dir) {
+        shared = cache_open(opts.cache_dir, opts.cache_size);
+        ok     = shared != NULL;
+        if (!ok) fprintf(stderr, "cache_open(): Failed to open %s\n", opts.cache_dir);
+        img2wav_ctx_set_cache(c, shared);
+    }
+    ok = ok && convert(c, &opts, opts.input, opts.output) == n;
+    if (opts.stats && c) stats_print(stderr, &c, 1, now() - start);
+    img2wav_ctx_free(c);
+    cache_free(shared);
+    check_error(!ok, "convert()", EXIT_FAILURE);
 
     return EXIT_SUCCESS;
 }
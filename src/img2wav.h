@@ -0,0 +1,387 @@
+/* img2wav.h - conversion of images to the frequency spectrum of a wav file, the library behind img2wav
+
+   Features:
+       + An img2wav_ctx owns the synthesis threads, fft plans, oscillator banks, wavetables and
+         buffers of its conversions, they are set up once and reused by every image it converts
+       + Contexts are independent, one per thread converts many images concurrently in one process
+       + A cache of finished wav files can be shared by every context
+       + Images are read from files, streams or memory, the wav file goes to a path or a stream
+
+    Limitations:
+       + A context converts one image at a time, use one context per thread
+       + stb_image decodes into the context of the calling thread through a thread local pointer,
+         set only for the duration of the decode
+
+    DOCUMENTATION
+    =============
+    // Link the img2wav_core library, it holds the implementations of wav.h, arena.h, pool.h and cache.h too
+    #include "img2wav.h"
+
+    // Options start from the defaults of the command line
+    struct options opts;
+    options_default(&opts);
+    opts.sample_rate  = 96000.0f;
+    opts.time_s       = 10.0f;
+    opts.synth.engine = SYNTH_OSC;
+
+    // Create a context once, threads render the columns of every image
+    img2wav_ctx *ctx = img2wav_ctx_new(threads);
+
+    // Every conversion reuses what the previous one set up, it returns the samples per channel written
+    int n = convert(ctx, &opts, "in.png", "out.wav");
+
+    // Encoded images already in memory, or read from a stream, are converted without touching the disk.
+    // The output "-" writes to opts.out, stdout when it is NULL.
+    struct image_source src;
+    source_read(&src, stream, max_bytes);
+    n = convert_source(ctx, &opts, &src, "-", now());
+
+    // Contexts can share a cache of finished wav files, it must outlive them
+    img2wav_ctx_set_cache(ctx, cache_open("cache", (uint64_t) 1 << 30));
+
+    // The timers and counters of every context are printed as JSON
+    stats_print(stderr, &ctx, 1, now() - start);
+
+    img2wav_ctx_free(ctx);
+*/
+#ifndef IMG2WAV_H
+#define IMG2WAV_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "wav.h"
+
+/** Coefficients converting RGB pixels to luma */
+enum luma_coeffs {
+    LUMA_BT601,//!< Rec. 601, 0.299 R + 0.587 G + 0.114 B
+    LUMA_BT709,//!< Rec. 709, 0.2126 R + 0.7152 G + 0.0722 B
+};
+
+struct stats;
+
+/** How get_pixels() and get_pixels_16() decode an image */
+struct decode_config {
+    enum luma_coeffs luma;//!< Coefficients converting RGB pixels to luma
+    int column_major;     //!< Store pixel (x, y) at x * height + y instead of y * width + x
+    int gray;             //!< Let stb_image decode colour images to one channel too, faster but ignores luma
+    struct stats *stats;  //!< Timers of the read, decode and luma stages, may be NULL
+    arena *arena;         //!< Arena the decoded image and the pixels are allocated from, NULL uses malloc()
+    int rgb;              //!< Keep the red, green and blue planes one after the other instead of converting to luma
+};
+
+/** Synthesis engines selectable with --engine */
+enum synth_engine {
+    SYNTH_FFT,     //!< One period of each column from an inverse FFT, rows off its bins summed directly
+    SYNTH_ADDITIVE,//!< Reference additive synthesis, one sin() per pixel per sample
+    SYNTH_OSC,     //!< Additive synthesis with a SIMD oscillator bank
+    SYNTH_TABLE,   //!< Additive synthesis reading an interpolated sine wavetable
+    SYNTH_SINF,    //!< Float32 additive synthesis with a vectorized polynomial sine
+    SYNTH_GPU,     //!< SYNTH_SINF's signal rendered by an OpenCL device, SYNTH_SINF on the CPU without one
+};
+
+/** Where the oscillator of every row starts at each column */
+enum synth_phase {
+    PHASE_RESTART,   //!< Every column starts its rows at phase 0, steps at column edges spread broadband energy
+    PHASE_CONTINUOUS,//!< Rows keep the phase of one oscillator for the whole signal, columns only change amplitudes
+};
+
+/** Interpolation between the samples of the SYNTH_TABLE wavetable */
+enum table_interp {
+    TABLE_LINEAR,//!< 2 point linear, error below (2 pi / size)^2 / 8
+    TABLE_CUBIC, //!< 4 point lagrange, error below (2 pi / size)^4 * 3 / 128
+};
+
+/** How the rows of an image are spread between synth_config.min_freq and synth_config.max_freq */
+enum freq_scale {
+    FREQ_LINEAR,//!< Rows are evenly spaced in hz
+    FREQ_LOG,   //!< Rows are evenly spaced in octaves, every octave gets as many rows
+    FREQ_MEL,   //!< Rows are evenly spaced in mel, about linear below 1 kHz and logarithmic above
+};
+
+/** Configuration for get_freqs() */
+struct synth_config {
+    enum synth_engine engine;//!< Engine used to render each column
+    int fft_size;            //!< Frame size of SYNTH_FFT, 0 picks the smallest power of two whose bins hold the rows
+    const char *simd;        //!< Kernel of SYNTH_OSC, see osc_bank_set_kernel(), NULL is "auto"
+    int table_size;          //!< Samples of the SYNTH_TABLE sine period, a power of two, 0 picks TABLE_DEFAULT_SIZE
+    enum table_interp interp;//!< Interpolation of SYNTH_TABLE
+    int threads;             //!< Number of threads rendering columns, 0 uses every processor
+    int column_major;        //!< Pixels are stored column after column, see get_pixels()
+    int depth;               //!< Bits per pixel, 16 for get_pixels_16() planes, 0 or 8 for get_pixels() planes
+    enum synth_phase phase;  //!< Phase of the rows at the start of each column
+    float crossfade;         //!< Fraction of each column fading in from the previous one
+    float min_freq;          //!< Frequency of the first row in hz
+    float max_freq;          //!< Frequency one row past the last in hz, 0 is the Nyquist frequency of the sample rate
+    enum freq_scale mapping; //!< Spacing of the rows between min_freq and max_freq
+};
+typedef struct synth_config synth_config;
+
+#define TABLE_MAX_BITS 24   //!< Largest wavetable is 2^TABLE_MAX_BITS samples
+#define FREQ_LOG_MIN   20.0f//!< Frequency of the first row of FREQ_LOG when synth_config.min_freq is 0
+
+/** How the peak used for normalization is found */
+enum peak_mode {
+    PEAK_EXACT,//!< Largest absolute sample, --stream keeps the raw samples in a temporary file to find it
+    PEAK_BOUND,//!< Largest sum of amplitudes of any column, known before synthesis
+};
+
+#define CHANNELS_MAX 64//!< Most channels of a wav file, the tiles of --channels tiles
+
+/** How the channels of the wav file are taken from the image */
+enum channel_mode {
+    CHANNELS_MONO, //!< One channel of luma
+    CHANNELS_RGB,  //!< The red, green and blue planes on three channels
+    CHANNELS_TILES,//!< The image cut into strips of whole columns side by side, one channel each
+};
+
+/** Command line options */
+struct options {
+    float sample_rate;          //!< Output sample rate
+    float time_s;               //!< Output length in seconds
+    const char *input;          //!< Input image path
+    const char *output;         //!< Output wav path
+    synth_config synth;         //!< Synthesis engine configuration
+    int stream;                 //!< Write columns as they are synthesized instead of buffering the whole signal
+    int ring;                   //!< Number of columns buffered by stream, 0 picks 4 per thread
+    enum peak_mode peak;        //!< How the peak used for normalization is found
+    int io_depth;               //!< Blocks of stream columns queued for the writer thread, 1 writes on the synthesis thread
+    size_t io_block;            //!< Bytes of the wav file encoded before each write
+    struct decode_config decode;//!< How images are decoded to a single channel
+    const char *batch;          //!< Manifest or directory of images to convert, NULL converts input to output
+    const char *out_dir;        //!< Directory of the wav files of a batch, NULL writes them next to the images
+    int jobs;                   //!< Number of images of a batch converted at once, 0 uses every processor
+    int stats;                  //!< Print stage timers and counters as JSON on stderr
+    enum wav_format container;  //!< Container of the wav files, WAV_AUTO switches to RF64 past 4 GiB
+    enum channel_mode channels; //!< How the channels of the wav files are taken from the image
+    int tiles;                  //!< Number of channels of CHANNELS_TILES
+    const char *cache_dir;      //!< Directory of finished wav files reused for identical conversions, NULL disables it
+    uint64_t cache_size;        //!< Size cap of the cache in bytes
+    int incremental;            //!< Re-render only the columns whose pixels changed since the last render of the output
+    int preview;                //!< Write the first columns downscaled as soon as possible, see preview_render()
+    int preview_rows;           //!< Rows the first columns of a preview are downscaled to
+    FILE *out;                  //!< Stream of the output "-", NULL is stdout
+    const char *serve;          //!< Unix socket path of --serve, NULL converts input to output
+    int queue;                  //!< Most --serve requests waiting for a worker
+    int serve_batch;            //!< Most --serve requests of one worker read and synthesized together
+};
+
+/** Encoded bytes of an image, mapped from a file or read from a stream */
+struct image_source {
+    const uint8_t *data;//!< Encoded image
+    size_t length;      //!< Size of data in bytes
+    wav_view view;      //!< Mapping of the file, if data points into one
+    uint8_t *buffer;    //!< Bytes read from a stream, if data points into them
+};
+
+/** Threads, engines and buffers reused by every image converted on one thread */
+typedef struct img2wav_ctx img2wav_ctx;
+
+/** One image of convert_batch() */
+struct convert_item {
+    const struct options *opts;//!< Options of the image, the wav file is written to output_stream() of them
+    struct image_source *src;  //!< Encoded image, closed once it is decoded
+    int written;               //!< Number of samples written, 0 on failure
+};
+
+/** Seconds elapsed since an arbitrary point in time */
+double now(void);
+
+/** Largest resident set size of the process so far in KiB */
+long peak_rss_kb(void);
+
+/** Find absolute maximum value in array */
+float find_max(const float *src, size_t n);
+
+/** Normalize values in array to be [-1.0, 1.0] */
+void normalize(float *src, size_t n);
+
+/**
+ * @brief Set every option to its default
+ *
+ * @param opts Options to set, the sample rate, the time and the paths are left alone
+ */
+void options_default(struct options *opts);
+
+/**
+ * @brief Read a whole stream of at most max bytes into memory
+ *
+ * @param src Source to fill in, zeroed or closed before, close it with source_close() even on failure
+ * @param file Stream to read until its end
+ * @param max Most bytes to read, a longer stream fails
+ * @return 1 on success, 0 on failure
+ */
+int source_read(struct image_source *src, FILE *file, size_t max);
+
+/**
+ * @brief Get the encoded bytes of an image without copying files
+ *
+ * Regular files are memory mapped, "-" reads stdin and anything that can't be mapped,
+ * like a named pipe, is read into memory.
+ *
+ * @param src Source to open, close it with source_close() even on failure
+ * @param path Path of the image or "-" for stdin
+ * @return 1 on success, 0 on failure
+ */
+int source_open(struct image_source *src, const char *path);
+
+/**
+ * @brief Read the size of an encoded image without decoding it
+ *
+ * @param src Encoded image
+ * @param width Pointer to store the width of the image
+ * @param height Pointer to store the height of the image
+ * @param channels Pointer to store the number of channels of the image
+ * @return 1 on success, 0 if the format isn't known
+ */
+int source_info(const struct image_source *src, int *width, int *height, int *channels);
+
+/** Release the bytes of an image source, closing it again does nothing */
+void source_close(struct image_source *src);
+
+/**
+ * @brief Convert an image into a Width x Height sized array of greyscale values between [0, 255].
+ *
+ * Colour pixels decoded by stb_image are converted straight to one byte of luma per pixel.
+ * Fixed point weights keep the result within one level of the floating point formula.
+ * Grayscale sources skip the conversion, row-major ones are returned as decoded.
+ *
+ * @param buffer Encoded image, in any format stb_image supports
+ * @param length Size of buffer in bytes
+ * @param width Pointer to a variable that stores the width of an image
+ * @param height Pointer to a variable that stores the height of an image
+ * @param dc Decoding options
+ * @return An array of pixels x by y in size containing values [0, 255], free it with free() or,
+ *         with dc->arena, with arena_reset(). With dc->rgb the red, green and blue planes follow each other.
+*/
+uint8_t *get_pixels_from_memory(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc);
+
+/**
+ * @brief Convert an image file into a Width x Height sized array of greyscale values between [0, 255].
+ *
+ * @param path Path to the image to convert, "-" reads it from stdin
+ * @see get_pixels_from_memory()
+ */
+uint8_t *get_pixels(const char *path, int *width, int *height, const struct decode_config *dc);
+
+/**
+ * @brief Convert an image into a Width x Height sized array of greyscale values between [0, 65535].
+ *
+ * Like get_pixels_from_memory() without rounding 16 bit and HDR sources down to 8 bits,
+ * HDR images are tone mapped with the gamma of stb_image.
+ *
+ * @return An array of pixels x by y in size containing values [0, 65535], free it with free() or,
+ *         with dc->arena, with arena_reset(). With dc->rgb the red, green and blue planes follow each other.
+ */
+uint16_t *get_pixels_16_from_memory(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc);
+
+/** Convert an image file into a Width x Height sized array of greyscale values between [0, 65535], see get_pixels() */
+uint16_t *get_pixels_16(const char *path, int *width, int *height, const struct decode_config *dc);
+
+/**
+ * @brief Convert pixel data to frequency data for use in generating audio files
+ *
+ * @param pixels Single channel pixel data of cfg.depth bits per pixel
+ * @param sample_rate Desired sample rate of the frequencies
+ * @param time_s Length in seconds of the transmission time
+ * @param width Width of the pixel data
+ * @param height Height of the pixel data
+ * @param cfg Synthesis engine configuration
+ * @param size Pointer to the number of generated amplitudes
+ * @return Array of amplitudes corresponding to the frequencies generated
+*/
+float *get_freqs(const void *pixels, float sample_rate, float time_s, int width, int height, synth_config cfg, int *size);
+
+/**
+ * @brief Create a context, the threads of one channel are started right away
+ *
+ * @param threads Number of threads rendering the columns of every channel, 0 uses every processor
+ * @return Context or NULL on failure
+ */
+img2wav_ctx *img2wav_ctx_new(int threads);
+
+/**
+ * @brief Stop the threads and deallocate the buffers of a context, its cache is left open
+ *
+ * @param ctx Context to free, may be NULL
+ */
+void img2wav_ctx_free(img2wav_ctx *ctx);
+
+/**
+ * @brief Look up and add the wav files converted by a context in a cache
+ *
+ * @param ctx Context
+ * @param c Cache that outlives the context, may be shared by contexts on other threads, NULL renders every image
+ */
+void img2wav_ctx_set_cache(img2wav_ctx *ctx, cache *c);
+
+/**
+ * @brief Convert the encoded bytes of an image to a wav file
+ *
+ * With a cache, an image whose pixels and options match a finished wav file is copied instead
+ * of rendered, and every rendered file is added to the cache. With --incremental only the
+ * columns that changed since the last render of output are rendered, see render_incremental().
+ *
+ * @param ctx Context whose buffers are reused across calls
+ * @param opts Command line options
+ * @param src Encoded image, closed once it is decoded
+ * @param output Output wav path, "-" writes to opts->out or stdout
+ * @param begin now() when the conversion started, the time to the first sample of --preview is measured from it
+ * @return Number of samples per channel written, 0 on failure
+ */
+int convert_source(img2wav_ctx *ctx, const struct options *opts, struct image_source *src, const char *output, double begin);
+
+/**
+ * @brief Convert an image to a wav file
+ *
+ * @see convert_source()
+ * @param ctx Context whose buffers are reused across calls
+ * @param opts Command line options
+ * @param input Input image path, "-" reads it from stdin
+ * @param output Output wav path
+ * @return Number of samples per channel written, 0 on failure
+ */
+int convert(img2wav_ctx *ctx, const struct options *opts, const char *input, const char *output);
+
+/**
+ * @brief Key of the synthesis setup of options on an image size
+ *
+ * Images with the same key differ only in their pixels, convert_batch() renders them together.
+ *
+ * @param opts Command line options
+ * @param width Width of the images
+ * @param height Height of the images
+ * @return Key of the options, the sample rate, the time and the size
+ */
+uint64_t convert_options_key(const struct options *opts, int width, int height);
+
+/**
+ * @brief Convert images with the same convert_options_key() in one synthesis pass
+ *
+ * Each image is a channel of the context, so they render concurrently like the channels of one image,
+ * and each one is normalized on its own and written as a mono wav file. The samples are the ones of
+ * convert_source() on each image. The images must be mono, without --preview, at least one sample per
+ * column long and their options may only differ in the container and the output stream.
+ *
+ * @param ctx Context whose buffers are reused across calls
+ * @param items Images to convert, written is set for every one
+ * @param n Number of images, at most CHANNELS_MAX
+ * @return Number of images converted
+ */
+int convert_batch(img2wav_ctx *ctx, struct convert_item *items, int n);
+
+/**
+ * @brief Print the timers and counters of contexts as JSON
+ *
+ * Stages and counters are summed over every context, cache holds the counters of the cache they share
+ * and threads lists every worker of every channel of every context.
+ *
+ * @param file Stream to print to
+ * @param ctx Contexts whose images are reported
+ * @param n Number of contexts
+ * @param wall Wall clock time of the whole run in seconds
+ */
+void stats_print(FILE *file, img2wav_ctx *const *ctx, int n, double wall);
+#endif
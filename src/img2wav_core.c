@@ -0,0 +1,2755 @@
+#ifdef _WIN32
+    #ifndef _CRT_SECURE_NO_WARNINGS
+        #define _CRT_SECURE_NO_WARNINGS
+    #endif
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #define IMG2WAV_THREAD_LOCAL __declspec(thread)
+#else
+    #define IMG2WAV_THREAD_LOCAL _Thread_local
+#endif
+
+/* stb_image has no allocator argument, decoding on a thread takes its buffers from the arena set here.
+   Memory the arena doesn't own, like buffers decoded without one, goes back to the C library. */
+static IMG2WAV_THREAD_LOCAL arena *stbi_arena;//!< Arena of the image being decoded on this thread, NULL uses malloc()
+
+void *stbi_arena_malloc(size_t size) {
+    return stbi_arena ? arena_alloc(stbi_arena, size) : malloc(size);
+}
+
+void *stbi_arena_realloc(void *p, size_t old_size, size_t size) {
+    if (stbi_arena && (!p || arena_owns(stbi_arena, p))) return arena_realloc(stbi_arena, p, old_size, size);
+
+    return realloc(p, size);
+}
+
+void stbi_arena_free(void *p) {
+    if (stbi_arena && arena_owns(stbi_arena, p))
+        arena_release(stbi_arena, p);
+    else
+        free(p);
+}
+
+#define STBI_MALLOC(size)                         stbi_arena_malloc(size)
+#define STBI_REALLOC_SIZED(p, old_size, new_size) stbi_arena_realloc((p), (old_size), (new_size))
+#define STBI_FREE(p)                              stbi_arena_free(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define WAV_IMPLEMENTATION
+#include "wav.h"
+
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
+#define OSC_IMPLEMENTATION
+#include "osc.h"
+
+#define POOL_IMPLEMENTATION
+#include "pool.h"
+
+#define CACHE_IMPLEMENTATION
+#include "cache.h"
+
+#define AIO_IMPLEMENTATION
+#include "aio.h"
+
+#ifdef IMG2WAV_GPU
+    #define GPU_IMPLEMENTATION
+    #include "gpu.h"
+#endif
+
+#include "img2wav.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define IMG2WAV_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #define IMG2WAV_NEON
+    #include <arm_neon.h>
+#endif
+
+#define check_error(error, description, retval)                                 \
+    do {                                                                        \
+        if ((error)) {                                                          \
+            fprintf(stderr, "%s [%s:%d]\n", (description), __FILE__, __LINE__); \
+            return (retval);                                                    \
+        }                                                                       \
+    } while (0);
+
+/** Remaps a value from a source range to a target range. */
+float map(float src, float src_min, float src_max, float target_min, float target_max) {
+    return target_min + ((target_max - target_min) * (src - src_min)) / (src_max - src_min);
+}
+
+float find_max(const float *src, size_t n) {
+    float max = 0.0f;
+    size_t i  = 0;
+#if defined(IMG2WAV_SSE2)
+    // clearing the sign bit gives the absolute value of four samples at once
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 m          = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+        m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(src + i), mask));
+    m   = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m   = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    max = _mm_cvtss_f32(m);
+#elif defined(IMG2WAV_NEON)
+    float32x4_t m = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4)
+        m = vmaxq_f32(m, vabsq_f32(vld1q_f32(src + i)));
+    const float32x2_t h = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+    max                 = vget_lane_f32(vpmax_f32(h, h), 0);
+#endif
+    for (; i < n; i++)
+        if (fabsf(src[i]) > max)
+            max = fabsf(src[i]);
+
+    return max;
+}
+
+/** Scale values in array to be [-1.0, 1.0] given their absolute maximum value */
+void normalize_to(float *src, size_t n, float max) {
+    if (max > 1.0)
+        for (size_t i = 0; i < n; i++)
+            src[i] /= max;
+}
+
+void normalize(float *src, size_t n) {
+    normalize_to(src, n, find_max(src, n));
+}
+
+double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+long peak_rss_kb(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (long) (pmc.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    #ifdef __APPLE__
+    return usage.ru_maxrss / 1024;// bytes on macOS, KiB everywhere else
+    #else
+    return usage.ru_maxrss;
+    #endif
+#endif
+}
+
+/** Stages of a conversion timed by --stats */
+enum stats_stage {
+    STAGE_READ,  //!< Reading or mapping the encoded image
+    STAGE_DECODE,//!< Decoding the image with stb_image
+    STAGE_LUMA,  //!< Converting the decoded pixels to a single channel plane
+    STAGE_SETUP, //!< Building the sparse columns and preparing the engines
+    STAGE_SYNTH, //!< Rendering the columns
+    STAGE_ENCODE,//!< Quantizing and writing the wav file
+    STAGE_CACHE, //!< Hashing the pixels for --cache or --incremental and copying wav files out of the cache
+    STAGE_COUNT,
+};
+
+static const char *const stats_stage_names[STAGE_COUNT] = {"read", "decode", "luma", "setup", "synthesis", "encode", "cache"};
+
+/** Timers and counters of --stats, summed over every converted image */
+struct stats {
+    double seconds[STAGE_COUNT];//!< Time spent in every stage
+    uint64_t images;            //!< Images converted
+    uint64_t pixels;            //!< Pixels of every image
+    uint64_t active;            //!< Pixels bright enough to be synthesized, the others are skipped
+    uint64_t oscillator_samples;//!< Samples of the sines of every active pixel
+    uint64_t samples;           //!< Samples written
+    uint64_t bytes;             //!< Bytes of audio data written
+    uint64_t reused_columns;    //!< Columns of --incremental renders kept from the previous wav file
+    double first_sample_s;      //!< Longest time from the start of a --preview conversion to its first samples
+    double io_stall_s;          //!< Time --stream synthesis waited for the writer thread to free a block
+    double io_write_s;          //!< Time the writer of --stream spent encoding and writing blocks
+};
+
+/** Add the time elapsed since start to a stage, st may be NULL */
+void stats_add(struct stats *st, enum stats_stage stage, double start) {
+    if (st) st->seconds[stage] += now() - start;
+}
+
+#define LUMA_BITS 14//!< Fraction bits of the fixed point luma weights
+
+/** Fixed point weights of every luma_coeffs, each set sums to 1 << LUMA_BITS so white stays 255 */
+static const int16_t luma_weights[][3] = {
+    {4899, 9617, 1868},
+    {3483, 11718, 1183},
+};
+
+#if defined(IMG2WAV_SSE2)
+/** Luma of the 4 RGB pixels in the low 12 bytes of x as 32 bit integers */
+static inline __m128i luma_sse2(__m128i x, __m128i w) {
+    const __m128i m0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+    const __m128i m1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+    const __m128i m2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+    const __m128i m3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+
+    // spread rgb rgb rgb rgb to rgb0 rgb0 rgb0 rgb0, pixel k moves up by k bytes
+    __m128i p = _mm_and_si128(x, m0);
+    p         = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(x, 1), m1));
+    p         = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(x, 2), m2));
+    p         = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(x, 3), m3));
+
+    // madd leaves r * wr + g * wg and b * wb of every pixel in neighbouring lanes
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 a     = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(p, zero), w));
+    const __m128 b     = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(p, zero), w));
+    const __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    const __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    return _mm_srli_epi32(_mm_add_epi32(even, odd), LUMA_BITS);
+}
+#endif
+
+/**
+ * @brief Convert a row of RGB pixels to luma
+ *
+ * @param rgb Row of n interleaved RGB pixels
+ * @param dst Output, the luma of pixel i is stored at dst[i * stride]
+ * @param n Number of pixels
+ * @param stride Distance between two outputs
+ * @param w Fixed point weights of R, G and B
+ */
+void luma_row(const uint8_t *rgb, uint8_t *dst, size_t n, size_t stride, const int16_t *w) {
+    size_t i = 0;
+#if defined(IMG2WAV_SSE2)
+    const __m128i wv = _mm_setr_epi16(w[0], w[1], w[2], 0, w[0], w[1], w[2], 0);
+    // the last 16 byte load of an iteration reads 4 bytes past its pixels
+    for (; i + 18 <= n; i += 16) {
+        const uint8_t *p = rgb + i * 3;
+        const __m128i a  = luma_sse2(_mm_loadu_si128((const __m128i *) p), wv);
+        const __m128i b  = luma_sse2(_mm_loadu_si128((const __m128i *) (p + 12)), wv);
+        const __m128i c  = luma_sse2(_mm_loadu_si128((const __m128i *) (p + 24)), wv);
+        const __m128i d  = luma_sse2(_mm_loadu_si128((const __m128i *) (p + 36)), wv);
+        const __m128i v  = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        if (stride == 1) {
+            _mm_storeu_si128((__m128i *) (dst + i), v);
+        } else {
+            uint8_t tmp[16];
+            _mm_storeu_si128((__m128i *) tmp, v);
+            for (size_t j = 0; j < 16; j++) dst[(i + j) * stride] = tmp[j];
+        }
+    }
+#elif defined(IMG2WAV_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16x3_t px = vld3q_u8(rgb + i * 3);
+        uint8x8_t half[2];
+        for (int h = 0; h < 2; h++) {
+            const uint16x8_t r = vmovl_u8(h ? vget_high_u8(px.val[0]) : vget_low_u8(px.val[0]));
+            const uint16x8_t g = vmovl_u8(h ? vget_high_u8(px.val[1]) : vget_low_u8(px.val[1]));
+            const uint16x8_t b = vmovl_u8(h ? vget_high_u8(px.val[2]) : vget_low_u8(px.val[2]));
+            uint32x4_t lo      = vmull_n_u16(vget_low_u16(r), (uint16_t) w[0]);
+            uint32x4_t hi      = vmull_n_u16(vget_high_u16(r), (uint16_t) w[0]);
+            lo                 = vmlal_n_u16(lo, vget_low_u16(g), (uint16_t) w[1]);
+            hi                 = vmlal_n_u16(hi, vget_high_u16(g), (uint16_t) w[1]);
+            lo                 = vmlal_n_u16(lo, vget_low_u16(b), (uint16_t) w[2]);
+            hi                 = vmlal_n_u16(hi, vget_high_u16(b), (uint16_t) w[2]);
+            half[h]            = vmovn_u16(vcombine_u16(vshrn_n_u32(lo, LUMA_BITS), vshrn_n_u32(hi, LUMA_BITS)));
+        }
+        const uint8x16_t v = vcombine_u8(half[0], half[1]);
+        if (stride == 1) {
+            vst1q_u8(dst + i, v);
+        } else {
+            uint8_t tmp[16];
+            vst1q_u8(tmp, v);
+            for (size_t j = 0; j < 16; j++) dst[(i + j) * stride] = tmp[j];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t *p = rgb + i * 3;
+        dst[i * stride]  = (uint8_t) ((p[0] * w[0] + p[1] * w[1] + p[2] * w[2]) >> LUMA_BITS);
+    }
+}
+
+/** Convert a row of 16 bit RGB pixels to luma, see luma_row() */
+void luma_row_16(const uint16_t *rgb, uint16_t *dst, size_t n, size_t stride, const int16_t *w) {
+    for (size_t i = 0; i < n; i++) {
+        const uint16_t *p = rgb + i * 3;
+        dst[i * stride]   = (uint16_t) (((uint32_t) p[0] * w[0] + (uint32_t) p[1] * w[1] + (uint32_t) p[2] * w[2]) >> LUMA_BITS);
+    }
+}
+
+/** Store a single channel plane of size byte pixels column after column */
+void transpose_plane(const void *src, void *dst, size_t width, size_t height, size_t size) {
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            if (size == 1)
+                ((uint8_t *) dst)[x * height + y] = ((const uint8_t *) src)[y * width + x];
+            else
+                ((uint16_t *) dst)[x * height + y] = ((const uint16_t *) src)[y * width + x];
+        }
+    }
+}
+
+/** Store the channels of interleaved RGB pixels of size bytes as three single channel planes one after the other */
+void split_planes(const void *src, void *dst, size_t width, size_t height, size_t size, int column_major) {
+    const size_t plane = width * height;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            const size_t i = column_major ? x * height + y : y * width + x;
+            const size_t j = (y * width + x) * 3;
+            for (size_t c = 0; c < 3; c++) {
+                if (size == 1)
+                    ((uint8_t *) dst)[c * plane + i] = ((const uint8_t *) src)[j + c];
+                else
+                    ((uint16_t *) dst)[c * plane + i] = ((const uint16_t *) src)[j + c];
+            }
+        }
+    }
+}
+
+int source_read(struct image_source *src, FILE *file, size_t max) {
+    size_t cap = 1 << 16;
+    src->buffer = malloc(cap);
+    check_error(!src->buffer, "malloc(): Failed to allocate image buffer", 0);
+
+    size_t got;
+    while ((got = fread(src->buffer + src->length, 1, cap - src->length, file)) > 0) {
+        src->length += got;
+        check_error(src->length > max, "fread(): Image is too large", 0);
+        if (src->length < cap) continue;
+
+        uint8_t *buffer = realloc(src->buffer, cap * 2);
+        check_error(!buffer, "realloc(): Failed to allocate image buffer", 0);
+        src->buffer = buffer;
+        cap *= 2;
+    }
+    check_error(ferror(file), "fread(): Failed to read image", 0);
+    src->data = src->buffer;
+
+    return 1;
+}
+
+int source_open(struct image_source *src, const char *path) {
+    memset(src, 0, sizeof(*src));
+    if (strcmp(path, "-") == 0) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return source_read(src, stdin, SIZE_MAX);
+    }
+
+    uint64_t size;
+    if (wav_file_size(path, &size) && size > 0 && size <= SIZE_MAX && wav_map(&src->view, path, 0, (size_t) size)) {
+        src->data   = src->view.data;
+        src->length = (size_t) size;
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    check_error(!file, "fopen(): Failed to open file", 0);
+    const int ok = source_read(src, file, SIZE_MAX);
+    fclose(file);
+
+    return ok;
+}
+
+int source_info(const struct image_source *src, int *width, int *height, int *channels) {
+    return src->length <= INT_MAX && stbi_info_from_memory(src->data, (int) src->length, width, height, channels);
+}
+
+void source_close(struct image_source *src) {
+    if (src->view.base) wav_unmap(&src->view);
+    free(src->buffer);
+    memset(src, 0, sizeof(*src));// closing again is harmless
+}
+
+/**
+ * @brief Decode an image to one or three channels of size bytes each
+ *
+ * Sources that are already grayscale, and every source with dc->gray, are decoded
+ * straight to a single channel so they are never expanded to RGB.
+ *
+ * @return Decoded pixels freed with stbi_image_free() and their number of channels in *channels
+ */
+void *decode_image(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc, size_t size, int *channels) {
+    check_error(length > INT_MAX, "Image is too large for stb_image", NULL);
+    const int len = (int) length;
+
+    int n;
+    check_error(!stbi_info_from_memory(buffer, len, width, height, &n), "stbi_info(): Unknown image format", NULL);
+    *channels = dc->rgb ? 3 : (dc->gray || n < 3) ? 1 : 3;
+
+    void *data = NULL;
+    if (size == 1) {
+        data = stbi_load_from_memory(buffer, len, width, height, &n, *channels);
+    } else if (stbi_is_hdr_from_memory(buffer, len)) {
+        // tone map like stb_image does for 8 bit output, but keep 16 bits of the result
+        float *hdr = stbi_loadf_from_memory(buffer, len, width, height, &n, *channels);
+        if (hdr) {
+            const size_t count = (size_t) *width * *height * *channels;
+            uint16_t *out      = (uint16_t *) hdr;
+            for (size_t i = 0; i < count; i++) {
+                float v = powf(hdr[i], 1.0f / 2.2f);
+                if (!(v > 0.0f)) v = 0.0f;
+                if (v > 1.0f) v = 1.0f;
+                out[i] = (uint16_t) (v * 65535.0f + 0.5f);// out[i] never overtakes hdr[i]
+            }
+        }
+        data = hdr;
+    } else {
+        data = stbi_load_16_from_memory(buffer, len, width, height, &n, *channels);
+    }
+    check_error(!data, "stbi_load(): Failed to decode image", NULL);
+
+    return data;
+}
+
+/** get_pixels_from_memory() with stb_image allocating from stbi_arena */
+uint8_t *get_pixels_8(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc) {
+    int channels;
+    const double start = now();
+    uint8_t *data  = decode_image(buffer, length, width, height, dc, 1, &channels);
+    stats_add(dc->stats, STAGE_DECODE, start);
+    check_error(!data, "decode_image()", NULL);
+
+    const size_t x = *width;
+    const size_t y = *height;
+    if (channels == 1 && !dc->column_major) return data;
+
+    const double luma   = now();
+    const size_t planes = dc->rgb ? 3 : 1;
+    uint8_t *pixels     = STBI_MALLOC(x * y * planes * sizeof(*pixels));
+    if (!pixels) stbi_image_free(data);
+    check_error(!pixels, "malloc(): Failed to allocate pixels", NULL);
+
+    if (dc->rgb) {
+        split_planes(data, pixels, x, y, sizeof(*pixels), dc->column_major);
+    } else if (channels == 1) {
+        transpose_plane(data, pixels, x, y, sizeof(*pixels));
+    } else {
+        for (size_t i = 0; i < y; i++) {
+            if (dc->column_major)
+                luma_row(data + i * x * 3, pixels + i, x, y, luma_weights[dc->luma]);
+            else
+                luma_row(data + i * x * 3, pixels + i * x, x, 1, luma_weights[dc->luma]);
+        }
+    }
+
+    stbi_image_free(data);
+    stats_add(dc->stats, STAGE_LUMA, luma);
+
+    return pixels;
+}
+
+uint8_t *get_pixels_from_memory(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc) {
+    arena *outer = stbi_arena;
+    stbi_arena   = dc->arena;
+    uint8_t *pixels = get_pixels_8(buffer, length, width, height, dc);
+    stbi_arena      = outer;
+
+    return pixels;
+}
+
+uint8_t *get_pixels(const char *path, int *width, int *height, const struct decode_config *dc) {
+    struct image_source src;
+    const double start = now();
+    const int ok       = source_open(&src, path);
+    stats_add(dc->stats, STAGE_READ, start);
+    uint8_t *pixels = ok ? get_pixels_from_memory(src.data, src.length, width, height, dc) : NULL;
+    source_close(&src);
+
+    return pixels;
+}
+
+/** get_pixels_16_from_memory() with stb_image allocating from stbi_arena */
+uint16_t *get_pixels_wide(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc) {
+    int channels;
+    const double start = now();
+    uint16_t *data = decode_image(buffer, length, width, height, dc, 2, &channels);
+    stats_add(dc->stats, STAGE_DECODE, start);
+    check_error(!data, "decode_image()", NULL);
+
+    const size_t x = *width;
+    const size_t y = *height;
+    if (channels == 1 && !dc->column_major) return data;
+
+    const double luma   = now();
+    const size_t planes = dc->rgb ? 3 : 1;
+    uint16_t *pixels    = STBI_MALLOC(x * y * planes * sizeof(*pixels));
+    if (!pixels) stbi_image_free(data);
+    check_error(!pixels, "malloc(): Failed to allocate pixels", NULL);
+
+    if (dc->rgb) {
+        split_planes(data, pixels, x, y, sizeof(*pixels), dc->column_major);
+    } else if (channels == 1) {
+        transpose_plane(data, pixels, x, y, sizeof(*pixels));
+    } else {
+        for (size_t i = 0; i < y; i++) {
+            if (dc->column_major)
+                luma_row_16(data + i * x * 3, pixels + i, x, y, luma_weights[dc->luma]);
+            else
+                luma_row_16(data + i * x * 3, pixels + i * x, x, 1, luma_weights[dc->luma]);
+        }
+    }
+
+    stbi_image_free(data);
+    stats_add(dc->stats, STAGE_LUMA, luma);
+
+    return pixels;
+}
+
+uint16_t *get_pixels_16_from_memory(const uint8_t *buffer, size_t length, int *width, int *height, const struct decode_config *dc) {
+    arena *outer = stbi_arena;
+    stbi_arena   = dc->arena;
+    uint16_t *pixels = get_pixels_wide(buffer, length, width, height, dc);
+    stbi_arena       = outer;
+
+    return pixels;
+}
+
+uint16_t *get_pixels_16(const char *path, int *width, int *height, const struct decode_config *dc) {
+    struct image_source src;
+    const double start = now();
+    const int ok       = source_open(&src, path);
+    stats_add(dc->stats, STAGE_READ, start);
+    uint16_t *pixels = ok ? get_pixels_16_from_memory(src.data, src.length, width, height, dc) : NULL;
+    source_close(&src);
+
+    return pixels;
+}
+
+#define PIXEL_THRESHOLD 10//!< Pixels darker than this are silent
+
+/**
+ * @brief Frequency of every row of an image
+ *
+ * Row y sits at the bottom of band y of height bands splitting the range from the minimum to the
+ * maximum frequency, so the last row stays below the maximum. With the default range of FREQ_LINEAR
+ * the rows are the multiples of fs / 2 / height.
+ *
+ * @param cfg Synthesis engine configuration
+ * @param fs Sample rate
+ * @param height Height of the image
+ * @param freq Pointer to store the frequency in hz of every row, NULL only counts the rows
+ * @return Number of first rows below the Nyquist frequency fs / 2, the only ones synthesized
+ */
+int row_freqs(const synth_config *cfg, float fs, int height, float *freq) {
+    const float nyquist = fs * 0.5f;
+    const float hi      = cfg->max_freq > 0.0f ? cfg->max_freq : nyquist;
+    const float lo      = (cfg->mapping == FREQ_LOG && cfg->min_freq <= 0.0f) ? FREQ_LOG_MIN : cfg->min_freq;
+    const float step    = (hi - lo) / height;
+    const double mel_lo = 2595.0 * log10(1.0 + lo / 700.0);
+    const double mel_hi = 2595.0 * log10(1.0 + hi / 700.0);
+
+    int rows = 0;
+    for (int y = 0; y < height; y++) {
+        float f = lo + y * step;
+        if (cfg->mapping == FREQ_LOG) f = lo * pow((double) hi / lo, (double) y / height);
+        if (cfg->mapping == FREQ_MEL) f = 700.0 * (pow(10.0, (mel_lo + (mel_hi - mel_lo) * y / height) / 2595.0) - 1.0);
+        if (freq) freq[y] = f;
+        // rows are ascending, the ones from the first at the Nyquist frequency would alias
+        if (f < nyquist && rows == y) rows++;
+    }
+
+    return rows;
+}
+
+/** Active pixels of every column of an image, stored column after column in contiguous arrays */
+struct sparse_columns {
+    int width;    //!< Number of columns
+    int *start;   //!< Entries of column x are [start[x], start[x + 1]), width + 1 values
+    int *row;     //!< Row of every entry, ascending within a column
+    float *amp;   //!< Amplitude of every entry
+    int columns;  //!< Capacity of start minus one
+    size_t cap;   //!< Capacity of row and amp
+};
+
+/** Deallocate the arrays of sparse columns */
+void sparse_free(struct sparse_columns *sp) {
+    free(sp->start);
+    free(sp->row);
+    free(sp->amp);
+}
+
+/**
+ * @brief Collect the active pixels of every column
+ *
+ * The image is read once in memory order, so synthesis never walks the pixels
+ * across rows or touches dark pixels. Arrays are kept and grown across images.
+ *
+ * @param sp Sparse columns, zero initialized before the first call
+ * @param pixels Single channel pixel data of depth bits per pixel
+ * @param width Width of the pixel data
+ * @param height Height of the pixel data
+ * @param rows Rows kept, the pixels of the rows from rows on are dropped
+ * @param column_major Pixels are stored column after column, see get_pixels()
+ * @param depth Bits per pixel, 8 or 16
+ * @return 1 on success, 0 on failure
+ */
+int sparse_build(struct sparse_columns *sp, const void *pixels, int width, int height, int rows, int column_major, int depth) {
+    if (width > sp->columns) {
+        int *start = realloc(sp->start, (width + 1) * sizeof(*start));
+        check_error(!start, "realloc(): Failed to allocate sparse columns", 0);
+        sp->start   = start;
+        sp->columns = width;
+    }
+    sp->width = width;
+
+    // amplitude of every 8 bit heat, 16 bit pixels are 257 times larger for the same heat
+    float amp_of[256];
+    for (int heat = 0; heat < 256; heat++)
+        amp_of[heat] = map(heat, 0.0f, 255.0f, 0.001f, 1.0f);
+
+    const uint8_t *p8   = pixels;
+    const uint16_t *p16 = pixels;
+    const int wide      = depth == 16;
+    const int threshold = wide ? PIXEL_THRESHOLD * 257 : PIXEL_THRESHOLD;
+#define SPARSE_PIXEL(i) (wide ? p16[(i)] : p8[(i)])
+#define SPARSE_AMP(v)   (wide ? map((v), 0.0f, 65535.0f, 0.001f, 1.0f) : amp_of[(v)])
+
+    // count the entries of each column into start[x + 1]
+    memset(sp->start, 0, (width + 1) * sizeof(*sp->start));
+    if (column_major) {
+        for (int x = 0; x < width; x++)
+            for (int y = 0; y < rows; y++)
+                sp->start[x + 1] += SPARSE_PIXEL((size_t) x * height + y) >= threshold;
+    } else {
+        for (int y = 0; y < rows; y++)
+            for (int x = 0; x < width; x++)
+                sp->start[x + 1] += SPARSE_PIXEL((size_t) y * width + x) >= threshold;
+    }
+    for (int x = 0; x < width; x++)
+        sp->start[x + 1] += sp->start[x];
+
+    const size_t nnz = sp->start[width];
+    if (nnz > sp->cap) {
+        int *row   = realloc(sp->row, nnz * sizeof(*row));
+        sp->row    = row ? row : sp->row;
+        float *amp = row ? realloc(sp->amp, nnz * sizeof(*amp)) : NULL;
+        sp->amp    = amp ? amp : sp->amp;
+        check_error(!row || !amp, "realloc(): Failed to allocate sparse columns", 0);
+        sp->cap = nnz;
+    }
+
+    if (column_major) {
+        for (int x = 0; x < width; x++) {
+            int i = sp->start[x];
+            for (int y = 0; y < rows; y++) {
+                const int heat = SPARSE_PIXEL((size_t) x * height + y);
+                if (heat < threshold) continue;
+                sp->row[i]   = y;
+                sp->amp[i++] = SPARSE_AMP(heat);
+            }
+        }
+    } else {
+        // start[x] is used as the fill cursor of column x, which leaves it at start[x + 1]
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < width; x++) {
+                const int heat = SPARSE_PIXEL((size_t) y * width + x);
+                if (heat < threshold) continue;
+
+                const int i = sp->start[x]++;
+                sp->row[i]  = y;
+                sp->amp[i]  = SPARSE_AMP(heat);
+            }
+        }
+        memmove(sp->start + 1, sp->start, width * sizeof(*sp->start));
+        sp->start[0] = 0;
+    }
+#undef SPARSE_PIXEL
+#undef SPARSE_AMP
+
+    return 1;
+}
+
+/**
+ * @brief Render a column with the reference additive engine
+ *
+ * Sample t of rp is sample origin + t of a signal whose rows are all at phase 0 at sample 0.
+ * The column functions below take the same origin, 0 restarts every row at the first sample.
+ */
+void additive_column(const struct sparse_columns *sp, const float *freq, float fs, long origin, int target, int x, float *rp) {
+    const float two_pi = M_PI * 2.0;
+    for (int i = sp->start[x]; i < sp->start[x + 1]; i++) {
+        const int y      = sp->row[i];
+        const float A    = sp->amp[i];
+        const float fc   = freq[y];// do freq[height - 1 - y] to flip the image upside down
+        const double ph0 = M_PI * 2.0 * fmod((double) (fc / fs) * origin, 1.0);
+        int t            = 0;
+        while (t < target) {
+            rp[t] += A * sin(two_pi * (fc / fs) * t + ph0);
+            t++;
+        }
+    }
+}
+
+/* sin(2 pi x) = x * P(x^2) for x in [-0.25, 0.25] turns, P is interpolated at chebyshev nodes. Together with the
+   range reduction the error stays below 2e-7, under 2 ulp at 1.0, for any 32 bit phase. */
+#define SINF_C0 6.283185482e+00f
+#define SINF_C1 -4.134168243e+01f
+#define SINF_C2 8.160247803e+01f
+#define SINF_C3 -7.658116913e+01f
+#define SINF_C4 3.975982666e+01f
+
+#define SINF_BLOCK 1024//!< Samples rendered by SYNTH_SINF for every pixel before moving to the next, fits in L1
+
+/** sin(2 pi p / 2^32) of a 32 bit phase without leaving single precision */
+static inline float sinf_turns(uint32_t p) {
+    const float x = (float) (int32_t) p * 0x1p-32f;// [-0.5, 0.5) turns
+    const float a = fabsf(x);
+    const float b = fminf(a, 0.5f - a);// sin(2 pi a) = sin(2 pi (0.5 - a)), b is in [0, 0.25]
+    const float s = b * b;
+    const float r = b * (SINF_C0 + s * (SINF_C1 + s * (SINF_C2 + s * (SINF_C3 + s * SINF_C4))));
+
+    return copysignf(r, x);
+}
+
+#if defined(IMG2WAV_SSE2)
+/** sinf_turns() of four phases, bit-identical to the scalar version */
+static inline __m128 sinf_turns_sse2(__m128i p) {
+    const __m128 x    = _mm_mul_ps(_mm_cvtepi32_ps(p), _mm_set1_ps(0x1p-32f));
+    const __m128 sign = _mm_and_ps(x, _mm_set1_ps(-0.0f));
+    const __m128 a    = _mm_xor_ps(x, sign);
+    const __m128 b    = _mm_min_ps(a, _mm_sub_ps(_mm_set1_ps(0.5f), a));
+    const __m128 s    = _mm_mul_ps(b, b);
+    __m128 r          = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(SINF_C4)), _mm_set1_ps(SINF_C3));
+    r                 = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(SINF_C2));
+    r                 = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(SINF_C1));
+    r                 = _mm_add_ps(_mm_mul_ps(s, r), _mm_set1_ps(SINF_C0));
+
+    return _mm_or_ps(_mm_mul_ps(b, r), sign);
+}
+#elif defined(IMG2WAV_NEON)
+/** sinf_turns() of four phases, separate multiplies and adds keep it bit-identical to the scalar version */
+static inline float32x4_t sinf_turns_neon(uint32x4_t p) {
+    const float32x4_t x   = vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(p)), vdupq_n_f32(0x1p-32f));
+    const uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000u));
+    const float32x4_t a   = vabsq_f32(x);
+    const float32x4_t b   = vminq_f32(a, vsubq_f32(vdupq_n_f32(0.5f), a));
+    const float32x4_t s   = vmulq_f32(b, b);
+    float32x4_t r         = vaddq_f32(vmulq_f32(s, vdupq_n_f32(SINF_C4)), vdupq_n_f32(SINF_C3));
+    r                     = vaddq_f32(vmulq_f32(s, r), vdupq_n_f32(SINF_C2));
+    r                     = vaddq_f32(vmulq_f32(s, r), vdupq_n_f32(SINF_C1));
+    r                     = vaddq_f32(vmulq_f32(s, r), vdupq_n_f32(SINF_C0));
+
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vmulq_f32(b, r)), sign));
+}
+#endif
+
+/** Phase increment in 2^-32 turns per sample of a row of fc hz of SYNTH_SINF and SYNTH_GPU, from the ratio SYNTH_ADDITIVE plays */
+uint32_t sinf_increment(float fc, float fs) {
+    return (uint32_t) (uint64_t) llround(ldexp(fmod((double) (fc / fs), 1.0), 32));
+}
+
+/** Add n samples of a row of amplitude A to out, starting at phase p and advancing by inc per sample */
+void sinf_row(float A, uint32_t inc, uint32_t p, int n, float *out) {
+    int t = 0;
+#if defined(IMG2WAV_SSE2)
+    const __m128 av    = _mm_set1_ps(A);
+    const __m128i step = _mm_set1_epi32((int32_t) (inc * 4));
+    __m128i pv         = _mm_add_epi32(_mm_set1_epi32((int32_t) p), _mm_set_epi32((int32_t) (inc * 3), (int32_t) (inc * 2), (int32_t) inc, 0));
+    for (; t + 4 <= n; t += 4) {
+        _mm_storeu_ps(out + t, _mm_add_ps(_mm_loadu_ps(out + t), _mm_mul_ps(av, sinf_turns_sse2(pv))));
+        pv = _mm_add_epi32(pv, step);
+    }
+    p += inc * (uint32_t) t;
+#elif defined(IMG2WAV_NEON)
+    const float32x4_t av    = vdupq_n_f32(A);
+    const uint32x4_t step   = vdupq_n_u32(inc * 4);
+    const uint32_t lanes[4] = {0, inc, inc * 2, inc * 3};
+    uint32x4_t pv           = vaddq_u32(vdupq_n_u32(p), vld1q_u32(lanes));
+    for (; t + 4 <= n; t += 4) {
+        vst1q_f32(out + t, vaddq_f32(vld1q_f32(out + t), vmulq_f32(av, sinf_turns_neon(pv))));
+        pv = vaddq_u32(pv, step);
+    }
+    p += inc * (uint32_t) t;
+#endif
+    for (; t < n; t++, p += inc)
+        out[t] += A * sinf_turns(p);
+}
+
+/**
+ * @brief Render a column with the float32 polynomial sine engine
+ *
+ * Phases are 32 bit fixed point turns, so they wrap exactly and the only approximation left is
+ * the frequency, rounded to a multiple of fs / 2^32.
+ */
+void sinf_column(const struct sparse_columns *sp, const float *freq, float fs, long origin, int target, int x, float *rp) {
+    for (int t0 = 0; t0 < target; t0 += SINF_BLOCK) {
+        const int n = (target - t0 < SINF_BLOCK) ? target - t0 : SINF_BLOCK;
+        for (int i = sp->start[x]; i < sp->start[x + 1]; i++) {
+            const uint32_t inc = sinf_increment(freq[sp->row[i]], fs);
+            sinf_row(sp->amp[i], inc, inc * (uint32_t) (origin + t0), n, rp + t0);
+        }
+    }
+}
+
+#define FFT_MIN_SIZE     16   //!< Smallest frame size picked automatically by SYNTH_FFT
+#define FFT_MAX_SIZE     65536//!< Largest frame size picked automatically by SYNTH_FFT
+#define FFT_ENGINE_CACHE 2    //!< Number of synthesized column frames kept by SYNTH_FFT, a column and the one fading out under it
+#define FFT_PHASE_ERROR  1e-4 //!< Largest phase drift in radians of a row played at the frequency of its bin
+
+/** Bin of a row of fc hz in frames of n samples, -1 if playing it at the bin's frequency drifts too far within span samples */
+long fft_bin(float fc, float fs, int n, long span) {
+    const double k   = (double) (fc / fs) * n;
+    const double bin = round(k);
+
+    return fabs(k - bin) * M_PI * 2.0 * span / n <= FFT_PHASE_ERROR ? (long) bin : -1;
+}
+
+/**
+ * @brief Pick the frame size of SYNTH_FFT
+ *
+ * Rows are only placed in a bin that matches their frequency, the others are summed in the
+ * time domain. The smallest power of two whose bins hold every row is picked, or the one holding
+ * the most rows if none does. The default linear rows of a power of two height all fit in 2 * height.
+ *
+ * @param cfg Synthesis engine configuration, a positive cfg.fft_size is used as it is
+ * @param fs Sample rate
+ * @param rows Number of rows synthesized
+ * @param freq Frequency of every row
+ * @param span Samples every row plays without restarting its phase
+ * @return Frame size, a power of two
+ */
+int fft_frame_size(synth_config cfg, float fs, int rows, const float *freq, long span) {
+    if (cfg.fft_size > 0) return cfg.fft_size;
+
+    int best = FFT_MIN_SIZE;
+    int most = -1;
+    for (int n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE && most < rows; n <<= 1) {
+        int hits = 0;
+        for (int y = 0; y < rows; y++)
+            hits += fft_bin(freq[y], fs, n, span) >= 0;
+        if (hits > most) {
+            best = n;
+            most = hits;
+        }
+    }
+
+    return best;
+}
+
+/** State of the inverse FFT engine */
+struct fft_engine {
+    fft_plan *plan;                //!< Transform plan of size n
+    int n;                         //!< Frame size
+    float *re;                     //!< Spectrum scratch, real part
+    float *im;                     //!< Spectrum scratch, imaginary part
+    float *frame[FFT_ENGINE_CACHE];//!< One period of the rows of a column that sit on a bin
+    int col[FFT_ENGINE_CACHE];     //!< Column stored in each frame slot, -1 if empty
+    int next;                      //!< Next frame slot to evict
+};
+
+/** Deallocate an inverse FFT engine */
+void fft_engine_free(struct fft_engine *e) {
+    if (!e) return;
+    fft_plan_free(e->plan);
+    free(e->re);
+    free(e->im);
+    for (int i = 0; i < FFT_ENGINE_CACHE; i++)
+        free(e->frame[i]);
+    free(e);
+}
+
+/** Create an inverse FFT engine with frames of n samples */
+struct fft_engine *fft_engine_new(int n) {
+    struct fft_engine *e = calloc(1, sizeof(*e));
+    check_error(!e, "calloc(): Failed to allocate fft engine", NULL);
+
+    e->n    = n;
+    e->plan = fft_plan_new(n);
+    e->re   = malloc(n * sizeof(*e->re));
+    e->im   = malloc(n * sizeof(*e->im));
+    int ok  = e->plan && e->re && e->im;
+    for (int i = 0; i < FFT_ENGINE_CACHE; i++) {
+        e->frame[i] = malloc(n * sizeof(*e->frame[i]));
+        e->col[i]   = -1;
+        ok          = ok && e->frame[i];
+    }
+    if (!ok) fft_engine_free(e);
+    check_error(!ok, "fft_engine_new(): Failed to allocate fft engine", NULL);
+
+    return e;
+}
+
+/** Forget the frames cached by an engine, needed before it renders another image */
+void fft_engine_reset(struct fft_engine *e) {
+    for (int i = 0; i < FFT_ENGINE_CACHE; i++)
+        e->col[i] = -1;
+    e->next = 0;
+}
+
+/**
+ * @brief Synthesize one period of the rows of a column that sit on a bin
+ *
+ * Every such pixel is placed in the bin of its frequency, so the inverse transform yields
+ * sum(A * sin(2 pi k t / n)), exactly the additive signal of those rows over the whole period.
+ *
+ * @param bin Bin of every row, see fft_bin()
+ * @return Frame of e->n samples, owned by the engine and valid until FFT_ENGINE_CACHE other columns are requested,
+ *         NULL if no pixel of the column sits on a bin
+ */
+const float *fft_engine_frame(struct fft_engine *e, const struct sparse_columns *sp, const int *bin, int x) {
+    for (int i = 0; i < FFT_ENGINE_CACHE; i++)
+        if (e->col[i] == x) return e->frame[i];
+
+    const int n = e->n;
+    int hits    = 0;
+    memset(e->re, 0, n * sizeof(*e->re));
+    memset(e->im, 0, n * sizeof(*e->im));
+    for (int i = sp->start[x]; i < sp->start[x + 1]; i++) {
+        const int k = bin[sp->row[i]];
+        if (k < 0) continue;
+        e->re[k] += sp->amp[i];
+        hits++;
+    }
+    if (!hits) return NULL;
+
+    fft_execute(e->plan, e->re, e->im, FFT_INVERSE);
+
+    const int slot = e->next;
+    e->next        = (e->next + 1) % FFT_ENGINE_CACHE;
+    e->col[slot]   = x;
+    memcpy(e->frame[slot], e->im, n * sizeof(*e->im));
+
+    return e->frame[slot];
+}
+
+/**
+ * @brief Render a column with the inverse FFT engine
+ *
+ * The rows on a bin repeat every n samples, so the column's frame is tiled from sample origin
+ * of its period. Rows off the bins are added like SYNTH_SINF does, at their own frequency.
+ */
+void fft_column(struct fft_engine *e, const struct sparse_columns *sp, const int *bin, const float *freq, float fs, long origin, int target, int x, float *rp) {
+    const float *frame = fft_engine_frame(e, sp, bin, x);
+    if (frame) {
+        long i = origin % e->n;
+        for (int t = 0; t < target; t++) {
+            rp[t] += frame[i];
+            if (++i == e->n) i = 0;
+        }
+    }
+
+    for (int i = sp->start[x]; i < sp->start[x + 1]; i++) {
+        if (bin[sp->row[i]] >= 0) continue;
+        const uint32_t inc = sinf_increment(freq[sp->row[i]], fs);
+        sinf_row(sp->amp[i], inc, inc * (uint32_t) origin, target, rp);
+    }
+}
+
+/** Render a column with the oscillator bank engine */
+void osc_column(osc_bank *bank, const struct sparse_columns *sp, const float *freq, float fs, long origin, int target, int x, float *rp) {
+    const double two_pi = M_PI * 2.0;
+
+    osc_bank_clear(bank);
+    for (int i = sp->start[x]; i < sp->start[x + 1]; i++) {
+        const float fc = freq[sp->row[i]];
+        osc_bank_add(bank, sp->amp[i], two_pi * (fc / fs), two_pi * fmod((double) (fc / fs) * origin, 1.0));
+    }
+    osc_bank_render(bank, rp, target);
+}
+
+#define TABLE_DEFAULT_SIZE 4096//!< Wavetable size of SYNTH_TABLE, about -130 dB of error with linear interpolation
+
+/** Sine wavetable and per row phase increments of SYNTH_TABLE, shared read only by every worker */
+struct wavetable {
+    int bits;                //!< log2 of the table size
+    enum table_interp interp;//!< Interpolation between samples
+    float *wave;             //!< sin(2 pi i / size) for i in [-1, size + 2), indexed from wave[1]
+    uint64_t *inc;           //!< Phase increment per sample of every row, a full period is 2^64
+    int rows;                //!< Number of rows of inc
+    int cap;                 //!< Capacity of inc and freq
+    float fs;                //!< Sample rate inc was computed for
+    float *freq;             //!< Frequency of every row inc was computed for
+};
+
+/** Deallocate a wavetable */
+void wavetable_free(struct wavetable *tb) {
+    if (!tb) return;
+    free(tb->wave);
+    free(tb->inc);
+    free(tb->freq);
+    free(tb);
+}
+
+/** Create a sine wavetable of size samples, size must be a power of two */
+struct wavetable *wavetable_new(int size, enum table_interp interp) {
+    struct wavetable *tb = calloc(1, sizeof(*tb));
+    check_error(!tb, "calloc(): Failed to allocate wavetable", NULL);
+
+    while ((1 << tb->bits) < size) tb->bits++;
+    tb->interp = interp;
+    tb->wave     = malloc((size + 3) * sizeof(*tb->wave));
+    const int ok = tb->wave != NULL;
+    if (!ok) wavetable_free(tb);
+    check_error(!ok, "malloc(): Failed to allocate wavetable", NULL);
+
+    // guard samples on both sides let interpolation read i - 1 and i + 2 without wrapping
+    for (int i = -1; i < size + 2; i++)
+        tb->wave[i + 1] = sin(M_PI * 2.0 * i / size);
+
+    return tb;
+}
+
+/**
+ * @brief Compute the phase increment of every row
+ *
+ * Increments only depend on the sample rate and the row frequencies, so they are
+ * kept across images and only recomputed when either changes.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int wavetable_tune(struct wavetable *tb, float fs, int height, const float *freq) {
+    if (tb->rows == height && tb->fs == fs && memcmp(tb->freq, freq, height * sizeof(*freq)) == 0) return 1;
+
+    if (height > tb->cap) {
+        uint64_t *inc = realloc(tb->inc, height * sizeof(*inc));
+        tb->inc       = inc ? inc : tb->inc;
+        float *copy   = inc ? realloc(tb->freq, height * sizeof(*copy)) : NULL;
+        tb->freq      = copy ? copy : tb->freq;
+        check_error(!inc || !copy, "realloc(): Failed to allocate phase increments", 0);
+        tb->cap = height;
+    }
+
+    // the single precision ratio is the one SYNTH_ADDITIVE and SYNTH_OSC play, so phases agree on long signals
+    for (int y = 0; y < height; y++) {
+        const double cycles = fmod((double) (freq[y] / fs), 1.0);
+        tb->inc[y]          = (uint64_t) ldexp(cycles, 64);
+    }
+    memcpy(tb->freq, freq, height * sizeof(*freq));
+    tb->rows = height;
+    tb->fs   = fs;
+
+    return 1;
+}
+
+/**
+ * @brief Render a column with the wavetable engine
+ *
+ * Every row keeps a 64 bit phase accumulator, its top bits index the table and the next
+ * 24 bits are the interpolation fraction, so frequencies are exact to fs / 2^53.
+ */
+void table_column(const struct wavetable *tb, const struct sparse_columns *sp, long origin, int target, int x, float *rp) {
+    const int shift     = 64 - tb->bits;
+    const float *wave   = tb->wave + 1;
+    const float to_frac = 1.0f / 16777216.0f;
+
+    for (int j = sp->start[x]; j < sp->start[x + 1]; j++) {
+        const float A      = sp->amp[j];
+        const uint64_t inc = tb->inc[sp->row[j]];
+        uint64_t phase     = inc * (uint64_t) origin;
+        if (tb->interp == TABLE_LINEAR) {
+            for (int t = 0; t < target; t++, phase += inc) {
+                const uint64_t i = phase >> shift;
+                const float f    = (float) ((phase << tb->bits) >> 40) * to_frac;
+                rp[t] += A * (wave[i] + f * (wave[i + 1] - wave[i]));
+            }
+        } else {
+            for (int t = 0; t < target; t++, phase += inc) {
+                const uint64_t i = phase >> shift;
+                const float f    = (float) ((phase << tb->bits) >> 40) * to_frac;
+                const float a = wave[i - 1], b = wave[i], c = wave[i + 1], d = wave[i + 2];
+
+                // lagrange weights of the points at -1, 0, 1 and 2
+                const float wa = -f * (f - 1.0f) * (f - 2.0f) * (1.0f / 6.0f);
+                const float wb = (f + 1.0f) * (f - 1.0f) * (f - 2.0f) * 0.5f;
+                const float wc = -(f + 1.0f) * f * (f - 2.0f) * 0.5f;
+                const float wd = (f + 1.0f) * f * (f - 1.0f) * (1.0f / 6.0f);
+                rp[t] += A * (wa * a + wb * b + wc * c + wd * d);
+            }
+        }
+    }
+}
+
+/** Peak and counters of one worker of a job */
+struct synth_worker {
+    float peak;      //!< Largest absolute sample of the current synth_job_render() call
+    uint64_t columns;//!< Columns rendered since synth_job_new()
+    uint64_t active; //!< Active pixels of those columns
+    double seconds;  //!< Time spent rendering those columns
+    float *tail;     //!< Previous column rendered under the cross-fade, synth_job.fade samples
+    char pad[64];    //!< Keep workers on separate cache lines
+};
+
+/** Columns of an image being synthesized by a pool of workers */
+struct synth_job {
+    struct sparse_columns sparse;//!< Active pixels of every column
+    int width;                   //!< Width of the pixel data
+    int height;                  //!< Height of the pixel data
+    float fs;                    //!< Sample rate
+    float *freq;                 //!< Frequency of every row in hz, see row_freqs()
+    int *bin;                    //!< Bin of every row in the frames of SYNTH_FFT, -1 for rows off the bins
+    int freq_cap;                //!< Capacity of freq and bin
+    int audible;                 //!< Rows below the Nyquist frequency, the others are dropped before synthesis
+    int target;                  //!< Samples per column
+    synth_config cfg;            //!< Synthesis engine configuration
+    pool *workers;               //!< Threads rendering the columns
+    double *cost;                //!< Relative cost of every column
+    int columns;                 //!< Capacity of cost
+    struct fft_engine **fft;     //!< Engine of every worker for SYNTH_FFT
+    osc_bank **bank;             //!< Oscillator bank of every worker for SYNTH_OSC
+    struct wavetable *table;     //!< Wavetable shared by every worker for SYNTH_TABLE
+    float *out;                  //!< Output of the current synth_job_render() call
+    int first;                   //!< Column rendered at the start of out
+    struct synth_worker *state;  //!< Peak and counters of every worker
+    float *window;               //!< Weight of the column itself at each sample of the cross-fade
+    int fade;                    //!< Samples of the cross-fade at the start of every column but the first
+    int fade_cap;                //!< Capacity of window and of the tail of every worker
+    int gpu_tried;               //!< A device for SYNTH_GPU was looked for already
+#ifdef IMG2WAV_GPU
+    gpu_synth *gpu;              //!< Device of SYNTH_GPU, NULL renders on the CPU
+    uint32_t *inc;               //!< Phase increment of every row uploaded to gpu
+    int rows;                    //!< Capacity of inc
+#endif
+};
+
+/** Stop the workers and deallocate the engines of a job */
+void synth_job_free(struct synth_job *job) {
+    for (int w = 0; job->workers && w < pool_size(job->workers); w++) {
+        if (job->fft) fft_engine_free(job->fft[w]);
+        if (job->bank) osc_bank_free(job->bank[w]);
+        if (job->state) free(job->state[w].tail);
+    }
+    free(job->fft);
+    free(job->bank);
+    free(job->cost);
+    free(job->state);
+    free(job->window);
+    free(job->freq);
+    free(job->bin);
+#ifdef IMG2WAV_GPU
+    gpu_synth_free(job->gpu);
+    free(job->inc);
+#endif
+    wavetable_free(job->table);
+    sparse_free(&job->sparse);
+    pool_free(job->workers);
+}
+
+/**
+ * @brief Start the workers of a job
+ *
+ * A job synthesizes any number of images one after the other, see synth_job_setup().
+ *
+ * @param job Job to initialize, free it with synth_job_free() even on failure
+ * @param threads Number of threads rendering columns, 0 uses every processor
+ * @return 1 on success, 0 on failure
+ */
+int synth_job_new(struct synth_job *job, int threads) {
+    memset(job, 0, sizeof(*job));
+    job->workers = pool_new(threads > 0 ? threads : pool_cpu_count());
+    check_error(!job->workers, "pool_new(): Failed to create threads", 0);
+
+    const int n = pool_size(job->workers);
+    job->fft    = calloc(n, sizeof(*job->fft));
+    job->bank   = calloc(n, sizeof(*job->bank));
+    job->state  = calloc(n, sizeof(*job->state));
+    check_error(!job->fft || !job->bank || !job->state, "calloc(): Failed to allocate engines", 0);
+
+    return 1;
+}
+
+/**
+ * @brief Open the device of SYNTH_GPU and upload the active pixels of the current image
+ *
+ * Without a device, or in a build without IMG2WAV_GPU, the columns are rendered by SYNTH_SINF
+ * on the CPU instead, which produces the same signal.
+ *
+ * @return 0 if the device failed to take the image, 1 otherwise
+ */
+int synth_job_upload(struct synth_job *job) {
+#ifdef IMG2WAV_GPU
+    if (!job->gpu_tried) {
+        job->gpu = gpu_synth_new();
+        if (!job->gpu) fprintf(stderr, "No OpenCL device found, --engine gpu renders on the CPU\n");
+    }
+    job->gpu_tried = 1;
+    if (!job->gpu) return 1;
+
+    if (job->height > job->rows) {
+        uint32_t *inc = realloc(job->inc, job->height * sizeof(*inc));
+        check_error(!inc, "realloc(): Failed to allocate phase increments", 0);
+        job->inc  = inc;
+        job->rows = job->height;
+    }
+    for (int y = 0; y < job->height; y++)
+        job->inc[y] = sinf_increment(job->freq[y], job->fs);
+
+    struct sparse_columns *sp = &job->sparse;
+    check_error(!gpu_synth_upload(job->gpu, job->width, sp->start, sp->row, sp->amp, job->height, job->inc), "gpu_synth_upload()", 0);
+#else
+    if (!job->gpu_tried) fprintf(stderr, "Built without IMG2WAV_GPU, --engine gpu renders on the CPU\n");
+    job->gpu_tried = 1;
+#endif
+
+    return 1;
+}
+
+/**
+ * @brief Prepare a job to synthesize an image
+ *
+ * Engines of a previous image are kept when they still fit, so fft plans and oscillator
+ * banks are only allocated again when the frame size or height grows.
+ *
+ * @param job Job created with synth_job_new()
+ * @param pixels Single channel pixel data of cfg.depth bits per pixel
+ * @param sample_rate Desired sample rate of the frequencies
+ * @param time_s Length in seconds of the transmission time
+ * @param width Width of the pixel data
+ * @param height Height of the pixel data
+ * @param cfg Synthesis engine configuration, cfg.threads is ignored
+ * @return 1 on success, 0 on failure
+ */
+int synth_job_setup(struct synth_job *job, const void *pixels, float sample_rate, float time_s, int width, int height, synth_config cfg) {
+    job->width  = width;
+    job->height = height;
+    job->fs     = sample_rate;
+    job->target = (sample_rate * time_s) / width;
+    job->cfg    = cfg;
+    check_error(job->target <= 0, "Transmission time is too short for the image width", 0);
+
+    if (height > job->freq_cap) {
+        float *freq = realloc(job->freq, height * sizeof(*freq));
+        check_error(!freq, "realloc(): Failed to allocate row frequencies", 0);
+        job->freq = freq;
+        int *bin  = realloc(job->bin, height * sizeof(*bin));
+        check_error(!bin, "realloc(): Failed to allocate row bins", 0);
+        job->bin      = bin;
+        job->freq_cap = height;
+    }
+    job->audible = row_freqs(&cfg, sample_rate, height, job->freq);
+
+    if (width > job->columns) {
+        double *cost = realloc(job->cost, width * sizeof(*cost));
+        check_error(!cost, "realloc(): Failed to allocate column costs", 0);
+        job->cost    = cost;
+        job->columns = width;
+    }
+
+    check_error(!sparse_build(&job->sparse, pixels, width, height, job->audible, cfg.column_major, cfg.depth), "sparse_build()", 0);
+
+    // columns are balanced by their number of active pixels, dark columns are nearly free
+    for (int x = 0; x < width; x++)
+        job->cost[x] = 1.0 + (job->sparse.start[x + 1] - job->sparse.start[x]);
+
+    if (cfg.engine == SYNTH_TABLE) {
+        const int size = cfg.table_size > 0 ? cfg.table_size : TABLE_DEFAULT_SIZE;
+        if (!job->table || (1 << job->table->bits) != size || job->table->interp != cfg.interp) {
+            wavetable_free(job->table);
+            job->table = wavetable_new(size, cfg.interp);
+            check_error(!job->table, "wavetable_new()", 0);
+        }
+        check_error(!wavetable_tune(job->table, sample_rate, height, job->freq), "wavetable_tune()", 0);
+    }
+
+    const float crossfade = cfg.crossfade < 0.0f ? 0.0f : cfg.crossfade > 1.0f ? 1.0f : cfg.crossfade;
+    job->fade             = width < 2 ? 0 : (int) (crossfade * job->target);
+    if (job->fade > job->fade_cap) {
+        float *window = realloc(job->window, job->fade * sizeof(*window));
+        check_error(!window, "realloc(): Failed to allocate cross-fade window", 0);
+        job->window = window;
+        for (int w = 0; w < pool_size(job->workers); w++) {
+            float *tail = realloc(job->state[w].tail, job->fade * sizeof(*tail));
+            check_error(!tail, "realloc(): Failed to allocate cross-fade tail", 0);
+            job->state[w].tail = tail;
+        }
+        job->fade_cap = job->fade;
+    }
+    // raised cosine, the weights of both columns sum to 1 so a row lit in both keeps its amplitude
+    for (int t = 0; t < job->fade; t++)
+        job->window[t] = 0.5 - 0.5 * cos(M_PI * (t + 0.5) / job->fade);
+
+    if (cfg.engine == SYNTH_GPU) check_error(!synth_job_upload(job), "synth_job_upload()", 0);
+
+    int n = 0;
+    if (cfg.engine == SYNTH_FFT) {
+        // rows restart at every column unless the phase is continuous, the cross-fade plays them fade samples longer
+        const long span = cfg.phase == PHASE_CONTINUOUS ? (long) width * job->target : job->target + job->fade;
+        n               = fft_frame_size(cfg, sample_rate, job->audible, job->freq, span);
+        for (int y = 0; y < job->audible; y++)
+            job->bin[y] = (int) fft_bin(job->freq[y], sample_rate, n, span);
+    }
+
+    for (int w = 0; w < pool_size(job->workers); w++) {
+        if (cfg.engine == SYNTH_FFT) {
+            if (job->fft[w] && job->fft[w]->n == n) {
+                fft_engine_reset(job->fft[w]);
+            } else {
+                fft_engine_free(job->fft[w]);
+                job->fft[w] = fft_engine_new(n);
+                check_error(!job->fft[w], "fft_engine_new()", 0);
+            }
+        } else if (cfg.engine == SYNTH_OSC) {
+            if (!job->bank[w] || job->bank[w]->cap < (size_t) height) {
+                osc_bank_free(job->bank[w]);
+                job->bank[w] = osc_bank_new(height);
+                check_error(!job->bank[w], "osc_bank_new(): Failed to allocate oscillator bank", 0);
+            }
+            check_error(!osc_bank_set_kernel(job->bank[w], cfg.simd ? cfg.simd : "auto"), "osc_bank_set_kernel(): Kernel not supported by this CPU", 0);
+        }
+    }
+
+    return 1;
+}
+
+/** Add n samples of the pixels of column x, starting at sample origin of the rows' phase, to rp */
+void synth_pixels(struct synth_job *job, int worker, int x, long origin, int n, float *rp) {
+    switch (job->cfg.engine) {
+        case SYNTH_FFT:
+            fft_column(job->fft[worker], &job->sparse, job->bin, job->freq, job->fs, origin, n, x, rp);
+            break;
+        case SYNTH_ADDITIVE:
+            additive_column(&job->sparse, job->freq, job->fs, origin, n, x, rp);
+            break;
+        case SYNTH_OSC:
+            osc_column(job->bank[worker], &job->sparse, job->freq, job->fs, origin, n, x, rp);
+            break;
+        case SYNTH_TABLE:
+            table_column(job->table, &job->sparse, origin, n, x, rp);
+            break;
+        case SYNTH_SINF:
+        case SYNTH_GPU:
+            sinf_column(&job->sparse, job->freq, job->fs, origin, n, x, rp);
+            break;
+    }
+}
+
+/** Render one column of a job, every column writes its own slice of the output so workers never share samples */
+void synth_column(void *ctx, int worker, size_t task) {
+    struct synth_job *job = ctx;
+    const int x           = job->first + (int) task;
+    float *rp             = job->out + task * job->target;
+    const double start    = now();
+    const int continuous  = job->cfg.phase == PHASE_CONTINUOUS;
+    const long origin     = continuous ? (long) x * job->target : 0;
+
+    memset(rp, 0, job->target * sizeof(*rp));
+    synth_pixels(job, worker, x, origin, job->target, rp);
+
+    if (job->fade > 0 && x > 0) {
+        // the previous column keeps playing past its end while this one fades in, with
+        // PHASE_RESTART its rows continue from where they stopped instead of restarting
+        float *tail = job->state[worker].tail;
+        memset(tail, 0, job->fade * sizeof(*tail));
+        synth_pixels(job, worker, x - 1, continuous ? origin : job->target, job->fade, tail);
+        for (int t = 0; t < job->fade; t++)
+            rp[t] = tail[t] + job->window[t] * (rp[t] - tail[t]);
+    }
+
+    // the column is still in cache, tracking the peak here saves another pass over the whole signal
+    const float max           = find_max(rp, job->target);
+    struct synth_worker *self = &job->state[worker];
+    if (max > self->peak) self->peak = max;
+
+    self->columns++;
+    self->active += job->sparse.start[x + 1] - job->sparse.start[x];
+    self->seconds += now() - start;
+}
+
+/**
+ * @brief Render a range of columns
+ *
+ * @param job Job to render
+ * @param first First column to render
+ * @param count Number of columns to render
+ * @param out Output of count * job->target samples
+ * @return Largest absolute sample of the rendered columns
+ */
+float synth_job_render(struct synth_job *job, int first, int count, float *out) {
+#ifdef IMG2WAV_GPU
+    if (job->cfg.engine == SYNTH_GPU && job->gpu) {
+        const double start = now();
+        if (gpu_synth_render(job->gpu, first, count, job->target, job->cfg.phase == PHASE_CONTINUOUS, job->fade, out)) {
+            struct synth_worker *self = &job->state[0];
+            self->columns += count;
+            self->active += job->sparse.start[first + count] - job->sparse.start[first];
+            self->seconds += now() - start;
+
+            return find_max(out, (size_t) count * job->target);
+        }
+        fprintf(stderr, "gpu_synth_render(): Device failed, rendering on the CPU\n");
+        gpu_synth_free(job->gpu);
+        job->gpu = NULL;
+    }
+#endif
+    const int n = pool_size(job->workers);
+    for (int w = 0; w < n; w++)
+        job->state[w].peak = 0.0f;
+
+    job->first = first;
+    job->out   = out;
+    pool_run(job->workers, count, job->cost + first, synth_column, job);
+
+    float peak = 0.0f;
+    for (int w = 0; w < n; w++)
+        if (job->state[w].peak > peak) peak = job->state[w].peak;
+
+    return peak;
+}
+
+/**
+ * @brief Columns on either side of a column whose samples depend on its pixels
+ *
+ * A cross-fade plays the tail of a column under the start of the next one.
+ *
+ * @param job Job prepared with synth_job_setup()
+ * @param before Pointer to store the number of earlier columns depending on a column
+ * @param after Pointer to store the number of later columns depending on a column
+ */
+void synth_job_reach(const struct synth_job *job, int *before, int *after) {
+    *before = 0;
+    *after  = job->fade > 0;
+}
+
+/** Factor that brings samples with an absolute maximum of peak into [-1.0, 1.0], quieter signals are kept as they are */
+float peak_scale(float peak) {
+    return peak > 1.0f ? 1.0f / peak : 1.0f;
+}
+
+/**
+ * @brief Upper bound of the absolute amplitude of any synthesized sample
+ *
+ * A column is a sum of sines so it can never exceed the sum of its amplitudes,
+ * cross-fades are convex combinations of two columns.
+ *
+ * @param sp Active pixels of every column
+ * @return Largest sum of amplitudes of any column
+ */
+float peak_bound(const struct sparse_columns *sp) {
+    float bound = 0.0f;
+    for (int x = 0; x < sp->width; x++) {
+        float sum = 0.0f;
+        for (int i = sp->start[x]; i < sp->start[x + 1]; i++)
+            sum += sp->amp[i];
+        if (sum > bound) bound = sum;
+    }
+
+    return bound;
+}
+
+float *get_freqs(const void *pixels, float sample_rate, float time_s, int width, int height, synth_config cfg, int *size) {
+    *size = time_s * sample_rate;
+
+    float *result = calloc(*size, sizeof(*result));
+    check_error(!result, "calloc(): Failed to allocate result", NULL);
+    if ((int) ((sample_rate * time_s) / width) <= 0) return result;
+
+    struct synth_job job;
+    if (!synth_job_new(&job, cfg.threads) || !synth_job_setup(&job, pixels, sample_rate, time_s, width, height, cfg)) {
+        synth_job_free(&job);
+        free(result);
+        return NULL;
+    }
+
+    synth_job_render(&job, 0, width, result);
+    synth_job_free(&job);
+
+    return result;
+}
+
+/** Number of channels of the wav files written with opts */
+int output_channels(const struct options *opts) {
+    switch (opts->channels) {
+        case CHANNELS_RGB:
+            return 3;
+        case CHANNELS_TILES:
+            return opts->tiles;
+        default:
+            return 1;
+    }
+}
+
+/** Stream of the output "-", opts->out or stdout */
+FILE *output_stream(const struct options *opts) {
+    if (opts->out) return opts->out;
+
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return stdout;
+}
+
+/**
+ * @brief Start writing a wav file
+ *
+ * stdout may be a pipe that can't seek back to patch the header,
+ * so its header is written up front with the sizes of cfg.ns samples.
+ *
+ * @param opts Command line options
+ * @param cfg Configuration of the wav file, cfg.ns must be the number of samples that will be appended
+ * @param path Output wav path, "-" writes to output_stream()
+ * @return Writer or NULL on failure
+ */
+wav_writer *output_open(const struct options *opts, wav_config cfg, const char *path) {
+    cfg.block = opts->io_block;
+    if (strcmp(path, "-") != 0) return wav_writer_open(cfg, path);
+
+    return wav_writer_open_stream(cfg, output_stream(opts));
+}
+
+/**
+ * @brief Copy a finished wav file to the output
+ *
+ * @param opts Command line options
+ * @param in Wav file opened for reading
+ * @param path Output wav path, "-" writes to output_stream()
+ * @return 1 on success, 0 on failure
+ */
+int output_copy(const struct options *opts, FILE *in, const char *path) {
+    if (strcmp(path, "-") == 0) {
+        FILE *out = output_stream(opts);
+        return cache_copy(in, out) && fflush(out) == 0;
+    }
+
+    FILE *out = fopen(path, "wb");
+    check_error(!out, "fopen(): Failed to open output", 0);
+    const int ok = cache_copy(in, out);
+
+    return fclose(out) == 0 && ok;
+}
+
+struct img2wav_ctx {
+    struct synth_job *jobs;//!< Threads and engines rendering the columns of every channel
+    int njobs;             //!< Number of jobs started, the most channels of any image so far
+    int threads;           //!< Threads rendering the columns of every job
+    pool *channels;        //!< Workers rendering the channels concurrently, NULL until an image has two
+    arena *arena;          //!< Decoded image, pixels and buffered signal of the current image
+    aio *io;               //!< Writer thread and blocks of --stream, NULL until the first stream
+    cache *cache;          //!< Finished wav files shared by every context, NULL renders every image
+    struct stats stats;    //!< Timers and counters of every image converted by convert()
+};
+
+/**
+ * @brief Start the jobs of n channels and, for more than one, the workers rendering them concurrently
+ *
+ * @param c Context created with img2wav_ctx_new()
+ * @param n Number of channels of the next image
+ * @return 1 on success, 0 on failure
+ */
+int img2wav_ctx_channels(img2wav_ctx *c, int n) {
+    if (n > c->njobs) {
+        struct synth_job *jobs = realloc(c->jobs, n * sizeof(*jobs));
+        check_error(!jobs, "realloc(): Failed to allocate channel jobs", 0);
+        c->jobs = jobs;
+        // a job that failed to start is counted too, synth_job_free() cleans it up
+        while (c->njobs < n)
+            if (!synth_job_new(&c->jobs[c->njobs++], c->threads)) return 0;
+    }
+    if (n > 1 && (!c->channels || pool_size(c->channels) < n)) {
+        pool_free(c->channels);
+        c->channels = pool_new(n);
+        check_error(!c->channels, "pool_new(): Failed to create channel threads", 0);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Start the writer of a stream, the one of the last stream is kept if it has the same depth
+ *
+ * @param c Context created with img2wav_ctx_new()
+ * @param depth Number of blocks queued for the writer thread, 1 writes on the calling thread
+ * @return 1 on success, 0 on failure
+ */
+int img2wav_ctx_writer(img2wav_ctx *c, int depth) {
+    if (c->io && aio_depth(c->io) == depth) return 1;
+
+    aio_free(c->io);
+    c->io = aio_new(depth);
+    check_error(!c->io, "aio_new(): Failed to create the writer", 0);
+
+    return 1;
+}
+
+img2wav_ctx *img2wav_ctx_new(int threads) {
+    img2wav_ctx *c = calloc(1, sizeof(*c));
+    check_error(!c, "calloc(): Failed to allocate context", NULL);
+    c->threads   = threads;
+    c->arena     = arena_new(0);
+    const int ok = c->arena && img2wav_ctx_channels(c, 1);
+    if (!ok) img2wav_ctx_free(c);
+    check_error(!ok, "img2wav_ctx_new(): Failed to start the context", NULL);
+
+    return c;
+}
+
+void img2wav_ctx_free(img2wav_ctx *c) {
+    if (!c) return;
+    for (int ch = 0; ch < c->njobs; ch++)
+        synth_job_free(&c->jobs[ch]);
+    free(c->jobs);
+    pool_free(c->channels);
+    aio_free(c->io);
+    arena_free(c->arena);
+    free(c);
+}
+
+void img2wav_ctx_set_cache(img2wav_ctx *c, cache *shared) {
+    c->cache = shared;
+}
+
+/** Columns of every channel rendered at once by the channel workers of a context */
+struct channel_render {
+    struct synth_job *jobs;  //!< Job of every channel
+    int first;               //!< First column to render
+    int count;               //!< Number of columns to render
+    float *const *out;       //!< Output of every channel
+    float peak[CHANNELS_MAX];//!< Largest absolute sample of every channel
+};
+
+/** Render the columns of one channel, the job's own threads split its columns */
+void channel_render_task(void *ctx, int worker, size_t task) {
+    struct channel_render *r = ctx;
+    r->peak[task]            = synth_job_render(&r->jobs[task], r->first, r->count, r->out[task]);
+    (void) worker;
+}
+
+/**
+ * @brief Render a range of columns of every channel, each channel on its own worker
+ *
+ * @param c Context whose first n jobs are prepared with synth_job_setup() on the same width and samples per column
+ * @param n Number of channels
+ * @param first First column to render
+ * @param count Number of columns to render
+ * @param out Output of count * target samples of every channel
+ * @return Largest absolute sample of every rendered channel
+ */
+float render_channels(img2wav_ctx *c, int n, int first, int count, float *const *out) {
+    if (n == 1) return synth_job_render(&c->jobs[0], first, count, out[0]);
+
+    struct channel_render r = {c->jobs, first, count, out, {0.0f}};
+    pool_run(c->channels, n, NULL, channel_render_task, &r);
+
+    float peak = 0.0f;
+    for (int ch = 0; ch < n; ch++)
+        if (r.peak[ch] > peak) peak = r.peak[ch];
+
+    return peak;
+}
+
+/** Largest peak_bound() of the first n channels of a context, they are all normalized by the same factor */
+float channels_peak_bound(const img2wav_ctx *c, int n) {
+    float bound = 0.0f;
+    for (int ch = 0; ch < n; ch++) {
+        const float b = peak_bound(&c->jobs[ch].sparse);
+        if (b > bound) bound = b;
+    }
+
+    return bound;
+}
+
+/** aio_write_fn appending a block to the wav_writer user */
+size_t stream_append(void *user, float *const *data, size_t ns, float scale) {
+    return wav_writer_append_scaled(user, data, ns, scale);
+}
+
+/** Temporary file of the raw samples of the first PEAK_EXACT pass of a stream */
+struct stream_spill {
+    FILE *tmp;//!< Raw samples, every block channel after channel
+    int nc;   //!< Number of channels
+};
+
+/** aio_write_fn appending the raw samples of a block to a stream_spill, scale is applied on the second pass */
+size_t stream_spill_write(void *user, float *const *data, size_t ns, float scale) {
+    const struct stream_spill *sp = user;
+    for (int ch = 0; ch < sp->nc; ch++)
+        if (fwrite(data[ch], sizeof(**data), ns, sp->tmp) != ns) return 0;
+    (void) scale;
+
+    return ns;
+}
+
+/**
+ * @brief Write the channels of a context to a wav file a few columns at a time
+ *
+ * Only opts->ring columns of every channel are held in memory per block, so peak memory is O(column) instead of
+ * O(duration). Blocks are encoded and written by the writer of the context while the next ones are rendered,
+ * opts->io_depth of them are queued before rendering waits for the writer.
+ * The peak is applied by the quantizer while the samples are encoded. With PEAK_BOUND it is known
+ * before synthesis and the output is written in a single pass, with PEAK_EXACT the raw samples go
+ * to a temporary file first and are scaled on a second pass.
+ *
+ * @param c Context whose first n jobs are prepared with synth_job_setup() on the same width and samples per column
+ * @param n Number of channels
+ * @param opts Command line options
+ * @param output Output wav path
+ * @return Number of samples per channel written
+ */
+int stream_freqs(img2wav_ctx *c, int n, const struct options *opts, const char *output) {
+    const struct synth_job *job = &c->jobs[0];
+    const int size              = opts->time_s * opts->sample_rate;
+    const int width             = job->width;
+    wav_config cfg              = {.nc = n, .ns = size, .sr = opts->sample_rate, .bd = 24, .format = opts->container};
+    check_error(size <= 0, "Transmission time is too short", 0);
+    check_error(!img2wav_ctx_writer(c, opts->io_depth), "img2wav_ctx_writer()", 0);
+
+    const double start     = now();
+    const aio_stats before = aio_get_stats(c->io);
+    double synth           = 0.0;// rendering is interleaved with encoding, everything else is encode time
+
+    const int ring            = opts->ring > 0 ? opts->ring : 4 * pool_size(job->workers);
+    const int columns         = ring < width ? ring : width;
+    const size_t cap          = (size_t) columns * job->target;
+    FILE *tmp                 = (opts->peak == PEAK_EXACT) ? tmpfile() : NULL;
+    wav_writer *out           = output_open(opts, cfg, output);
+    struct stream_spill spill = {tmp, n};
+    int ok                    = out && (opts->peak != PEAK_EXACT || tmp);
+
+    // every block holds its own run of columns of every channel, the writer interleaves them
+    size_t rendered = 0;
+    if (ok && opts->peak == PEAK_BOUND) {
+        const float scale = peak_scale(channels_peak_bound(c, n));
+        ok                = aio_begin(c->io, n, cap, stream_append, out);
+        for (int x = 0; ok && x < width; x += columns) {
+            const int count      = (width - x < columns) ? width - x : columns;
+            const size_t m       = (size_t) count * job->target;
+            float *const *blocks = aio_acquire(c->io);
+            const double t       = now();
+            render_channels(c, n, x, count, blocks);
+            synth += now() - t;
+            aio_submit(c->io, m, scale);
+            rendered += m;
+        }
+    } else if (ok) {
+        // first pass keeps the raw samples in the temporary file while tracking the peak
+        float peak = 0.0f;
+        ok         = aio_begin(c->io, n, cap, stream_spill_write, &spill);
+        for (int x = 0; ok && x < width; x += columns) {
+            const int count      = (width - x < columns) ? width - x : columns;
+            const size_t m       = (size_t) count * job->target;
+            float *const *blocks = aio_acquire(c->io);
+            const double t       = now();
+            const float max      = render_channels(c, n, x, count, blocks);
+            synth += now() - t;
+            if (max > peak) peak = max;
+            aio_submit(c->io, m, 1.0f);
+            rendered += m;
+        }
+        ok = ok && aio_end(c->io) == rendered;
+
+        rewind(tmp);
+        const float scale = peak_scale(peak);
+        ok                = ok && aio_begin(c->io, n, cap, stream_append, out);
+        for (int x = 0; ok && x < width; x += columns) {
+            const int count      = (width - x < columns) ? width - x : columns;
+            const size_t m       = (size_t) count * job->target;
+            float *const *blocks = aio_acquire(c->io);
+            for (int ch = 0; ok && ch < n; ch++)
+                ok = fread(blocks[ch], sizeof(**blocks), m, tmp) == m;
+            if (ok) aio_submit(c->io, m, scale);
+        }
+    }
+
+    // samples after the last column are silent
+    for (size_t i = rendered; ok && i < (size_t) size;) {
+        const size_t m       = (size - i < cap) ? size - i : cap;
+        float *const *blocks = aio_acquire(c->io);
+        for (int ch = 0; ch < n; ch++)
+            memset(blocks[ch], 0, m * sizeof(**blocks));
+        aio_submit(c->io, m, 1.0f);
+        i += m;
+    }
+
+    // the writer must be done with out before it is closed, even after a failure
+    const size_t written = aio_end(c->io);
+    ok                   = ok && written == (size_t) size;
+    if (out) ok = wav_writer_close(out) == (size_t) size && ok;
+    if (tmp) fclose(tmp);
+
+    const aio_stats after = aio_get_stats(c->io);
+    c->stats.io_stall_s += after.stall_s - before.stall_s;
+    c->stats.io_write_s += after.write_s - before.write_s;
+    c->stats.seconds[STAGE_SYNTH] += synth;
+    c->stats.seconds[STAGE_ENCODE] += now() - start - synth;
+
+    return ok ? (int) written : 0;
+}
+
+#define PREVIEW_ROWS 64//!< Rows the first run of a --preview is downscaled to by default
+
+/**
+ * @brief Downscale the first columns of a plane for the first run of a preview
+ *
+ * Each group of rows becomes one pixel carrying the power of its active pixels, sqrt(sum p^2), so the coarse
+ * columns sound about as loud with a fraction of the oscillators. The whole plane is read once for its largest
+ * column amplitude sum, the peak_bound() of its sparse columns, before they are built.
+ *
+ * @param pixels Single channel pixels of depth bits
+ * @param width Width of the plane
+ * @param height Height of the plane
+ * @param audible Rows below the Nyquist frequency, the rows past them are left out like sparse_build() does
+ * @param column_major Pixels are stored column after column
+ * @param depth Bits per pixel, 8 or 16
+ * @param columns Number of first columns to downscale
+ * @param group Rows of the plane merged into one
+ * @param sums Scratch of width floats
+ * @param out Column major plane of width columns of (height + group - 1) / group rows, its other columns are left as they are
+ * @return Largest sum of amplitudes of any column of the plane
+ */
+float preview_plane(const void *pixels, int width, int height, int audible, int column_major, int depth, int columns, int group,
+                    float *sums, void *out) {
+    const uint8_t *p8   = pixels;
+    const uint16_t *p16 = pixels;
+    const int wide      = depth == 16;
+    const int threshold = wide ? PIXEL_THRESHOLD * 257 : PIXEL_THRESHOLD;
+    const float top     = wide ? 65535.0f : 255.0f;
+    const int rows      = (height + group - 1) / group;
+#define PREVIEW_PIXEL(x, y) (wide ? p16[column_major ? (size_t) (x) * height + (y) : (size_t) (y) * width + (x)] \
+                                  : p8[column_major ? (size_t) (x) * height + (y) : (size_t) (y) * width + (x)])
+
+    // summed in ascending rows of every column like peak_bound(), in memory order
+    memset(sums, 0, width * sizeof(*sums));
+    if (column_major) {
+        for (int x = 0; x < width; x++)
+            for (int y = 0; y < audible; y++)
+                if (PREVIEW_PIXEL(x, y) >= threshold) sums[x] += map(PREVIEW_PIXEL(x, y), 0.0f, top, 0.001f, 1.0f);
+    } else {
+        for (int y = 0; y < audible; y++)
+            for (int x = 0; x < width; x++)
+                if (PREVIEW_PIXEL(x, y) >= threshold) sums[x] += map(PREVIEW_PIXEL(x, y), 0.0f, top, 0.001f, 1.0f);
+    }
+    float bound = 0.0f;
+    for (int x = 0; x < width; x++)
+        if (sums[x] > bound) bound = sums[x];
+
+    for (int x = 0; x < columns; x++) {
+        for (int r = 0; r < rows; r++) {
+            float power = 0.0f;
+            for (int y = r * group; y < audible && y < (r + 1) * group; y++) {
+                const float v = PREVIEW_PIXEL(x, y);
+                if (v >= threshold) power += v * v;
+            }
+            const float v = sqrtf(power) < top ? sqrtf(power) + 0.5f : top;
+            if (wide)
+                ((uint16_t *) out)[(size_t) x * rows + r] = (uint16_t) v;
+            else
+                ((uint8_t *) out)[(size_t) x * rows + r] = (uint8_t) v;
+        }
+    }
+#undef PREVIEW_PIXEL
+
+    return bound;
+}
+
+/**
+ * @brief Receives the runs of samples of a preview
+ *
+ * @param user Pointer passed to preview_render()
+ * @param offset Index of the first sample of the run
+ * @param ns Number of samples per channel of the run
+ * @param samples Samples of every channel
+ * @param scale Factor bringing the samples into [-1.0, 1.0], the same for every run
+ * @param refined 0 for the downscaled first run, 1 for full quality samples
+ * @return 1 to go on, 0 to stop the preview
+ */
+typedef int (*preview_sink)(void *user, size_t offset, size_t ns, float *const *samples, float scale, int refined);
+
+/**
+ * @brief Render an image for playback while it is being synthesized
+ *
+ * The first run of opts->ring columns is rendered from planes downscaled to opts->preview_rows rows, with
+ * a fraction of the oscillators, and handed to sink as soon as it is done. The other runs follow in order
+ * at full quality, the look-ahead is a single run. Last, the first run comes again at full quality, so a
+ * player still ahead of it or a file can swap it in. Every run is normalized by the peak bound of the
+ * full image, so they all match.
+ *
+ * @param c Context whose first n jobs are started
+ * @param n Number of channels
+ * @param opts Command line options
+ * @param planes Pixels of every channel
+ * @param width Width of every channel
+ * @param height Height of the image
+ * @param cfg Synthesis engine configuration
+ * @param sink Function receiving the runs
+ * @param user Pointer passed to sink
+ * @param begin now() when the conversion started, the time until the first run is handed to sink is kept in c->stats
+ * @return 1 on success, 0 on failure or if sink stopped the preview
+ */
+int preview_render(img2wav_ctx *c, int n, const struct options *opts, const void *const *planes, int width, int height,
+                   synth_config cfg, preview_sink sink, void *user, double begin) {
+    const int rows_max = opts->preview_rows > 0 ? opts->preview_rows : PREVIEW_ROWS;
+    const int group    = (height + rows_max - 1) / rows_max;
+    const int rows     = (height + group - 1) / group;
+    const int ring     = opts->ring > 0 ? opts->ring : 4 * pool_size(c->jobs[0].workers);
+    const int first    = ring < width ? ring : width;
+    const size_t bytes = cfg.depth / 8;
+    const int audible  = row_freqs(&cfg, opts->sample_rate, height, NULL);
+
+    double start = now();
+    float bound  = 0.0f;
+    const void *coarse[CHANNELS_MAX];
+    if (group > 1) {
+        float *sums = arena_alloc(c->arena, width * sizeof(*sums));
+        check_error(!sums, "arena_alloc(): Failed to allocate column sums", 0);
+        for (int ch = 0; ch < n; ch++) {
+            void *plane = arena_alloc(c->arena, (size_t) width * rows * bytes);
+            check_error(!plane, "arena_alloc(): Failed to allocate preview plane", 0);
+            memset(plane, 0, (size_t) width * rows * bytes);
+            const float b = preview_plane(planes[ch], width, height, audible, cfg.column_major, cfg.depth, first, group, sums, plane);
+            if (b > bound) bound = b;
+            coarse[ch] = plane;
+        }
+    }
+
+    // the downscaled planes are column major whatever the layout of the image
+    synth_config small = cfg;
+    small.column_major = 1;
+    int ok             = 1;
+    for (int ch = 0; ok && ch < n; ch++) {
+        if (group > 1)
+            ok = synth_job_setup(&c->jobs[ch], coarse[ch], opts->sample_rate, opts->time_s, width, rows, small);
+        else
+            ok = synth_job_setup(&c->jobs[ch], planes[ch], opts->sample_rate, opts->time_s, width, height, cfg);
+    }
+    if (ok && group == 1) bound = channels_peak_bound(c, n);
+    stats_add(&c->stats, STAGE_SETUP, start);
+    check_error(!ok, "synth_job_setup()", 0);
+
+    const size_t target = c->jobs[0].target;
+    float *block        = arena_alloc(c->arena, (size_t) first * target * n * sizeof(*block));
+    check_error(!block, "arena_alloc(): Failed to allocate preview block", 0);
+    float *blocks[CHANNELS_MAX];
+    for (int ch = 0; ch < n; ch++)
+        blocks[ch] = block + ch * first * target;
+
+    const float scale = peak_scale(bound);
+    for (int x = 0; ok && x < width; x += first) {
+        const int count = (width - x < first) ? width - x : first;
+        if (x == first && group > 1) {
+            start = now();
+            for (int ch = 0; ok && ch < n; ch++)
+                ok = synth_job_setup(&c->jobs[ch], planes[ch], opts->sample_rate, opts->time_s, width, height, cfg);
+            stats_add(&c->stats, STAGE_SETUP, start);
+            if (!ok) break;
+        }
+
+        start = now();
+        render_channels(c, n, x, count, blocks);
+        stats_add(&c->stats, STAGE_SYNTH, start);
+
+        start = now();
+        ok    = sink(user, x * target, count * target, blocks, scale, x > 0 || group == 1);
+        stats_add(&c->stats, STAGE_ENCODE, start);
+        const double latency = now() - begin;
+        if (x == 0 && latency > c->stats.first_sample_s) c->stats.first_sample_s = latency;
+    }
+
+    if (ok && group > 1) {
+        // a single run image never set up its full columns in the loop
+        for (int ch = 0; ok && width == first && ch < n; ch++)
+            ok = synth_job_setup(&c->jobs[ch], planes[ch], opts->sample_rate, opts->time_s, width, height, cfg);
+
+        start = now();
+        if (ok) render_channels(c, n, 0, first, blocks);
+        stats_add(&c->stats, STAGE_SYNTH, start);
+
+        start = now();
+        ok    = ok && sink(user, 0, first * target, blocks, scale, 1);
+        stats_add(&c->stats, STAGE_ENCODE, start);
+    }
+
+    return ok;
+}
+
+/** Wav file a preview is written to by preview_write() */
+struct preview_output {
+    wav_writer *out; //!< Writer of the runs in order, NULL once the file is finished
+    const char *path;//!< Output wav path, "-" for stdout
+    size_t size;     //!< Samples per channel of the wav file
+    size_t written;  //!< Samples per channel appended so far
+};
+
+/** Append the silence after the last column and close the writer of a preview, 1 on success */
+int preview_finish(struct preview_output *p) {
+    if (!p->out) return 1;
+
+    float zeros[1024] = {0.0f};
+    float *silence[CHANNELS_MAX];
+    for (int ch = 0; ch < CHANNELS_MAX; ch++)
+        silence[ch] = zeros;
+
+    int ok = 1;
+    while (ok && p->written < p->size) {
+        const size_t m = (p->size - p->written < 1024) ? p->size - p->written : 1024;
+        ok             = wav_writer_append(p->out, silence, m) == m;
+        p->written += m;
+    }
+    ok     = wav_writer_close(p->out) == p->size && ok;
+    p->out = NULL;
+
+    return ok;
+}
+
+/** preview_sink appending every run to a wav file, the refined first run is written over the downscaled one once the file is finished */
+int preview_write(void *user, size_t offset, size_t ns, float *const *samples, float scale, int refined) {
+    struct preview_output *p = user;
+    (void) refined;
+
+    if (offset >= p->written) {
+        p->written += wav_writer_append_scaled(p->out, samples, ns, scale);
+
+        // a player reading the file or pipe gets every run as soon as it is synthesized
+        return p->written == offset + ns && wav_writer_flush(p->out);
+    }
+
+    // stdout played the first run already
+    if (!preview_finish(p)) return 0;
+    if (strcmp(p->path, "-") == 0) return 1;
+
+    wav_config cfg;
+    return wav_get_header(&cfg, p->path) && wav_write_range(cfg, p->path, offset, ns, samples, scale) == ns;
+}
+
+/**
+ * @brief Write a preview of an image to a wav file
+ *
+ * @see preview_render()
+ * @param output Output wav path, "-" writes to stdout
+ * @return Number of samples per channel written, 0 on failure
+ */
+int preview_file(img2wav_ctx *c, int n, const struct options *opts, const char *output, const void *const *planes,
+                 int width, int height, synth_config cfg, double begin) {
+    const int size          = opts->time_s * opts->sample_rate;
+    wav_config wc           = {.nc = n, .ns = size, .sr = opts->sample_rate, .bd = 24, .format = opts->container};
+    struct preview_output p = {output_open(opts, wc, output), output, size, 0};
+    check_error(!p.out, "output_open()", 0);
+
+    int ok = preview_render(c, n, opts, planes, width, height, cfg, preview_write, &p, begin);
+    ok     = preview_finish(&p) && ok;
+
+    return ok ? size : 0;
+}
+
+/**
+ * @brief Bytes of the arena of one conversion
+ *
+ * Covers the decoded image, about as much again for stb_image's inflated or dequantized rows,
+ * the encoded file for formats it buffers, the single channel planes and the buffered signal.
+ *
+ * @param length Size of the encoded image in bytes
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param channels Channels stb_image decodes
+ * @param depth Bits per decoded channel, 8 or 16
+ * @param planes Single channel planes kept, 3 for CHANNELS_RGB and 2 for CHANNELS_TILES which may pad a copy
+ * @param samples Samples of the buffered signal of every channel, 0 with --stream
+ * @return Bytes to reserve
+ */
+size_t convert_arena_size(size_t length, int width, int height, int channels, int depth, int planes, size_t samples) {
+    const size_t plane = (size_t) width * height * (depth / 8);
+
+    return 2 * (plane * channels + height) + length + plane * planes + samples * sizeof(float);
+}
+
+/**
+ * @brief Pixels of every channel of an image
+ *
+ * The planes of CHANNELS_RGB follow each other. Tiles are runs of whole columns of a column major plane,
+ * all of them as wide so the columns of every channel line up. When the width isn't a multiple of the
+ * number of tiles the plane is copied and padded with dark columns, so the last tile ends in silence.
+ *
+ * @param a Arena of the padded copy
+ * @param mode How the channels are taken from the image
+ * @param pixels Pixels of get_pixels() or get_pixels_16(), decoded with dc->rgb for CHANNELS_RGB
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param bytes Bytes per pixel
+ * @param n Number of channels
+ * @param planes Pointer to store the pixels of every channel
+ * @return Width of every channel, 0 on failure
+ */
+int channel_planes(arena *a, enum channel_mode mode, const void *pixels, int width, int height, size_t bytes, int n, const void **planes) {
+    const size_t column = (size_t) height * bytes;
+    const int tile      = (mode == CHANNELS_TILES) ? (width + n - 1) / n : width;
+
+    const uint8_t *p = pixels;
+    if (mode == CHANNELS_TILES && tile * n != width) {
+        uint8_t *padded = arena_alloc(a, column * tile * n);
+        check_error(!padded, "arena_alloc(): Failed to allocate padded tiles", 0);
+        memcpy(padded, pixels, column * width);
+        memset(padded + column * width, 0, column * (tile * n - width));
+        p = padded;
+    }
+    for (int ch = 0; ch < n; ch++)
+        planes[ch] = p + column * tile * ch;
+
+    return tile;
+}
+
+void stats_print(FILE *file, img2wav_ctx *const *ctx, int n, double wall) {
+    struct stats st = {.seconds = {0.0}};
+    size_t arena_bytes = 0, arena_mallocs = 0;
+    for (int i = 0; i < n; i++) {
+        const struct stats *c = &ctx[i]->stats;
+        if (ctx[i]->arena) arena_bytes += arena_capacity(ctx[i]->arena), arena_mallocs += arena_blocks(ctx[i]->arena);
+        for (int k = 0; k < STAGE_COUNT; k++)
+            st.seconds[k] += c->seconds[k];
+        st.images += c->images;
+        st.pixels += c->pixels;
+        st.active += c->active;
+        st.oscillator_samples += c->oscillator_samples;
+        st.samples += c->samples;
+        st.bytes += c->bytes;
+        st.reused_columns += c->reused_columns;
+        if (c->first_sample_s > st.first_sample_s) st.first_sample_s = c->first_sample_s;
+        st.io_stall_s += c->io_stall_s;
+        st.io_write_s += c->io_write_s;
+    }
+
+    fprintf(file, "{\n  \"wall_s\": %.6f,\n  \"stages_s\": {", wall);
+    for (int k = 0; k < STAGE_COUNT; k++)
+        fprintf(file, "%s\"%s\": %.6f", k ? ", " : "", stats_stage_names[k], st.seconds[k]);
+    fprintf(file, "},\n");
+    fprintf(file, "  \"images\": %llu,\n", (unsigned long long) st.images);
+    fprintf(file, "  \"pixels\": %llu,\n", (unsigned long long) st.pixels);
+    fprintf(file, "  \"active_pixels\": %llu,\n", (unsigned long long) st.active);
+    fprintf(file, "  \"skipped_pixels\": %llu,\n", (unsigned long long) (st.pixels - st.active));
+    fprintf(file, "  \"oscillator_samples\": %llu,\n", (unsigned long long) st.oscillator_samples);
+    fprintf(file, "  \"samples_written\": %llu,\n", (unsigned long long) st.samples);
+    fprintf(file, "  \"bytes_written\": %llu,\n", (unsigned long long) st.bytes);
+    fprintf(file, "  \"reused_columns\": %llu,\n", (unsigned long long) st.reused_columns);
+    fprintf(file, "  \"first_sample_s\": %.6f,\n", st.first_sample_s);
+    fprintf(file, "  \"io_stall_s\": %.6f,\n", st.io_stall_s);
+    fprintf(file, "  \"io_write_s\": %.6f,\n", st.io_write_s);
+    fprintf(file, "  \"arena_bytes\": %llu,\n", (unsigned long long) arena_bytes);
+    fprintf(file, "  \"arena_blocks\": %llu,\n", (unsigned long long) arena_mallocs);
+    if (n > 0 && ctx[0]->cache) {
+        const cache_stats cs = cache_get_stats(ctx[0]->cache);
+        fprintf(file, "  \"cache\": {\"hits\": %llu, \"misses\": %llu, \"evictions\": %llu, \"entries\": %llu, \"bytes\": %llu},\n",
+                (unsigned long long) cs.hits, (unsigned long long) cs.misses, (unsigned long long) cs.evictions,
+                (unsigned long long) cs.entries, (unsigned long long) cs.bytes);
+    }
+    fprintf(file, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+    fprintf(file, "  \"threads\": [");
+    for (int i = 0, first = 1; i < n; i++) {
+        for (int ch = 0; ch < ctx[i]->njobs; ch++) {
+            const struct synth_job *job = &ctx[i]->jobs[ch];
+            for (int w = 0; job->workers && job->state && w < pool_size(job->workers); w++, first = 0) {
+                const struct synth_worker *t = &job->state[w];
+                fprintf(file, "%s\n    {\"converter\": %d, \"channel\": %d, \"worker\": %d, \"columns\": %llu, \"active_pixels\": %llu, \"busy_s\": %.6f}",
+                        first ? "" : ",", i, ch, w, (unsigned long long) t->columns, (unsigned long long) t->active, t->seconds);
+            }
+        }
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+#define CONVERT_CACHE_VERSION 3//!< Part of every cache key, bumped whenever the same options start writing other samples
+
+/**
+ * @brief Key of the wav file of an image in the cache
+ *
+ * Hashes the decoded pixels and every option that changes the samples, options that only change
+ * how fast they are rendered like --threads, --stream or --ring are left out. The osc kernel and the
+ * fft size are only hashed for the engine they belong to.
+ *
+ * @param opts Command line options
+ * @param cfg Synthesis engine configuration of the image
+ * @param pixels Pixels of get_pixels() or get_pixels_16()
+ * @param bytes Size of pixels in bytes
+ * @param width Width of the image
+ * @param height Height of the image
+ * @return Cache key
+ */
+uint64_t convert_cache_key(const struct options *opts, const synth_config *cfg, const void *pixels, size_t bytes, int width, int height) {
+    // only 4 byte fields, so the struct has no padding that could differ between two identical conversions
+    struct {
+        int32_t version, width, height, depth, column_major, threshold, bit_depth;
+        int32_t engine, fft_size, table_size, interp, phase, peak, channels, tiles, container, mapping;
+        float sample_rate, time_s, min_freq, max_freq, crossfade;
+    } params;
+    memset(&params, 0, sizeof(params));
+    params.version      = CONVERT_CACHE_VERSION;
+    params.width        = width;
+    params.height       = height;
+    params.depth        = cfg->depth;
+    params.column_major = cfg->column_major;
+    params.threshold    = PIXEL_THRESHOLD;
+    params.bit_depth    = 24;
+    params.engine       = cfg->engine;
+    params.fft_size     = cfg->engine == SYNTH_FFT ? cfg->fft_size : 0;
+    params.table_size   = cfg->table_size;
+    params.interp       = cfg->interp;
+    params.phase        = cfg->phase;
+    params.peak         = opts->peak;
+    params.channels     = opts->channels;
+    params.tiles        = opts->channels == CHANNELS_TILES ? opts->tiles : 0;
+    params.container    = opts->container;
+    params.mapping      = cfg->mapping;
+    params.sample_rate  = opts->sample_rate;
+    params.time_s       = opts->time_s;
+    params.min_freq     = cfg->min_freq;
+    params.max_freq     = cfg->max_freq;
+    params.crossfade    = cfg->crossfade;
+
+    cache_hash h;
+    cache_hash_init(&h, 0);
+    cache_hash_update(&h, pixels, bytes);
+    cache_hash_update(&h, &params, sizeof(params));
+    // the osc kernels differ in their last bits, "auto" hashes the kernel it picks on this CPU
+    const char *kernel = cfg->engine == SYNTH_OSC ? osc_kernel_name(cfg->simd ? cfg->simd : "auto") : NULL;
+    if (kernel) cache_hash_update(&h, kernel, strlen(kernel));
+
+    return cache_hash_digest(&h);
+}
+
+uint64_t convert_options_key(const struct options *opts, int width, int height) {
+    synth_config cfg = opts->synth;
+    cfg.column_major = opts->decode.column_major;
+
+    return convert_cache_key(opts, &cfg, NULL, 0, width, height);
+}
+
+#define COLUMN_INDEX_VERSION 1//!< Version of the files written by column_index_write()
+
+/** Hash and peak of every column of a wav file rendered with --incremental, kept next to it as out.wav.cols */
+struct column_index {
+    uint64_t key;   //!< convert_cache_key() of the options without the pixels
+    int32_t columns;//!< Columns of every channel
+    int32_t target; //!< Samples per column
+    float peak;     //!< Peak the samples were normalized by
+    uint64_t *hash; //!< Hash of the pixels of every channel of every column
+    float *max;     //!< Largest absolute sample of every channel of every column before normalization
+};
+
+/** Bytes of the arena taken by render_incremental() for an image of width columns, height rows and depth bits per pixel */
+size_t column_index_size(int width, int height, int depth) {
+    return 2 * (size_t) width * (sizeof(uint64_t) + sizeof(float)) + width + (size_t) height * (depth / 8) + 8 * 64;
+}
+
+/** Allocate the hashes and peaks of an index of columns columns */
+int column_index_alloc(struct column_index *ix, arena *a, int columns) {
+    ix->columns = columns;
+    ix->hash    = arena_alloc(a, columns * sizeof(*ix->hash));
+    ix->max     = arena_alloc(a, columns * sizeof(*ix->max));
+    check_error(!ix->hash || !ix->max, "arena_alloc(): Failed to allocate column index", 0);
+
+    return 1;
+}
+
+/**
+ * @brief Hash the pixels of every column of every channel
+ *
+ * @param ix Index whose hashes are computed
+ * @param planes Pixels of every channel, ix->columns wide
+ * @param n Number of channels
+ * @param height Height of the image
+ * @param bytes Bytes per pixel
+ * @param column_major The pixels are stored column after column
+ * @param scratch Buffer of height * bytes the columns of row major planes are gathered into
+ */
+void column_index_hash(struct column_index *ix, const void *const *planes, int n, int height, size_t bytes, int column_major, uint8_t *scratch) {
+    const size_t column = (size_t) height * bytes;
+    for (int x = 0; x < ix->columns; x++) {
+        cache_hash h;
+        cache_hash_init(&h, 0);
+        for (int ch = 0; ch < n; ch++) {
+            const uint8_t *p = planes[ch];
+            if (column_major) {
+                cache_hash_update(&h, p + column * x, column);
+                continue;
+            }
+            for (int y = 0; y < height; y++)
+                memcpy(scratch + y * bytes, p + ((size_t) y * ix->columns + x) * bytes, bytes);
+            cache_hash_update(&h, scratch, column);
+        }
+        ix->hash[x] = cache_hash_digest(&h);
+    }
+}
+
+/**
+ * @brief Read the index of the last render of a wav file
+ *
+ * @param ix Index to fill, its arrays are allocated from a
+ * @param a Arena of the arrays
+ * @param path Path of the index
+ * @param columns Columns of the image about to be rendered, an index of another width is rejected
+ * @return 1 on success, 0 if there is no index or it doesn't match
+ */
+int column_index_read(struct column_index *ix, arena *a, const char *path, int columns) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;// nothing was rendered with --incremental yet
+
+    char magic[4];
+    uint32_t version = 0;
+    int ok           = fread(magic, 1, 4, file) == 4 && memcmp(magic, "I2WC", 4) == 0;
+    ok               = ok && fread(&version, sizeof(version), 1, file) == 1 && version == COLUMN_INDEX_VERSION;
+    ok               = ok && fread(&ix->key, sizeof(ix->key), 1, file) == 1;
+    ok               = ok && fread(&ix->columns, sizeof(ix->columns), 1, file) == 1 && ix->columns == columns;
+    ok               = ok && fread(&ix->target, sizeof(ix->target), 1, file) == 1;
+    ok               = ok && fread(&ix->peak, sizeof(ix->peak), 1, file) == 1;
+    ok               = ok && column_index_alloc(ix, a, columns);
+    ok               = ok && fread(ix->hash, sizeof(*ix->hash), columns, file) == (size_t) columns;
+    ok               = ok && fread(ix->max, sizeof(*ix->max), columns, file) == (size_t) columns;
+    fclose(file);
+
+    return ok;
+}
+
+/** Write the index of a wav file, 1 on success, 0 on failure */
+int column_index_write(const struct column_index *ix, const char *path) {
+    FILE *file = fopen(path, "wb");
+    check_error(!file, "fopen(): Failed to open column index", 0);
+
+    const uint32_t version = COLUMN_INDEX_VERSION;
+    const size_t columns   = ix->columns;
+    int ok                 = fwrite("I2WC", 1, 4, file) == 4 && fwrite(&version, sizeof(version), 1, file) == 1;
+    ok                     = ok && fwrite(&ix->key, sizeof(ix->key), 1, file) == 1;
+    ok                     = ok && fwrite(&ix->columns, sizeof(ix->columns), 1, file) == 1;
+    ok                     = ok && fwrite(&ix->target, sizeof(ix->target), 1, file) == 1;
+    ok                     = ok && fwrite(&ix->peak, sizeof(ix->peak), 1, file) == 1;
+    ok                     = ok && fwrite(ix->hash, sizeof(*ix->hash), columns, file) == columns;
+    ok                     = ok && fwrite(ix->max, sizeof(*ix->max), columns, file) == columns;
+    ok                     = (fclose(file) == 0) && ok;
+    if (!ok) remove(path);
+    check_error(!ok, "fwrite(): Failed to write column index", 0);
+
+    return 1;
+}
+
+/** Length of the next run of columns flagged value, *first is moved to its start, 0 once there are none left */
+int column_run(const uint8_t *flags, int columns, uint8_t value, int *first) {
+    int x = *first;
+    while (x < columns && flags[x] != value) x++;
+    int end = x;
+    while (end < columns && flags[end] == value) end++;
+    *first = x;
+
+    return end - x;
+}
+
+/**
+ * @brief Render an image with --incremental, synthesizing only the columns that changed since the last render of output
+ *
+ * The index next to output holds the hash and the peak of every column of the last render. When it was
+ * written with the same options, only the columns whose pixels changed and the columns their samples
+ * reach are rendered and written in place. If the normalization changes with them, the columns kept are
+ * read back and written again at the new scale, which rounds them once more but skips their synthesis.
+ * Without a matching index the whole image is rendered and a new index is written.
+ *
+ * @param c Context whose first n jobs are prepared with synth_job_setup() on the same width and samples per column
+ * @param n Number of channels
+ * @param opts Command line options
+ * @param output Output wav path
+ * @param key convert_cache_key() of the options without the pixels
+ * @param planes Pixels of every channel
+ * @param height Height of the image
+ * @param bytes Bytes per pixel
+ * @param column_major The pixels are stored column after column
+ * @param signal Buffer of every channel, opts->time_s * opts->sample_rate samples each
+ * @return Number of samples per channel of the wav file, 0 on failure
+ */
+int render_incremental(img2wav_ctx *c, int n, const struct options *opts, const char *output, uint64_t key,
+                       const void *const *planes, int height, size_t bytes, int column_major, float *const *signal) {
+    const struct synth_job *job = &c->jobs[0];
+    const int size              = opts->time_s * opts->sample_rate;
+    const int columns           = job->width;
+    const size_t target         = job->target;
+    char *path                  = arena_alloc(c->arena, strlen(output) + sizeof(".cols"));
+    uint8_t *dirty              = arena_alloc(c->arena, columns);
+    uint8_t *scratch            = arena_alloc(c->arena, (size_t) height * bytes);
+    check_error(!path || !dirty || !scratch, "arena_alloc(): Failed to allocate incremental buffers", 0);
+    sprintf(path, "%s.cols", output);
+
+    double start             = now();
+    struct column_index prev = {0}, next = {key, columns, job->target, 0.0f, NULL, NULL};
+    check_error(!column_index_alloc(&next, c->arena, columns), "column_index_alloc()", 0);
+    column_index_hash(&next, planes, n, height, bytes, column_major, scratch);
+
+    // the last render is only patched when it had the same options and its wav file is still there in full
+    wav_config hdr = {0};
+    uint64_t length;
+    int patch = column_index_read(&prev, c->arena, path, columns) && prev.key == key && prev.target == job->target;
+    patch     = patch && wav_file_size(output, &length) && wav_get_header(&hdr, output);
+    patch     = patch && hdr.nc == n && hdr.ns == (uint64_t) size && hdr.bd == 24 && length >= hdr.offset + hdr.ns * n * 3;
+
+    int before, after;
+    synth_job_reach(job, &before, &after);
+    memset(dirty, !patch, columns);
+    for (int x = 0; patch && x < columns; x++) {
+        if (next.hash[x] == prev.hash[x]) continue;
+        const int lo = (x - before < 0) ? 0 : x - before;
+        const int hi = (x + after >= columns) ? columns - 1 : x + after;
+        memset(dirty + lo, 1, hi - lo + 1);
+    }
+    if (patch) memcpy(next.max, prev.max, columns * sizeof(*next.max));
+    stats_add(&c->stats, STAGE_CACHE, start);
+
+    // runs of changed columns are rendered at their place in the signal, the column peaks are kept for the next render
+    start        = now();
+    int rendered = 0;
+    for (int x = 0, len; (len = column_run(dirty, columns, 1, &x)) > 0; x += len) {
+        float *run[CHANNELS_MAX];
+        for (int ch = 0; ch < n; ch++)
+            run[ch] = signal[ch] + x * target;
+        render_channels(c, n, x, len, run);
+
+        for (int i = x; i < x + len; i++) {
+            next.max[i] = 0.0f;
+            for (int ch = 0; ch < n; ch++) {
+                const float max = find_max(signal[ch] + i * target, target);
+                if (max > next.max[i]) next.max[i] = max;
+            }
+        }
+        rendered += len;
+    }
+    stats_add(&c->stats, STAGE_SYNTH, start);
+
+    float peak = 0.0f;
+    if (opts->peak == PEAK_BOUND) {
+        peak = channels_peak_bound(c, n);
+    } else {
+        for (int x = 0; x < columns; x++)
+            if (next.max[x] > peak) peak = next.max[x];
+    }
+    next.peak         = peak;
+    const float scale = peak_scale(peak);
+
+    // a failure halfway through leaves no index behind, so the next run renders everything again
+    start = now();
+    remove(path);
+    int written = 0;
+    if (!patch) {
+        for (int ch = 0; ch < n; ch++)
+            memset(signal[ch] + columns * target, 0, (size - columns * target) * sizeof(**signal));
+
+        wav_config cfg  = {.nc = n, .ns = size, .sr = opts->sample_rate, .bd = 24, .format = opts->container};
+        wav_writer *out = output_open(opts, cfg, output);
+        if (out) {
+            const int ok = wav_writer_append_scaled(out, signal, size, scale) == (size_t) size;
+            written      = (wav_writer_close(out) == (size_t) size && ok) ? size : 0;
+        }
+    } else {
+        // a new peak changes the scale of every sample, the columns kept are read back and brought to it
+        const float old = peak_scale(prev.peak);
+        const int all   = scale != old;
+        int ok          = 1;
+        for (int x = 0, len; all && ok && (len = column_run(dirty, columns, 0, &x)) > 0; x += len) {
+            float *run[CHANNELS_MAX];
+            for (int ch = 0; ch < n; ch++)
+                run[ch] = signal[ch] + x * target;
+            ok = wav_read_range(hdr, output, x * target, len * target, run) == len * target;
+            for (int ch = 0; ok && ch < n; ch++)
+                for (size_t t = 0; t < len * target; t++)
+                    run[ch][t] /= old;
+        }
+        if (all) {
+            ok = ok && wav_write_range(hdr, output, 0, columns * target, signal, scale) == columns * target;
+        } else {
+            for (int x = 0, len; ok && (len = column_run(dirty, columns, 1, &x)) > 0; x += len) {
+                float *run[CHANNELS_MAX];
+                for (int ch = 0; ch < n; ch++)
+                    run[ch] = signal[ch] + x * target;
+                ok = wav_write_range(hdr, output, x * target, len * target, run, scale) == len * target;
+            }
+        }
+        written = ok ? size : 0;
+    }
+    if (written > 0) column_index_write(&next, path);
+    stats_add(&c->stats, STAGE_ENCODE, start);
+
+    c->stats.reused_columns += columns - rendered;
+
+    return written;
+}
+
+int convert_source(img2wav_ctx *c, const struct options *opts, struct image_source *src, const char *output, double begin) {
+    const int size     = opts->time_s * opts->sample_rate;
+    const int n        = output_channels(opts);
+    const int buffered = !opts->stream && !opts->preview;
+    int ok             = size > 0 && img2wav_ctx_channels(c, n);
+    if (!ok) source_close(src);
+    check_error(size <= 0, "Transmission time is too short", 0);
+    check_error(!ok, "img2wav_ctx_channels()", 0);
+
+    struct decode_config dc = opts->decode;
+    dc.stats                = &c->stats;
+    dc.arena                = c->arena;
+    dc.rgb                  = opts->channels == CHANNELS_RGB;
+    // tiles are runs of whole columns, contiguous once the pixels are stored column after column
+    if (opts->channels == CHANNELS_TILES) dc.column_major = 1;
+
+    synth_config cfg = opts->synth;
+    cfg.column_major = dc.column_major;
+
+    // everything the previous image allocated is gone, the memory is kept
+    arena_reset(c->arena);
+
+    // size the arena once for the whole conversion, unknown formats are reported by the decoder
+    int width, height, channels;
+    if (source_info(src, &width, &height, &channels)) {
+        channels           = dc.rgb ? 3 : (dc.gray || channels < 3) ? 1 : 3;
+        const int planes   = dc.rgb ? 3 : (n > 1) ? 2 : 1;
+        size_t bytes       = convert_arena_size(src->length, width, height, channels, cfg.depth, planes, buffered ? (size_t) size * n : 0);
+        if (opts->incremental) bytes += column_index_size(width, height, cfg.depth);
+        ok                 = arena_reserve(c->arena, bytes);
+        if (!ok) fprintf(stderr, "arena_reserve(): Failed to allocate %zu bytes\n", bytes);
+    }
+
+    float *samples = (ok && buffered) ? arena_alloc(c->arena, (size_t) size * n * sizeof(*samples)) : NULL;
+    ok             = ok && (!buffered || samples);
+
+    void *pixels = NULL;
+    if (ok && cfg.depth == 16)
+        pixels = get_pixels_16_from_memory(src->data, src->length, &width, &height, &dc);
+    else if (ok)
+        pixels = get_pixels_from_memory(src->data, src->length, &width, &height, &dc);
+    source_close(src);
+    check_error(!pixels, "get_pixels()", 0);
+
+    const void *planes[CHANNELS_MAX];
+    const int columns = channel_planes(c->arena, opts->channels, pixels, width, height, cfg.depth / 8, n, planes);
+    check_error(columns == 0, "channel_planes()", 0);
+    // every mode rejects an image wider than the number of samples, a column needs at least one
+    check_error((int) ((opts->sample_rate * opts->time_s) / columns) <= 0, "Transmission time is too short for the image width", 0);
+
+    // on a miss the wav file is rendered to a temporary file of the cache, copied to the output and kept
+    char temp[CACHE_PATH_MAX];
+    uint64_t key       = 0;
+    const char *target = output;
+    double start;
+    if (c->cache) {
+        start     = now();
+        key       = convert_cache_key(opts, &cfg, pixels, (size_t) width * height * (cfg.depth / 8) * (dc.rgb ? 3 : 1), width, height);
+        FILE *hit = cache_get(c->cache, key);
+        if (hit) {
+            const int copied = output_copy(opts, hit, output);
+            fclose(hit);
+            stats_add(&c->stats, STAGE_CACHE, start);
+            check_error(!copied, "output_copy(): Failed to copy the cached wav file", 0);
+
+            c->stats.images++;
+            c->stats.pixels += (uint64_t) columns * height * n;
+            c->stats.samples += (uint64_t) size * n;
+            c->stats.bytes += (uint64_t) size * n * 3;
+
+            return size;
+        }
+        if (cache_temp(c->cache, key, temp, sizeof(temp))) target = temp;
+        stats_add(&c->stats, STAGE_CACHE, start);
+    }
+
+    start     = now();
+    int ready = 1;
+    for (int ch = 0; ready && !opts->preview && ch < n; ch++)
+        ready = synth_job_setup(&c->jobs[ch], planes[ch], opts->sample_rate, opts->time_s, columns, height, cfg);
+    stats_add(&c->stats, STAGE_SETUP, start);
+
+    float *signal[CHANNELS_MAX];
+    for (int ch = 0; samples && ch < n; ch++)
+        signal[ch] = samples + (size_t) ch * size;
+
+    int written = 0;
+    if (opts->preview) {
+        written = preview_file(c, n, opts, output, planes, columns, height, cfg, begin);
+    } else if (opts->stream) {
+        if (ready) written = stream_freqs(c, n, opts, target);
+    } else if (opts->incremental && ready) {
+        key     = convert_cache_key(opts, &cfg, NULL, 0, width, height);
+        written = render_incremental(c, n, opts, output, key, planes, height, cfg.depth / 8, cfg.column_major, signal);
+    } else if (ready) {
+        start = now();
+        memset(samples, 0, (size_t) size * n * sizeof(*samples));
+        const float max = render_channels(c, n, 0, columns, signal);
+        stats_add(&c->stats, STAGE_SYNTH, start);
+
+        /* Wav files expect amplitudes between [-1.0, 1.0], the quantizer applies the scale */
+        const float peak = opts->peak == PEAK_BOUND ? channels_peak_bound(c, n) : max;
+
+        start           = now();
+        wav_config cfg  = {.nc = n, .ns = size, .sr = opts->sample_rate, .bd = 24, .format = opts->container};
+        wav_writer *out = output_open(opts, cfg, target);
+        if (out) {
+            const int ok = wav_writer_append_scaled(out, signal, size, peak_scale(peak)) == (size_t) size;
+            written      = (wav_writer_close(out) == (size_t) size && ok) ? size : 0;
+        }
+        stats_add(&c->stats, STAGE_ENCODE, start);
+    }
+
+    if (target != output) {
+        start    = now();
+        FILE *in = written > 0 ? fopen(temp, "rb") : NULL;
+        if (!in || !output_copy(opts, in, output)) written = 0;
+        if (in) fclose(in);
+        if (written > 0)
+            cache_put(c->cache, key, temp);
+        else
+            remove(temp);
+        stats_add(&c->stats, STAGE_CACHE, start);
+    }
+
+    if (written > 0) {
+        uint64_t active = 0;
+        for (int ch = 0; ready && ch < n; ch++)
+            active += c->jobs[ch].sparse.start[columns];
+        c->stats.images++;
+        c->stats.pixels += (uint64_t) columns * height * n;
+        c->stats.active += active;
+        c->stats.oscillator_samples += active * (ready ? c->jobs[0].target : 0);
+        c->stats.samples += (uint64_t) written * n;
+        c->stats.bytes += (uint64_t) written * n * 3;// 24 bit samples
+    }
+
+    return written;
+}
+
+int convert(img2wav_ctx *c, const struct options *opts, const char *input, const char *output) {
+    const double begin = now();
+
+    struct image_source src;
+    const double start = now();
+    const int ok       = source_open(&src, input);
+    stats_add(&c->stats, STAGE_READ, start);
+    if (!ok) source_close(&src);
+    check_error(!ok, "source_open()", 0);
+
+    return convert_source(c, opts, &src, output, begin);
+}
+
+int convert_batch(img2wav_ctx *c, struct convert_item *items, int n) {
+    const struct options *opts = items[0].opts;
+    const int size             = opts->time_s * opts->sample_rate;
+    synth_config cfg           = opts->synth;
+    cfg.column_major           = opts->decode.column_major;
+
+    // the images are decoded side by side, size the arena for all of them from their headers
+    int width = 0, height = 0;
+    size_t bytes = (size_t) size * n * sizeof(float);
+    int ok       = n <= CHANNELS_MAX && img2wav_ctx_channels(c, n);
+    for (int i = 0; ok && i < n; i++) {
+        int w, h, channels;
+        ok = source_info(items[i].src, &w, &h, &channels) && (i == 0 || (w == width && h == height));
+        if (ok) {
+            width = w, height = h;
+            bytes += convert_arena_size(items[i].src->length, w, h, (opts->decode.gray || channels < 3) ? 1 : 3, cfg.depth, 1, 0);
+        }
+    }
+    ok = ok && size > 0 && (int) ((opts->sample_rate * opts->time_s) / width) > 0;
+    arena_reset(c->arena);
+    ok = ok && arena_reserve(c->arena, bytes);
+
+    const void *pixels[CHANNELS_MAX];
+    for (int i = 0; i < n; i++) {
+        struct decode_config dc = items[i].opts->decode;
+        dc.stats                = &c->stats;
+        dc.arena                = c->arena;
+        dc.rgb                  = 0;
+
+        int w = 0, h = 0;
+        items[i].written = 0;
+        if (ok && cfg.depth == 16)
+            pixels[i] = get_pixels_16_from_memory(items[i].src->data, items[i].src->length, &w, &h, &dc);
+        else if (ok)
+            pixels[i] = get_pixels_from_memory(items[i].src->data, items[i].src->length, &w, &h, &dc);
+        source_close(items[i].src);
+        ok = ok && pixels[i] && w == width && h == height;
+    }
+    float *samples = ok ? arena_alloc(c->arena, (size_t) size * n * sizeof(*samples)) : NULL;
+    check_error(!samples, "convert_batch(): Images failed to decode or differ in size", 0);
+
+    double start = now();
+    for (int i = 0; ok && i < n; i++)
+        ok = synth_job_setup(&c->jobs[i], pixels[i], opts->sample_rate, opts->time_s, width, height, cfg);
+    stats_add(&c->stats, STAGE_SETUP, start);
+    check_error(!ok, "synth_job_setup()", 0);
+
+    float *signal[CHANNELS_MAX];
+    for (int i = 0; i < n; i++)
+        signal[i] = samples + (size_t) i * size;
+
+    start = now();
+    memset(samples, 0, (size_t) size * n * sizeof(*samples));
+    render_channels(c, n, 0, width, signal);
+    stats_add(&c->stats, STAGE_SYNTH, start);
+
+    int converted = 0;
+    start         = now();
+    for (int i = 0; i < n; i++) {
+        struct convert_item *item = &items[i];
+        const float peak          = (opts->peak == PEAK_BOUND) ? peak_bound(&c->jobs[i].sparse) : find_max(signal[i], size);
+
+        wav_config wc   = {.nc = 1, .ns = size, .sr = opts->sample_rate, .bd = 24, .format = item->opts->container};
+        wav_writer *out = output_open(item->opts, wc, "-");
+        if (out) {
+            const int appended = wav_writer_append_scaled(out, &signal[i], size, peak_scale(peak)) == (size_t) size;
+            item->written      = (wav_writer_close(out) == (size_t) size && appended) ? size : 0;
+        }
+        if (item->written == 0) continue;
+
+        const uint64_t active = c->jobs[i].sparse.start[width];
+        converted++;
+        c->stats.images++;
+        c->stats.pixels += (uint64_t) width * height;
+        c->stats.active += active;
+        c->stats.oscillator_samples += active * c->jobs[i].target;
+        c->stats.samples += (uint64_t) size;
+        c->stats.bytes += (uint64_t) size * 3;
+    }
+    stats_add(&c->stats, STAGE_ENCODE, start);
+
+    return converted;
+}
+
+void options_default(struct options *opts) {
+    opts->synth.engine        = SYNTH_OSC;
+    opts->synth.fft_size      = 0;
+    opts->synth.simd          = "auto";
+    opts->synth.table_size    = 0;
+    opts->synth.interp        = TABLE_LINEAR;
+    opts->synth.threads       = 1;
+    opts->synth.column_major  = 1;
+    opts->synth.depth         = 8;
+    opts->synth.phase         = PHASE_RESTART;
+    opts->synth.crossfade     = 0.0f;
+    opts->synth.min_freq      = 0.0f;
+    opts->synth.max_freq      = 0.0f;
+    opts->synth.mapping       = FREQ_LINEAR;
+    opts->stream              = 0;
+    opts->ring                = 0;
+    opts->peak                = PEAK_EXACT;
+    opts->io_depth            = 2;
+    opts->io_block            = WAV_BLOCK_SIZE;
+    opts->decode.luma         = LUMA_BT601;
+    opts->decode.column_major = 1;
+    opts->decode.gray         = 0;
+    opts->decode.stats        = NULL;
+    opts->batch               = NULL;
+    opts->out_dir             = NULL;
+    opts->jobs                = 1;
+    opts->stats               = 0;
+    opts->container           = WAV_AUTO;
+    opts->channels            = CHANNELS_MONO;
+    opts->tiles               = 2;
+    opts->cache_dir           = NULL;
+    opts->incremental         = 0;
+    opts->preview             = 0;
+    opts->preview_rows        = PREVIEW_ROWS;
+    opts->cache_size          = (uint64_t) 1024 << 20;
+    opts->out                 = NULL;
+    opts->serve               = NULL;
+    opts->queue               = 64;
+    opts->serve_batch         = 8;
+}
@@ -0,0 +1,496 @@
+/* osc.h - SIMD oscillator bank for additive synthesis in img2wav
+
+   Features:
+       + Phasors of every oscillator stored in a structure-of-arrays layout
+       + Advances phasors with a complex-multiply recurrence instead of calling sin()
+       + Resynchronizes every phasor from double precision every OSC_RESYNC samples
+       + Scalar, SSE, AVX2, AVX-512 and NEON kernels picked at runtime
+
+    Limitations:
+       + Results differ from sin() by rounding of the recurrence, about 1e-6 per oscillator
+       + Kernels sum oscillators in a different order, so output is only bit-identical between runs using the same kernel
+
+    DOCUMENTATION
+    =============
+    // Define OSC_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define OSC_IMPLEMENTATION
+    #include "osc.h"
+
+    // A bank holds up to capacity oscillators and picks the fastest kernel the CPU supports.
+    osc_bank *bank = osc_bank_new(capacity);
+
+    // Add an oscillator computing amp * sin(omega * t + phase), omega is in radians per sample
+    osc_bank_add(bank, amp, omega, phase);
+
+    // Add the sum of all oscillators to out[0..n), calling again continues where the last call ended
+    osc_bank_render(bank, out, n);
+
+    // Remove every oscillator to reuse the bank, t starts again at 0
+    osc_bank_clear(bank);
+
+    // A specific kernel can be forced, returns 0 if the CPU doesn't support it
+    osc_bank_set_kernel(bank, "scalar");
+
+    // Name of the kernel a name picks, "auto" gives the fastest one of this CPU
+    const char *kernel = osc_kernel_name("auto");
+
+    osc_bank_free(bank);
+*/
+#ifndef OSC_H
+#define OSC_H
+#include <stddef.h>
+
+#define OSC_LANES  16 //!< Oscillator arrays are padded to a multiple of the widest kernel
+#define OSC_RESYNC 256//!< Number of samples between resynchronizing the phasors
+
+/** Kernel adding the imaginary part of n phasors to out for ns samples while rotating them */
+typedef void (*osc_kernel_fn)(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns);
+
+/** Bank of oscillators sharing one render call */
+struct osc_bank {
+    size_t n;            //!< Number of oscillators
+    size_t cap;          //!< Capacity of the arrays, a multiple of OSC_LANES
+    size_t t;            //!< Samples rendered since the last osc_bank_clear()
+    float *re;           //!< Real part of amp * exp(i * phase)
+    float *im;           //!< Imaginary part of amp * exp(i * phase)
+    float *wr;           //!< Real part of the per sample rotation exp(i * omega)
+    float *wi;           //!< Imaginary part of the per sample rotation exp(i * omega)
+    float *amp;          //!< Amplitude of each oscillator
+    double *omega;       //!< Angular frequency of each oscillator in radians per sample
+    double *phase;       //!< Phase of each oscillator at t = 0
+    osc_kernel_fn kernel;//!< Kernel used by osc_bank_render()
+    const char *name;    //!< Name of the kernel
+};
+typedef struct osc_bank osc_bank;
+
+/**
+ * @brief Create an oscillator bank using the fastest kernel supported by the CPU
+ *
+ * @param capacity Maximum number of oscillators
+ * @return Oscillator bank or NULL if allocation failed
+ */
+osc_bank *osc_bank_new(size_t capacity);
+
+/**
+ * @brief Deallocate an oscillator bank
+ *
+ * @param bank Bank to free, may be NULL
+ */
+void osc_bank_free(osc_bank *bank);
+
+/**
+ * @brief Remove every oscillator and restart the bank at t = 0
+ *
+ * @param bank Bank to clear
+ */
+void osc_bank_clear(osc_bank *bank);
+
+/**
+ * @brief Add an oscillator computing amp * sin(omega * t + phase)
+ *
+ * @param bank Bank to add to, must be cleared or not rendered yet
+ * @param amp Amplitude of the oscillator
+ * @param omega Angular frequency in radians per sample
+ * @param phase Phase at t = 0 in radians
+ * @return 1 on success, 0 if the bank is full
+ */
+int osc_bank_add(osc_bank *bank, float amp, double omega, double phase);
+
+/**
+ * @brief Add the sum of every oscillator to an output buffer
+ *
+ * @param bank Bank to render
+ * @param out Output buffer the samples are added to
+ * @param ns Number of samples to render
+ */
+void osc_bank_render(osc_bank *bank, float *out, size_t ns);
+
+/**
+ * @brief Force a kernel
+ *
+ * @param bank Bank to change
+ * @param name One of "auto", "scalar", "sse", "avx2", "avx512" or "neon"
+ * @return 1 on success, 0 if the kernel is unknown or not supported by the CPU
+ */
+int osc_bank_set_kernel(osc_bank *bank, const char *name);
+
+/**
+ * @brief Name of the kernel osc_bank_set_kernel() picks for a name, so "auto" names the kernel of this CPU
+ *
+ * @param name One of "auto", "scalar", "sse", "avx2", "avx512" or "neon"
+ * @return Name of the kernel, NULL if it is unknown or not supported by the CPU
+ */
+const char *osc_kernel_name(const char *name);
+
+#ifdef OSC_IMPLEMENTATION
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define OSC_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define OSC_TARGET(t)
+    #else
+        #define OSC_TARGET(t) __attribute__((target(t)))
+    #endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+    #define OSC_NEON
+    #include <arm_neon.h>
+#endif
+
+#define OSC_TWO_PI 6.28318530717958647692
+
+void osc_kernel_scalar(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns) {
+    for (size_t t = 0; t < ns; t++) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            const float r = re[i];
+            sum += im[i];
+            re[i] = r * wr[i] - im[i] * wi[i];
+            im[i] = r * wi[i] + im[i] * wr[i];
+        }
+        out[t] += sum;
+    }
+}
+
+#ifdef OSC_X86
+OSC_TARGET("sse2")
+void osc_kernel_sse(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns) {
+    size_t t = 0;
+    // render 4 samples per pass so every phasor is loaded and stored once per 4 samples
+    for (; t + 4 <= ns; t += 4) {
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+        for (size_t i = 0; i < n; i += 4) {
+            const __m128 cr = _mm_load_ps(wr + i);
+            const __m128 ci = _mm_load_ps(wi + i);
+            __m128 r        = _mm_load_ps(re + i);
+            __m128 m        = _mm_load_ps(im + i);
+            __m128 nr;
+            a0 = _mm_add_ps(a0, m);
+            nr = _mm_sub_ps(_mm_mul_ps(r, cr), _mm_mul_ps(m, ci));
+            m  = _mm_add_ps(_mm_mul_ps(r, ci), _mm_mul_ps(m, cr));
+            r  = nr;
+            a1 = _mm_add_ps(a1, m);
+            nr = _mm_sub_ps(_mm_mul_ps(r, cr), _mm_mul_ps(m, ci));
+            m  = _mm_add_ps(_mm_mul_ps(r, ci), _mm_mul_ps(m, cr));
+            r  = nr;
+            a2 = _mm_add_ps(a2, m);
+            nr = _mm_sub_ps(_mm_mul_ps(r, cr), _mm_mul_ps(m, ci));
+            m  = _mm_add_ps(_mm_mul_ps(r, ci), _mm_mul_ps(m, cr));
+            r  = nr;
+            a3 = _mm_add_ps(a3, m);
+            nr = _mm_sub_ps(_mm_mul_ps(r, cr), _mm_mul_ps(m, ci));
+            m  = _mm_add_ps(_mm_mul_ps(r, ci), _mm_mul_ps(m, cr));
+            _mm_store_ps(re + i, nr);
+            _mm_store_ps(im + i, m);
+        }
+        // transpose so each lane of the sum holds one sample
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        const __m128 sum = _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3));
+        _mm_storeu_ps(out + t, _mm_add_ps(_mm_loadu_ps(out + t), sum));
+    }
+    if (t < ns) osc_kernel_scalar(n, re, im, wr, wi, out + t, ns - t);
+}
+
+OSC_TARGET("avx2,fma")
+void osc_kernel_avx2(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns) {
+    size_t t = 0;
+    for (; t + 4 <= ns; t += 4) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        for (size_t i = 0; i < n; i += 8) {
+            const __m256 cr = _mm256_load_ps(wr + i);
+            const __m256 ci = _mm256_load_ps(wi + i);
+            __m256 r        = _mm256_load_ps(re + i);
+            __m256 m        = _mm256_load_ps(im + i);
+            __m256 nr;
+            a0 = _mm256_add_ps(a0, m);
+            nr = _mm256_fmsub_ps(r, cr, _mm256_mul_ps(m, ci));
+            m  = _mm256_fmadd_ps(r, ci, _mm256_mul_ps(m, cr));
+            r  = nr;
+            a1 = _mm256_add_ps(a1, m);
+            nr = _mm256_fmsub_ps(r, cr, _mm256_mul_ps(m, ci));
+            m  = _mm256_fmadd_ps(r, ci, _mm256_mul_ps(m, cr));
+            r  = nr;
+            a2 = _mm256_add_ps(a2, m);
+            nr = _mm256_fmsub_ps(r, cr, _mm256_mul_ps(m, ci));
+            m  = _mm256_fmadd_ps(r, ci, _mm256_mul_ps(m, cr));
+            r  = nr;
+            a3 = _mm256_add_ps(a3, m);
+            nr = _mm256_fmsub_ps(r, cr, _mm256_mul_ps(m, ci));
+            m  = _mm256_fmadd_ps(r, ci, _mm256_mul_ps(m, cr));
+            _mm256_store_ps(re + i, nr);
+            _mm256_store_ps(im + i, m);
+        }
+        // fold the upper half onto the lower half, then transpose like the sse kernel
+        __m128 s0 = _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1));
+        __m128 s1 = _mm_add_ps(_mm256_castps256_ps128(a1), _mm256_extractf128_ps(a1, 1));
+        __m128 s2 = _mm_add_ps(_mm256_castps256_ps128(a2), _mm256_extractf128_ps(a2, 1));
+        __m128 s3 = _mm_add_ps(_mm256_castps256_ps128(a3), _mm256_extractf128_ps(a3, 1));
+        _MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+        const __m128 sum = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+        _mm_storeu_ps(out + t, _mm_add_ps(_mm_loadu_ps(out + t), sum));
+    }
+    if (t < ns) osc_kernel_scalar(n, re, im, wr, wi, out + t, ns - t);
+}
+
+OSC_TARGET("avx512f")
+void osc_kernel_avx512(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns) {
+    size_t t = 0;
+    for (; t + 4 <= ns; t += 4) {
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        for (size_t i = 0; i < n; i += 16) {
+            const __m512 cr = _mm512_load_ps(wr + i);
+            const __m512 ci = _mm512_load_ps(wi + i);
+            __m512 r        = _mm512_load_ps(re + i);
+            __m512 m        = _mm512_load_ps(im + i);
+            __m512 nr;
+            a0 = _mm512_add_ps(a0, m);
+            nr = _mm512_fmsub_ps(r, cr, _mm512_mul_ps(m, ci));
+            m  = _mm512_fmadd_ps(r, ci, _mm512_mul_ps(m, cr));
+            r  = nr;
+            a1 = _mm512_add_ps(a1, m);
+            nr = _mm512_fmsub_ps(r, cr, _mm512_mul_ps(m, ci));
+            m  = _mm512_fmadd_ps(r, ci, _mm512_mul_ps(m, cr));
+            r  = nr;
+            a2 = _mm512_add_ps(a2, m);
+            nr = _mm512_fmsub_ps(r, cr, _mm512_mul_ps(m, ci));
+            m  = _mm512_fmadd_ps(r, ci, _mm512_mul_ps(m, cr));
+            r  = nr;
+            a3 = _mm512_add_ps(a3, m);
+            nr = _mm512_fmsub_ps(r, cr, _mm512_mul_ps(m, ci));
+            m  = _mm512_fmadd_ps(r, ci, _mm512_mul_ps(m, cr));
+            _mm512_store_ps(re + i, nr);
+            _mm512_store_ps(im + i, m);
+        }
+        out[t] += _mm512_reduce_add_ps(a0);
+        out[t + 1] += _mm512_reduce_add_ps(a1);
+        out[t + 2] += _mm512_reduce_add_ps(a2);
+        out[t + 3] += _mm512_reduce_add_ps(a3);
+    }
+    if (t < ns) osc_kernel_scalar(n, re, im, wr, wi, out + t, ns - t);
+}
+
+/** Check the CPU and OS support a kernel */
+int osc_cpu_supports(const char *name) {
+    #if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    const int sse2       = (info[3] >> 26) & 1;
+    const int fma        = (info[2] >> 12) & 1;
+    const int osxsave    = (info[2] >> 27) & 1;
+    const int avx        = (info[2] >> 28) & 1;
+    unsigned long long x = osxsave ? _xgetbv(0) : 0;
+    int avx2 = 0, avx512f = 0;
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2    = (info[1] >> 5) & 1;
+        avx512f = (info[1] >> 16) & 1;
+    }
+    if (strcmp(name, "sse") == 0) return sse2;
+    if (strcmp(name, "avx2") == 0) return avx && avx2 && fma && (x & 0x6) == 0x6;
+    if (strcmp(name, "avx512") == 0) return avx512f && (x & 0xE6) == 0xE6;
+    return 0;
+    #else
+    __builtin_cpu_init();
+    if (strcmp(name, "sse") == 0) return __builtin_cpu_supports("sse2");
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+    return 0;
+    #endif
+}
+#endif
+
+#ifdef OSC_NEON
+void osc_kernel_neon(size_t n, float *re, float *im, const float *wr, const float *wi, float *out, size_t ns) {
+    size_t t = 0;
+    for (; t + 4 <= ns; t += 4) {
+        float32x4_t a0 = vdupq_n_f32(0.0f), a1 = a0, a2 = a0, a3 = a0;
+        for (size_t i = 0; i < n; i += 4) {
+            const float32x4_t cr = vld1q_f32(wr + i);
+            const float32x4_t ci = vld1q_f32(wi + i);
+            float32x4_t r        = vld1q_f32(re + i);
+            float32x4_t m        = vld1q_f32(im + i);
+            float32x4_t nr;
+            a0 = vaddq_f32(a0, m);
+            nr = vmlsq_f32(vmulq_f32(r, cr), m, ci);
+            m  = vmlaq_f32(vmulq_f32(r, ci), m, cr);
+            r  = nr;
+            a1 = vaddq_f32(a1, m);
+            nr = vmlsq_f32(vmulq_f32(r, cr), m, ci);
+            m  = vmlaq_f32(vmulq_f32(r, ci), m, cr);
+            r  = nr;
+            a2 = vaddq_f32(a2, m);
+            nr = vmlsq_f32(vmulq_f32(r, cr), m, ci);
+            m  = vmlaq_f32(vmulq_f32(r, ci), m, cr);
+            r  = nr;
+            a3 = vaddq_f32(a3, m);
+            nr = vmlsq_f32(vmulq_f32(r, cr), m, ci);
+            m  = vmlaq_f32(vmulq_f32(r, ci), m, cr);
+            vst1q_f32(re + i, nr);
+            vst1q_f32(im + i, m);
+        }
+        out[t] += vaddvq_f32(a0);
+        out[t + 1] += vaddvq_f32(a1);
+        out[t + 2] += vaddvq_f32(a2);
+        out[t + 3] += vaddvq_f32(a3);
+    }
+    if (t < ns) osc_kernel_scalar(n, re, im, wr, wi, out + t, ns - t);
+}
+#endif
+
+int osc_bank_set_kernel(osc_bank *bank, const char *name) {
+    const int any = strcmp(name, "auto") == 0;
+
+    #ifdef OSC_X86
+    if ((any || strcmp(name, "avx512") == 0) && osc_cpu_supports("avx512")) {
+        bank->kernel = osc_kernel_avx512, bank->name = "avx512";
+        return 1;
+    }
+    if ((any || strcmp(name, "avx2") == 0) && osc_cpu_supports("avx2")) {
+        bank->kernel = osc_kernel_avx2, bank->name = "avx2";
+        return 1;
+    }
+    if ((any || strcmp(name, "sse") == 0) && osc_cpu_supports("sse")) {
+        bank->kernel = osc_kernel_sse, bank->name = "sse";
+        return 1;
+    }
+    #endif
+    #ifdef OSC_NEON
+    if (any || strcmp(name, "neon") == 0) {
+        bank->kernel = osc_kernel_neon, bank->name = "neon";
+        return 1;
+    }
+    #endif
+    if (any || strcmp(name, "scalar") == 0) {
+        bank->kernel = osc_kernel_scalar, bank->name = "scalar";
+        return 1;
+    }
+
+    return 0;
+}
+
+const char *osc_kernel_name(const char *name) {
+    osc_bank bank;
+
+    return osc_bank_set_kernel(&bank, name) ? bank.name : NULL;
+}
+
+/** Allocate an array aligned for the widest kernel */
+void *osc_aligned_alloc(size_t size) {
+    // over-allocate and stash the original pointer right before the aligned block
+    unsigned char *raw = malloc(size + 64 + sizeof(void *));
+    if (!raw) return NULL;
+
+    const uintptr_t p = ((uintptr_t) raw + sizeof(void *) + 63) & ~(uintptr_t) 63;
+    ((void **) p)[-1] = raw;
+
+    return (void *) p;
+}
+
+/** Deallocate an array allocated with osc_aligned_alloc() */
+void osc_aligned_free(void *p) {
+    if (p) free(((void **) p)[-1]);
+}
+
+osc_bank *osc_bank_new(size_t capacity) {
+    osc_bank *bank = calloc(1, sizeof(*bank));
+    if (!bank) return NULL;
+
+    bank->cap = (capacity + OSC_LANES - 1) / OSC_LANES * OSC_LANES;
+    if (bank->cap == 0) bank->cap = OSC_LANES;
+
+    bank->re    = osc_aligned_alloc(bank->cap * sizeof(float));
+    bank->im    = osc_aligned_alloc(bank->cap * sizeof(float));
+    bank->wr    = osc_aligned_alloc(bank->cap * sizeof(float));
+    bank->wi    = osc_aligned_alloc(bank->cap * sizeof(float));
+    bank->amp   = malloc(bank->cap * sizeof(*bank->amp));
+    bank->omega = malloc(bank->cap * sizeof(*bank->omega));
+    bank->phase = malloc(bank->cap * sizeof(*bank->phase));
+    if (!bank->re || !bank->im || !bank->wr || !bank->wi || !bank->amp || !bank->omega || !bank->phase) {
+        osc_bank_free(bank);
+        return NULL;
+    }
+
+    osc_bank_set_kernel(bank, "auto");
+    osc_bank_clear(bank);
+
+    return bank;
+}
+
+void osc_bank_free(osc_bank *bank) {
+    if (!bank) return;
+    osc_aligned_free(bank->re);
+    osc_aligned_free(bank->im);
+    osc_aligned_free(bank->wr);
+    osc_aligned_free(bank->wi);
+    free(bank->amp);
+    free(bank->omega);
+    free(bank->phase);
+    free(bank);
+}
+
+void osc_bank_clear(osc_bank *bank) {
+    bank->n = 0;
+    bank->t = 0;
+    // padding lanes stay at zero so kernels can always process whole vectors
+    memset(bank->re, 0, bank->cap * sizeof(float));
+    memset(bank->im, 0, bank->cap * sizeof(float));
+    memset(bank->wr, 0, bank->cap * sizeof(float));
+    memset(bank->wi, 0, bank->cap * sizeof(float));
+}
+
+int osc_bank_add(osc_bank *bank, float amp, double omega, double phase) {
+    if (bank->n == bank->cap) return 0;
+
+    const size_t i = bank->n++;
+    bank->amp[i]   = amp;
+    bank->omega[i] = omega;
+    bank->phase[i] = phase;
+    bank->wr[i]    = (float) cos(omega);
+    bank->wi[i]    = (float) sin(omega);
+    bank->re[i]    = (float) (amp * cos(phase));
+    bank->im[i]    = (float) (amp * sin(phase));
+
+    return 1;
+}
+
+/** Reset every phasor to its exact value at time t, removing drift in both phase and magnitude */
+void osc_bank_resync(osc_bank *bank) {
+    for (size_t i = 0; i < bank->n; i++) {
+        const double theta = fmod(bank->phase[i] + bank->omega[i] * (double) bank->t, OSC_TWO_PI);
+        bank->re[i]        = (float) (bank->amp[i] * cos(theta));
+        bank->im[i]        = (float) (bank->amp[i] * sin(theta));
+    }
+}
+
+void osc_bank_render(osc_bank *bank, float *out, size_t ns) {
+    if (bank->n == 0) {
+        bank->t += ns;
+        return;
+    }
+
+    // kernels only need to touch the vectors that hold oscillators
+    const size_t n = (bank->n + OSC_LANES - 1) / OSC_LANES * OSC_LANES;
+    while (ns > 0) {
+        if (bank->t % OSC_RESYNC == 0 && bank->t > 0) osc_bank_resync(bank);
+
+        size_t count = OSC_RESYNC - bank->t % OSC_RESYNC;
+        if (count > ns) count = ns;
+        bank->kernel(n, bank->re, bank->im, bank->wr, bank->wi, out, count);
+
+        out += count;
+        ns -= count;
+        bank->t += count;
+    }
+}
+
+#undef OSC_TWO_PI
+#endif
+#endif
@@ -0,0 +1,326 @@
+/* pool.h - work stealing thread pool for img2wav
+
+   Features:
+       + Persistent worker threads, reused by every pool_run() call
+       + Tasks are split into contiguous per worker ranges of equal total cost
+       + Idle workers steal from the back of the busiest ranges
+       + Cross platform windows/unix/linux
+
+    Limitations:
+       + Every task of a pool_run() call is known up front, tasks can't spawn tasks
+       + One pool_run() call at a time per pool
+
+    DOCUMENTATION
+    =============
+    // Define POOL_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define POOL_IMPLEMENTATION
+    #include "pool.h"
+
+    // Create a pool of num_threads workers, the calling thread counts as one of them.
+    // pool_cpu_count() returns the number of processors to use every core.
+    pool *p = pool_new(num_threads);
+
+    // Run fn(ctx, worker, task) for every task in [0, num_tasks). cost[task] is the
+    // relative cost of each task used to balance the work, NULL means every task costs the same.
+    // worker is in [0, pool_size(p)) and identifies the thread running the task, so
+    // per thread scratch buffers can be indexed with it.
+    pool_run(p, num_tasks, cost, fn, ctx);
+
+    pool_free(p);
+*/
+#ifndef POOL_H
+#define POOL_H
+#include <stddef.h>
+
+/** Task executed by the pool */
+typedef void (*pool_task_fn)(void *ctx, int worker, size_t task);
+
+typedef struct pool pool;
+
+/**
+ * @brief Create a thread pool
+ *
+ * @param nthreads Number of workers including the calling thread, values below 1 are treated as 1
+ * @return Thread pool or NULL if the threads couldn't be created
+ */
+pool *pool_new(int nthreads);
+
+/**
+ * @brief Number of workers of a pool
+ *
+ * @param p Thread pool
+ * @return Number of workers including the calling thread
+ */
+int pool_size(const pool *p);
+
+/**
+ * @brief Run tasks on every worker and wait for them to finish
+ *
+ * @param p Thread pool
+ * @param ntasks Number of tasks
+ * @param cost Relative cost of each task, may be NULL
+ * @param fn Function executing a task
+ * @param ctx Context passed to fn
+ */
+void pool_run(pool *p, size_t ntasks, const double *cost, pool_task_fn fn, void *ctx);
+
+/**
+ * @brief Number of processors available to the process
+ *
+ * @return Number of online processors, at least 1
+ */
+int pool_cpu_count(void);
+
+/**
+ * @brief Stop the workers and deallocate a thread pool
+ *
+ * @param p Thread pool to free, may be NULL
+ */
+void pool_free(pool *p);
+
+#ifdef POOL_IMPLEMENTATION
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+typedef HANDLE pool_thread;
+typedef CRITICAL_SECTION pool_mutex;
+typedef CONDITION_VARIABLE pool_cond;
+    #define pool_mutex_init(m)    InitializeCriticalSection(m)
+    #define pool_mutex_destroy(m) DeleteCriticalSection(m)
+    #define pool_lock(m)          EnterCriticalSection(m)
+    #define pool_unlock(m)        LeaveCriticalSection(m)
+    #define pool_cond_init(c)     InitializeConditionVariable(c)
+    #define pool_cond_destroy(c)  ((void) (c))
+    #define pool_wait(c, m)       SleepConditionVariableCS((c), (m), INFINITE)
+    #define pool_broadcast(c)     WakeAllConditionVariable(c)
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+typedef pthread_t pool_thread;
+typedef pthread_mutex_t pool_mutex;
+typedef pthread_cond_t pool_cond;
+    #define pool_mutex_init(m)    pthread_mutex_init((m), NULL)
+    #define pool_mutex_destroy(m) pthread_mutex_destroy(m)
+    #define pool_lock(m)          pthread_mutex_lock(m)
+    #define pool_unlock(m)        pthread_mutex_unlock(m)
+    #define pool_cond_init(c)     pthread_cond_init((c), NULL)
+    #define pool_cond_destroy(c)  pthread_cond_destroy(c)
+    #define pool_wait(c, m)       pthread_cond_wait((c), (m))
+    #define pool_broadcast(c)     pthread_cond_broadcast(c)
+#endif
+
+/** Range of tasks owned by one worker, the owner pops from lo and thieves from hi */
+struct pool_queue {
+    pool_mutex lock;//!< Guards lo and hi
+    size_t lo;      //!< Next task of the owner
+    size_t hi;      //!< One past the last task of the range
+    char pad[64];   //!< Keep queues of different workers on separate cache lines
+};
+
+/** Argument of a background worker thread */
+struct pool_worker {
+    pool *p;//!< Pool the worker belongs to
+    int id; //!< Worker index, 0 is the thread calling pool_run()
+};
+
+struct pool {
+    int n;                       //!< Number of workers including the caller
+    pool_thread *threads;        //!< Background workers 1..n-1
+    struct pool_worker *workers; //!< Arguments of the background workers
+    struct pool_queue *queues;   //!< Task range of every worker
+    pool_mutex lock;             //!< Guards generation, busy and quit
+    pool_cond wake;              //!< Signaled when a job starts or the pool stops
+    pool_cond idle;              //!< Signaled when a background worker finishes a job
+    unsigned long generation;    //!< Incremented for every job
+    int busy;                    //!< Background workers still running the current job
+    int quit;                    //!< Set when the pool is freed
+    pool_task_fn fn;             //!< Task of the current job
+    void *ctx;                   //!< Context of the current job
+};
+
+int pool_size(const pool *p) {
+    return p->n;
+}
+
+int pool_cpu_count(void) {
+    #ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const long n = info.dwNumberOfProcessors;
+    #else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    #endif
+
+    return n < 1 ? 1 : (int) n;
+}
+
+/** Take the next task of a worker's own range */
+int pool_pop(struct pool_queue *q, size_t *task) {
+    int ok = 0;
+    pool_lock(&q->lock);
+    if (q->lo < q->hi) *task = q->lo++, ok = 1;
+    pool_unlock(&q->lock);
+
+    return ok;
+}
+
+/** Take the last task of another worker's range */
+int pool_steal(struct pool_queue *q, size_t *task) {
+    int ok = 0;
+    pool_lock(&q->lock);
+    if (q->lo < q->hi) *task = --q->hi, ok = 1;
+    pool_unlock(&q->lock);
+
+    return ok;
+}
+
+/** Run tasks until every range is empty */
+void pool_work(pool *p, int id) {
+    size_t task;
+    for (;;) {
+        int found = pool_pop(&p->queues[id], &task);
+        for (int i = 1; i < p->n && !found; i++)
+            found = pool_steal(&p->queues[(id + i) % p->n], &task);
+        if (!found) return;
+
+        p->fn(p->ctx, id, task);
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI pool_main(LPVOID arg) {
+#else
+void *pool_main(void *arg) {
+#endif
+    struct pool_worker *w   = arg;
+    pool *p                 = w->p;
+    unsigned long last_seen = 0;
+
+    pool_lock(&p->lock);
+    for (;;) {
+        while (!p->quit && p->generation == last_seen)
+            pool_wait(&p->wake, &p->lock);
+        if (p->quit) break;
+        last_seen = p->generation;
+        pool_unlock(&p->lock);
+
+        pool_work(p, w->id);
+
+        pool_lock(&p->lock);
+        if (--p->busy == 0) pool_broadcast(&p->idle);
+    }
+    pool_unlock(&p->lock);
+
+    return 0;
+}
+
+pool *pool_new(int nthreads) {
+    pool *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+
+    p->n       = nthreads < 1 ? 1 : nthreads;
+    p->queues  = calloc(p->n, sizeof(*p->queues));
+    p->threads = calloc(p->n, sizeof(*p->threads));
+    p->workers = calloc(p->n, sizeof(*p->workers));
+    if (!p->queues || !p->threads || !p->workers) {
+        free(p->queues);
+        free(p->threads);
+        free(p->workers);
+        free(p);
+        return NULL;
+    }
+
+    pool_mutex_init(&p->lock);
+    pool_cond_init(&p->wake);
+    pool_cond_init(&p->idle);
+    for (int i = 0; i < p->n; i++)
+        pool_mutex_init(&p->queues[i].lock);
+
+    for (int i = 1; i < p->n; i++) {
+        p->workers[i].p  = p;
+        p->workers[i].id = i;
+        #ifdef _WIN32
+        p->threads[i] = CreateThread(NULL, 0, pool_main, &p->workers[i], 0, NULL);
+        const int ok  = p->threads[i] != NULL;
+        #else
+        const int ok = pthread_create(&p->threads[i], NULL, pool_main, &p->workers[i]) == 0;
+        #endif
+        if (!ok) {
+            // run with the workers that did start
+            p->n = i;
+            break;
+        }
+    }
+
+    return p;
+}
+
+void pool_run(pool *p, size_t ntasks, const double *cost, pool_task_fn fn, void *ctx) {
+    if (ntasks == 0) return;
+
+    // split the tasks into contiguous ranges of roughly equal cost, neighbouring
+    // tasks stay on the same worker which keeps per worker caches warm
+    double total = 0.0;
+    for (size_t i = 0; i < ntasks; i++)
+        total += cost ? cost[i] : 1.0;
+
+    size_t task = 0;
+    double sum  = 0.0;
+    for (int w = 0; w < p->n; w++) {
+        const double goal = total * (w + 1) / p->n;
+        p->queues[w].lo   = task;
+        while (task < ntasks && (w == p->n - 1 || sum < goal)) {
+            sum += cost ? cost[task] : 1.0;
+            task++;
+        }
+        p->queues[w].hi = task;
+    }
+
+    pool_lock(&p->lock);
+    p->fn   = fn;
+    p->ctx  = ctx;
+    p->busy = p->n - 1;
+    p->generation++;
+    pool_broadcast(&p->wake);
+    pool_unlock(&p->lock);
+
+    pool_work(p, 0);
+
+    pool_lock(&p->lock);
+    while (p->busy > 0)
+        pool_wait(&p->idle, &p->lock);
+    pool_unlock(&p->lock);
+}
+
+void pool_free(pool *p) {
+    if (!p) return;
+
+    pool_lock(&p->lock);
+    p->quit = 1;
+    pool_broadcast(&p->wake);
+    pool_unlock(&p->lock);
+
+    for (int i = 1; i < p->n; i++) {
+        #ifdef _WIN32
+        WaitForSingleObject(p->threads[i], INFINITE);
+        CloseHandle(p->threads[i]);
+        #else
+        pthread_join(p->threads[i], NULL);
+        #endif
+    }
+
+    for (int i = 0; i < p->n; i++)
+        pool_mutex_destroy(&p->queues[i].lock);
+    pool_mutex_destroy(&p->lock);
+    pool_cond_destroy(&p->wake);
+    pool_cond_destroy(&p->idle);
+    free(p->queues);
+    free(p->threads);
+    free(p->workers);
+    free(p);
+}
+
+#endif
+#endif
@@ -0,0 +1,396 @@
+/* serve.h - Unix domain socket server with a bounded connection queue for img2wav
+
+   Features:
+       + Connections accepted on a Unix domain socket wait in a queue served by a fixed set of worker threads
+       + A full queue turns connections away at once with a short message instead of letting them pile up
+       + Workers can take every connection waiting at once, to handle several requests together
+       + server_stop() is async signal safe, so a SIGINT or SIGTERM handler can shut the server down
+       + Connections get read and write timeouts, a stalled client can't hold a worker forever
+       + Connections still queued when the server stops are served before server_run() returns
+
+    Limitations:
+       + Unix only, server_open() fails on Windows
+       + One server_run() call at a time per server
+
+    DOCUMENTATION
+    =============
+    // Define SERVE_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define SERVE_IMPLEMENTATION
+    #include "serve.h"
+
+    // Listen on a socket path, at most queue connections wait for a worker and the
+    // ones past it get busy written to them before they are closed
+    server *s = server_open("/tmp/app.sock", queue, "busy\n");
+
+    // Every worker takes connections until the server stops
+    void worker(server *s, void *ctx, int id) {
+        int fd;
+        while ((fd = server_next(s, 1)) >= 0) {
+            // server_next(s, 0) takes another waiting connection without blocking, -1 if there is none
+            handle(fd);
+            close(fd);
+        }
+    }
+
+    // Start the workers and accept connections on the calling thread until server_stop()
+    server_run(s, workers, worker, ctx);
+
+    // Connections accepted and turned away
+    server_stats st = server_get_stats(s);
+
+    server_free(s);
+*/
+#ifndef SERVE_H
+#define SERVE_H
+#include <stdint.h>
+
+#define SERVE_TIMEOUT_S 30//!< Seconds a read or write of a connection may block before it fails
+
+typedef struct server server;
+
+/** Loop of a worker thread, it takes connections with server_next() until it returns -1 */
+typedef void (*server_worker_fn)(server *s, void *ctx, int worker);
+
+/** Counters of a server */
+struct server_stats {
+    uint64_t accepted;//!< Connections queued for a worker
+    uint64_t rejected;//!< Connections turned away because the queue was full
+};
+typedef struct server_stats server_stats;
+
+/**
+ * @brief Listen on a Unix domain socket
+ *
+ * A socket left behind at path by a previous server is replaced, any other file is kept and fails.
+ *
+ * @param path Path of the socket
+ * @param queue Most connections waiting for a worker, at least 1
+ * @param busy Message written to connections turned away, kept by the server
+ * @return Server or NULL on failure
+ */
+server *server_open(const char *path, int queue, const char *busy);
+
+/**
+ * @brief Start the workers and accept connections on the calling thread until server_stop()
+ *
+ * The workers run with every signal blocked, so signals are handled by the calling thread.
+ *
+ * @param s Server
+ * @param workers Number of worker threads, at least 1
+ * @param fn Loop of every worker
+ * @param ctx Context passed to fn
+ * @return 1 once the server stopped and every worker returned, 0 on failure
+ */
+int server_run(server *s, int workers, server_worker_fn fn, void *ctx);
+
+/**
+ * @brief Take the next connection of the queue
+ *
+ * @param s Server
+ * @param wait Block until there is a connection or the server stops, 0 returns -1 right away if the queue is empty
+ * @return File descriptor of the connection, closed by the caller, -1 if there is none
+ */
+int server_next(server *s, int wait);
+
+/**
+ * @brief Stop accepting connections, async signal safe
+ *
+ * @param s Server
+ */
+void server_stop(server *s);
+
+/**
+ * @brief Counters of a server
+ *
+ * @param s Server
+ * @return Connections accepted and turned away since server_open()
+ */
+server_stats server_get_stats(server *s);
+
+/**
+ * @brief Close the socket, remove its path and deallocate a server
+ *
+ * @param s Server to free, may be NULL
+ */
+void server_free(server *s);
+
+#ifdef SERVE_IMPLEMENTATION
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define check_error(error, description, retval)                                 \
+    do {                                                                        \
+        if (error) {                                                            \
+            fprintf(stderr, "%s [%s:%d]\n", description, __FILE__, __LINE__); \
+            return retval;                                                      \
+        }                                                                       \
+    } while (0)
+
+#ifdef _WIN32
+struct server {
+    server_stats stats;//!< Never used, there is no server on Windows
+};
+
+server *server_open(const char *path, int queue, const char *busy) {
+    (void) path, (void) queue, (void) busy;
+    check_error(1, "server_open(): Unix domain sockets aren't supported on Windows", NULL);
+}
+
+int server_run(server *s, int workers, server_worker_fn fn, void *ctx) {
+    (void) s, (void) workers, (void) fn, (void) ctx;
+    return 0;
+}
+
+int server_next(server *s, int wait) {
+    (void) s, (void) wait;
+    return -1;
+}
+
+void server_stop(server *s) {
+    (void) s;
+}
+
+server_stats server_get_stats(server *s) {
+    return s->stats;
+}
+
+void server_free(server *s) {
+    (void) s;
+}
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/time.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+
+struct server {
+    int listener;        //!< Listening socket
+    int wake[2];         //!< Pipe written by server_stop() to wake the accepting thread
+    char *path;          //!< Path of the socket, removed by server_free()
+    const char *busy;    //!< Message written to connections turned away
+    pthread_mutex_t lock;//!< Guards the queue, stopping and stats
+    pthread_cond_t ready;//!< Signaled when a connection is queued or the server stops
+    int *queue;          //!< Ring of connections waiting for a worker
+    int cap;             //!< Capacity of queue
+    int head;            //!< Index of the oldest connection of queue
+    int count;           //!< Number of connections in queue
+    int stopping;        //!< server_stop() was called and the accepting thread saw it
+    server_stats stats;  //!< Counters
+    server_worker_fn fn; //!< Loop of every worker of server_run()
+    void *ctx;           //!< Context of fn
+};
+
+/** Worker thread of server_run() (internal use only) */
+struct server_thread {
+    server *s;       //!< Server the worker takes connections from
+    int id;          //!< Index of the worker
+    pthread_t thread;//!< Thread running the worker
+};
+
+/** Set or clear O_NONBLOCK and set FD_CLOEXEC on a file descriptor (internal use only) */
+int server_set_flags(int fd, int nonblock) {
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return 0;
+
+    return fcntl(fd, F_SETFL, nonblock ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+server *server_open(const char *path, int queue, const char *busy) {
+    struct sockaddr_un addr;
+    check_error(!path || strlen(path) >= sizeof(addr.sun_path), "server_open(): Socket path is too long", NULL);
+
+    server *s = calloc(1, sizeof(*s));
+    check_error(!s, "calloc(): Failed to allocate server", NULL);
+    s->listener = -1;
+    s->wake[0] = s->wake[1] = -1;
+    s->busy                 = busy ? busy : "";
+    s->cap                  = queue > 0 ? queue : 1;
+    s->queue                = malloc(s->cap * sizeof(*s->queue));
+    s->path                 = malloc(strlen(path) + 1);
+    int ok                  = s->queue && s->path;
+    if (!ok) {
+        free(s->queue);
+        free(s->path);
+        free(s);
+    }
+    check_error(!ok, "malloc(): Failed to allocate server", NULL);
+    strcpy(s->path, path);
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->ready, NULL);
+
+    // a socket of a server that didn't shut down cleanly refuses the bind
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    s->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    ok          = s->listener >= 0 && server_set_flags(s->listener, 1);
+    ok          = ok && bind(s->listener, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+    if (!ok) {
+        // the path isn't ours, server_free() must leave it alone
+        free(s->path);
+        s->path = NULL;
+    }
+    ok = ok && listen(s->listener, SOMAXCONN) == 0;
+    ok = ok && pipe(s->wake) == 0 && server_set_flags(s->wake[0], 1) && server_set_flags(s->wake[1], 1);
+    if (!ok) {
+        perror("server_open()");
+        server_free(s);
+    }
+    check_error(!ok, "server_open(): Failed to listen on the socket", NULL);
+
+    return s;
+}
+
+/** Main function of a worker thread (internal use only) */
+void *server_thread_main(void *arg) {
+    struct server_thread *t = arg;
+    t->s->fn(t->s, t->s->ctx, t->id);
+
+    return NULL;
+}
+
+/** Queue a connection or turn it away (internal use only) */
+void server_push(server *s, int fd) {
+    // the listener is non blocking, which some systems pass on to accepted sockets
+    const struct timeval timeout = {SERVE_TIMEOUT_S, 0};
+    server_set_flags(fd, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    pthread_mutex_lock(&s->lock);
+    const int full = s->count == s->cap;
+    if (full) {
+        s->stats.rejected++;
+    } else {
+        s->queue[(s->head + s->count++) % s->cap] = fd;
+        s->stats.accepted++;
+        pthread_cond_signal(&s->ready);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (full) {
+        const size_t n = strlen(s->busy);
+        if (write(fd, s->busy, n) != (ssize_t) n) perror("server_push(): write()");
+        close(fd);
+    }
+}
+
+int server_run(server *s, int workers, server_worker_fn fn, void *ctx) {
+    check_error(!s || !fn, "server_run(): Server and worker must not be NULL", 0);
+    if (workers < 1) workers = 1;
+
+    struct server_thread *threads = calloc(workers, sizeof(*threads));
+    check_error(!threads, "calloc(): Failed to allocate workers", 0);
+    s->fn  = fn;
+    s->ctx = ctx;
+
+    // workers inherit the blocked signals, so only this thread sees them
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int started = 0;
+    while (started < workers) {
+        threads[started].s  = s;
+        threads[started].id = started;
+        if (pthread_create(&threads[started].thread, NULL, server_thread_main, &threads[started]) != 0) break;
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    const int ok = started == workers;
+    if (!ok) fprintf(stderr, "pthread_create(): Failed to start the workers [%s:%d]\n", __FILE__, __LINE__);
+
+    // a signal interrupts poll(), its handler has written to the wake pipe by then
+    struct pollfd fds[2] = {{s->listener, POLLIN, 0}, {s->wake[0], POLLIN, 0}};
+    while (ok) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("server_run(): poll()");
+            break;
+        }
+        if (fds[1].revents) break;
+
+        int fd;
+        while ((fd = accept(s->listener, NULL, NULL)) >= 0)
+            server_push(s, fd);
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+            perror("server_run(): accept()");
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    pthread_cond_broadcast(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i].thread, NULL);
+    free(threads);
+
+    // the wake byte is consumed, the server can run again
+    char drain[16];
+    while (read(s->wake[0], drain, sizeof(drain)) > 0) continue;
+    s->stopping = 0;
+
+    return ok;
+}
+
+int server_next(server *s, int wait) {
+    pthread_mutex_lock(&s->lock);
+    while (wait && s->count == 0 && !s->stopping)
+        pthread_cond_wait(&s->ready, &s->lock);
+
+    int fd = -1;
+    if (s->count > 0) {
+        fd      = s->queue[s->head];
+        s->head = (s->head + 1) % s->cap;
+        s->count--;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return fd;
+}
+
+void server_stop(server *s) {
+    const char byte = 1;
+    if (write(s->wake[1], &byte, 1) < 0) return;// the pipe is full, a wake up is pending already
+}
+
+server_stats server_get_stats(server *s) {
+    pthread_mutex_lock(&s->lock);
+    const server_stats st = s->stats;
+    pthread_mutex_unlock(&s->lock);
+
+    return st;
+}
+
+void server_free(server *s) {
+    if (!s) return;
+    if (s->listener >= 0) close(s->listener);
+    if (s->path) unlink(s->path);
+    for (int i = 0; i < 2; i++)
+        if (s->wake[i] >= 0) close(s->wake[i]);
+    for (int i = 0; i < s->count; i++)
+        close(s->queue[(s->head + i) % s->cap]);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->ready);
+    free(s->queue);
+    free(s->path);
+    free(s);
+}
+#endif
+
+#undef check_error
+#endif
+#endif
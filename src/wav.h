@@ -3,16 +3,27 @@
    Features:
        + Supports 32-bit float, signed 24-bit PCM, signed 16-bit PCM and signed 8-bit PCM bit depths
        + Supports multi-channel formats
+       + Encodes samples into WAV_BLOCK_SIZE byte blocks, or cfg.block bytes, one fwrite per block
+       + SSE2/NEON 16-bit and 24-bit quantizers
+       + Encode and decode kernels specialized for mono and stereo at every bit depth, picked once per call
+       + Zero-copy reads decoded straight from a memory mapping of the requested range
+       + Incremental writing to seekable files or, with the sizes known up front, to pipes
+       + In place rewriting of a range of samples of an existing file
+       + RF64 (EBU Tech 3306) once the data passes 4 GiB, or Sony Wave64 on request
        + Cross platform windows/unix/linux
     
     Limitations:
        + Only supports Little-Endian systems
        + Forced usage of standard library
        + Limited support for wav header extensions
-       + Does not support partial reads
 
     DOCUMENTATION
     =============
+    // Define WAV_IMPLEMENTATION in exactly one translation unit before
+    // including this file to create the implementation.
+    #define WAV_IMPLEMENTATION
+    #include "wav.h"
+
     // When you want to write to a wav file to you need specify 
     // how its written using a wav_config.
     wav_config cfg;
@@ -20,12 +31,34 @@
     cfg.ns = num_samples;  // >0
     cfg.sr = sample_rate;  // 44100, 48000, 96000 etc
     cfg.bd = bit_depth;    // 8, 16, 24, 32
+    cfg.format = WAV_AUTO; // RIFF, switching to RF64 when the sizes don't fit in 32 bits
 
     // To actually write your audio data, call wav_write() using 
     // your created wav_config. The data parameter to wav write
     // is your deinterleaved channel data of size data[num_channels][num_samples];
     wav_write(cfg, "audio.wav", data);
 
+    // Audio data that doesn't fit in memory can be written in blocks to an open file,
+    // as long as the blocks add up to cfg.ns samples.
+    FILE *f = fopen("audio.wav", "wb");
+    wav_write_header(cfg, f);
+    wav_write_samples(cfg, f, block, block_samples); // repeat for every block
+    wav_write_pad(cfg, f);
+    fclose(f);
+
+    // When the number of samples isn't known up front, use a wav_writer instead.
+    // The header sizes are patched in when the writer is closed. Unless cfg.ns says
+    // the file fits in RIFF, room for a ds64 chunk is reserved and the file becomes
+    // RF64 if it ends up larger than 4 GiB.
+    wav_writer *w = wav_writer_open(cfg, "audio.wav");
+    wav_writer_append(w, block, block_samples); // repeat for every block
+    wav_writer_flush(w);                        // optional, hands the samples to a reader right away
+    wav_writer_close(w);
+
+    // Pipes can't seek, so a writer on an open stream like stdout writes the sizes
+    // of cfg.ns samples up front and checks that exactly that many were appended.
+    wav_writer *p = wav_writer_open_stream(cfg, stdout);
+
     // When you want to read from a wav file, you need to populate
     // the parameters of a wav_config
     wav_get_header(&cfg, "audio.wav");
@@ -40,6 +73,13 @@
     // the channel data using wav_read()
     wav_read(cfg, "audio.wav", in);
 
+    // A window of count samples starting at sample offset can be read with wav_read_range(),
+    // only that part of the file is mapped so in only needs to hold in[num_channels][count]
+    wav_read_range(cfg, "audio.wav", offset, count, in);
+
+    // A range of an existing file can be overwritten in place, the rest of the file is left as it is
+    wav_write_range(cfg, "audio.wav", offset, count, in, 1.0f);
+
     // Don't forget to deallocate the in buffer when you're done
     for (size_t ch = 0; ch < cfg.nc; ch++)
         free(in[ch]);
@@ -58,30 +98,15 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <errno.h>
+#include <math.h>
 
-#define WAV_KEY_SIZE    4 //!< Size of the header tags in a wav file
-#define WAV_VALUE_SIZE  1 //!< Number of values to read/write each (read/write)_val call
-#define WAV_HEADER_SIZE 25//!< Size of the wav header section
-#define WAV_DATA_OFFSET 44//!< Offset to the channel data in a wav file
-
-#define check_error(error, description, retval)                                 \
-    do {                                                                        \
-        if ((error)) {                                                          \
-            fprintf(stderr, "%s [%s:%d]\n", (description), __FILE__, __LINE__); \
-            return (retval);                                                    \
-        }                                                                       \
-    } while (0);
-
-#define die(msg)                                                                         \
-    do {                                                                                 \
-        fprintf(stderr, "%s: %s [%s:%d]\n", (msg), strerror(errno), __FILE__, __LINE__); \
-        exit(EXIT_FAILURE);                                                              \
-    } while (0);
-
-#define write_key(key, file) fwrite((key), sizeof(*(key)), WAV_KEY_SIZE, (file))  //!< Write a key to the wav file
-#define write_val(val, file) fwrite(&(val), sizeof((val)), WAV_VALUE_SIZE, (file))//!< Write a value to the wav file
-#define read_val(val, file)  fread(&(val), sizeof((val)), WAV_VALUE_SIZE, (file)) //!< Read a key from the wav file
-#define read_key(key, file)  fread((key), sizeof(*(key)), WAV_KEY_SIZE, (file))   //!< Read a value from the wav file
+#define WAV_HEADER_SIZE 25         //!< Number of entries of a wav header, returned by wav_write_header() on success
+#define WAV_DATA_OFFSET 44         //!< Offset to the channel data in a wav file with the classic RIFF header
+#define WAV_BLOCK_SIZE  65536      //!< Size in bytes of the buffer samples are encoded into before each fwrite
+#define WAV_RIFF_MAX    0xFFFFFFFFu//!< Largest 32-bit size, RF64 stores it in place of the sizes kept in ds64
+#define WAV_DS64_SIZE   36         //!< Size of the ds64 chunk of RF64 files and of the JUNK chunk holding its place
+#define WAV_W64_HEADER  104        //!< Size of a Wave64 header, every chunk has a 16 byte GUID and a 64-bit size
+#define WAV_MAX_HEADER  104        //!< Size of the largest header written, the Wave64 one
 
 /**
  * @brief Error checked version of malloc 
@@ -89,28 +114,7 @@
  * @param size Number of bytes to allocate
  * @return Pointer to the beginning of newly allocated memory
  */
-void *wav_malloc(size_t size) {
-    void *v;
-    if (!(v = malloc(size)))
-        die("malloc()");
-
-    return v;
-}
-
-/**
- * @brief Error checked version of fopen
- * 
- * @param filename File name to associate the file stream to 
- * @param mode NULL-terminated character string determining file access mode
- * @return Pointer to the new file stream
- */
-FILE *wav_fopen(const char *filename, const char *mode) {
-    FILE *f;
-    if (!(f = fopen(filename, mode)))
-        die("fopen()");
-
-    return f;
-}
+void *wav_malloc(size_t size);
 
 /**
  * @brief Error checked version of fseek
@@ -119,26 +123,22 @@ FILE *wav_fopen(const char *filename, const char *mode) {
  * @param offset  Number of characters to shift the position relative to origin 
  * @param origin  Position to which offset is added. It can have one of the following values: SEEK_SET, SEEK_CUR, SEEK_END
  */
-void wav_fseek(FILE *stream, long offset, int origin) {
-    int ret;
-    if (!(ret = fseek(stream, offset, origin)))
-        die("fseek()");
-}
+void wav_fseek(FILE *stream, long offset, int origin);
 
 /** Header for a wav file */
 struct wav_header {
     /** RIFF section is the magic tag + entire file size */
     struct RIFF {
         const char *title;//!< RIFF tag
-        uint32_t size;    //!< size of entire wav file in bytes
+        uint64_t size;    //!< size of entire wav file in bytes minus the RIFF tag and size
     } RIFF;
 
     /** WAVE section is the configuration for the wave file */
     struct WAVE {
         const char *title;              //!< WAVE tag
         const char *marker;             //!< fmt\x20 tag
-        uint32_t cksize;                //!< Idk what this is
-        uint16_t WAVE_FORMAT_EXTENSIBLE;//!< Idk what this is
+        uint32_t cksize;                //!< Size of the fmt chunk that follows
+        uint16_t WAVE_FORMAT_EXTENSIBLE;//!< Sample format, 1 for PCM and 3 for IEEE float
         uint16_t num_channels;          //!< Number of channels
         uint32_t sample_rate;           //!< Sample rate
         uint32_t avg_bytes_per_sec;     //!< Average bytes per second (Sample Rate * bitDepth * Channels) / 8
@@ -149,7 +149,7 @@ struct wav_header {
     /** DATA section stores the actual channel data and its size */
     struct DATA {
         const char *title;//!< data tag
-        uint32_t size;    //!< Size in bytes of channel data
+        uint64_t size;    //!< Size in bytes of channel data
     } DATA;
 
     struct RIFF riff;
@@ -158,6 +158,17 @@ struct wav_header {
 };
 typedef struct wav_header wav_header;
 
+/**
+ * @brief Fill in a WavHeader, stack allocated headers need no wav_header_free() (internal use only)
+ *
+ * @param header Header to fill in
+ * @param nc Number of channels
+ * @param ns Number of samples
+ * @param sr Sample rate
+ * @param bd Bit depth
+ */
+void wav_header_init(wav_header *header, uint16_t nc, uint64_t ns, uint32_t sr, uint16_t bd);
+
 /**
  * @brief Create a new WavHeader (internal use only)
  * 
@@ -167,56 +178,162 @@ typedef struct wav_header wav_header;
  * @param bd Bit depth
  * @return Wav header usable for writing
  */
-wav_header *wav_header_new(uint16_t nc, uint32_t ns, uint32_t sr, uint16_t bd) {
-    wav_header *header = wav_malloc(sizeof(*header));
-
-    uint16_t M = bd / 8;
-
-    // RIFF
-    header->riff.title = "RIFF";
-    header->riff.size  = 28 + 8 + (M * nc * ns);
-    // if our file size is odd we padd it with one byte
-    if (header->riff.size % 2 != 0) header->riff.size++;
-
-    // WAVE
-    header->wave.title                  = "WAVE";
-    header->wave.marker                 = "fmt\x20";
-    header->wave.cksize                 = 16;
-    header->wave.WAVE_FORMAT_EXTENSIBLE = (bd == 32) ? 3 : 1;
-    header->wave.num_channels           = nc;
-    header->wave.sample_rate            = sr;
-    header->wave.avg_bytes_per_sec      = (sr * bd * nc) / 8;
-    header->wave.n_block_align          = M * nc;
-    header->wave.bits_per_sample        = bd;
-
-    // DATA
-    header->data.title = "data";
-    header->data.size  = M * nc * ns;
-
-    return header;
-}
+wav_header *wav_header_new(uint16_t nc, uint64_t ns, uint32_t sr, uint16_t bd);
 
 /**
  * @brief Deallocate a WavHeader (internal use only)
  * 
  * @param header Wav header to free
  */
-void wav_header_free(wav_header *header) {
-    if (header)
-        free(header), header = NULL;
-    else
-        fprintf(stderr, "Failed to free WaveHeader!\n");
-}
+void wav_header_free(wav_header *header);
+
+/** Container a wav file is written in */
+enum wav_format {
+    WAV_AUTO,//!< RIFF when every size fits in 32 bits, RF64 otherwise
+    WAV_RIFF,//!< Classic RIFF WAVE, limited to 4 GiB
+    WAV_RF64,//!< RIFF with 64-bit sizes in a ds64 chunk, read by broadcast tools and most editors
+    WAV_W64, //!< Sony Wave64, GUID chunk ids and 64-bit sizes throughout
+};
 
 /** Configuration for wav_writer and wav_reader */
 struct wav_config {
-    uint16_t nc;//!< Number of channels
-    uint32_t ns;//!< Number of samples
-    uint32_t sr;//!< Sample rate
-    uint16_t bd;//!< Bit depth
+    uint16_t nc;           //!< Number of channels
+    uint64_t ns;           //!< Number of samples
+    uint32_t sr;           //!< Sample rate
+    uint16_t bd;           //!< Bit depth
+    enum wav_format format;//!< Container to write, set to the container of the file by wav_get_header()
+    uint64_t offset;       //!< Offset of the samples in the file set by wav_get_header(), 0 reads from WAV_DATA_OFFSET
+    size_t block;          //!< Bytes encoded or decoded before each fwrite or fread, 0 is WAV_BLOCK_SIZE
 };
 typedef struct wav_config wav_config;
 
+/** Bytes padding ns samples to the chunk alignment of a container, 2 for RIFF and RF64, 8 for Wave64 (internal use only) */
+size_t wav_pad_size(wav_config cfg, enum wav_format format, uint64_t ns);
+
+/**
+ * @brief Check whether the RIFF sizes of ns samples fit in 32 bits (internal use only)
+ *
+ * @param cfg Configuration of the file
+ * @param ns Number of samples
+ * @param reserve The header holds a JUNK chunk in place of a ds64 chunk
+ * @return 1 if a RIFF header can describe the file, 0 if it needs RF64
+ */
+int wav_fits_riff(wav_config cfg, uint64_t ns, int reserve);
+
+/**
+ * @brief Encode the header of a file of ns samples (internal use only)
+ *
+ * A reserved RIFF header and an RF64 header have the same layout, so a file can be turned into RF64
+ * by rewriting its header once the data turns out larger than 4 GiB.
+ *
+ * @param cfg Configuration of the file
+ * @param format Container, must not be WAV_AUTO
+ * @param ns Number of samples
+ * @param reserve Put a JUNK chunk the size of a ds64 chunk in a RIFF header
+ * @param out Destination of at most WAV_MAX_HEADER bytes
+ * @return Size of the header in bytes, the offset of the samples
+ */
+size_t wav_header_encode(wav_config cfg, enum wav_format format, uint64_t ns, int reserve, uint8_t *out);
+
+/**
+ * @brief Write the header of a wav file
+ *
+ * With cfg.format set to WAV_AUTO the header is RIFF, or RF64 when cfg.ns samples don't fit in 4 GiB.
+ *
+ * @see wav_write_samples()
+ * @param cfg Configuration for the wav writer, cfg.ns must be the total number of samples that will be written
+ * @param file File stream positioned at the start of the file
+ * @return WAV_HEADER_SIZE on success, 0 on failure
+ */
+int wav_write_header(wav_config cfg, FILE *file);
+
+/**
+ * @brief Quantize floats to signed 16-bit PCM
+ *
+ * @param src Samples to quantize
+ * @param dst Destination of the first sample, sample i is stored at dst[i * stride]
+ * @param n Number of samples
+ * @param stride Distance between two destination samples, the number of channels
+ * @param scale Factor applied to every sample, folded into the quantization step
+ */
+void wav_quantize_16(const float *src, int16_t *dst, size_t n, size_t stride, float scale);
+
+/**
+ * @brief Quantize floats to signed 24-bit PCM, rounding half away from zero like lround()
+ *
+ * Samples outside of [-1.0, 1.0] are clamped to the largest 24-bit values instead of wrapping around.
+ *
+ * @param src Samples to quantize
+ * @param dst Destination of the first sample, sample i is stored at dst + i * stride * 3
+ * @param n Number of samples
+ * @param stride Distance in samples between two destination samples, the number of channels
+ * @param scale Factor applied to every sample, folded into the quantization step
+ */
+void wav_quantize_24(const float *src, uint8_t *dst, size_t n, size_t stride, float scale);
+
+/**
+ * @brief Interleave and encode samples of every channel into a block buffer
+ *
+ * Generic kernel of every channel count, wav_get_encoder() picks faster ones for mono and stereo.
+ *
+ * @param cfg Configuration for the wav writer
+ * @param data Deinterleaved multi-channel audio data
+ * @param offset Index of the first sample to encode
+ * @param ns Number of samples per channel to encode
+ * @param scale Factor applied to every sample, 1 stores the samples as they are
+ * @param block Destination of ns * cfg.nc * cfg.bd / 8 bytes
+ */
+void wav_encode_block(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block);
+
+/** Encoder of one bit depth and channel count, same parameters as wav_encode_block() */
+typedef void (*wav_encoder)(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block);
+
+/**
+ * @brief Pick the encoder of a configuration once, before a run of blocks is encoded
+ *
+ * Mono and stereo files of every bit depth get a specialized kernel, other channel counts wav_encode_block().
+ *
+ * @param cfg Configuration for the wav writer
+ * @return Encoder to call with cfg for every block
+ */
+wav_encoder wav_get_encoder(wav_config cfg);
+
+/** Samples per channel encoded into one cfg.block buffer (internal use only) */
+size_t wav_block_samples(wav_config cfg);
+
+/**
+ * @brief Append a block of audio data after the header of a wav file
+ *
+ * Blocks can be written one after another as long as they add up to cfg.ns samples.
+ * Samples are encoded into cfg.block byte buffers, WAV_BLOCK_SIZE by default, each flushed with a single fwrite.
+ *
+ * @see wav_write_header()
+ * @see wav_write_pad()
+ * @param cfg Configuration for the wav writer
+ * @param file File stream positioned after the previous block
+ * @param data Deinterleaved multi-channel audio data of the block
+ * @param ns Number of samples per channel in the block
+ * @param scale Factor applied to every sample while it is encoded, normalizing without another pass over the data
+ * @return Number of samples written
+ */
+size_t wav_write_samples_scaled(wav_config cfg, FILE *file, float *const *data, size_t ns, float scale);
+
+/**
+ * @brief Append a block of audio data after the header of a wav file
+ *
+ * @see wav_write_samples_scaled()
+ * @return Number of samples written
+ */
+size_t wav_write_samples(wav_config cfg, FILE *file, float *const *data, size_t ns);
+
+/**
+ * @brief Pad the audio data of a wav file to an even size, or a multiple of 8 for Wave64, once every sample is written
+ *
+ * @param cfg Configuration for the wav writer
+ * @param file File stream positioned after the last block
+ */
+void wav_write_pad(wav_config cfg, FILE *file);
+
 /**
  * @brief Write audio data to a wav file
  * 
@@ -225,230 +342,1261 @@ typedef struct wav_config wav_config;
  * @param data Deinterleaved multi-channel Audio data to write to our wav file
  * @return Number of samples written
  */
-int wav_write(wav_config cfg, const char *path, float *const *data) {
-    int n = 0;
-
-    check_error(!path, "Path pointer must not be NULL!", n);
-    check_error(!data, "Data pointer must not be NULL!", n);
-    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", n);
-    check_error(cfg.ns == 0, "Number of samples must be greater than 0.", n);
-    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", n);
-    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", n);
-
-    FILE *file = wav_fopen(path, "wb");
-
-    wav_header *header = wav_header_new(cfg.nc, cfg.ns, cfg.sr, cfg.bd);
+size_t wav_write(wav_config cfg, const char *path, float *const *data);
 
-    // RIFF
-    n += write_key(header->riff.title, file);
-    n += write_val(header->riff.size, file);
-
-    // WAVE
-    n += write_key(header->wave.title, file);
-    n += write_key(header->wave.marker, file);
-    n += write_val(header->wave.cksize, file);
-    n += write_val(header->wave.WAVE_FORMAT_EXTENSIBLE, file);
-    n += write_val(header->wave.num_channels, file);
-    n += write_val(header->wave.sample_rate, file);
-    n += write_val(header->wave.avg_bytes_per_sec, file);
-    n += write_val(header->wave.n_block_align, file);
-    n += write_val(header->wave.bits_per_sample, file);
+/** Wav file written incrementally, the header sizes are patched in by wav_writer_close() */
+typedef struct wav_writer wav_writer;
 
-    // DATA
-    n += write_key(header->data.title, file);
-    n += write_val(header->data.size, file);
+/**
+ * @brief Open a wav file for incremental writing
+ *
+ * With cfg.format set to WAV_AUTO the file is RIFF and the header keeps room for a ds64 chunk,
+ * so wav_writer_close() can turn it into RF64 if more than 4 GiB were appended. Files that
+ * cfg.ns says will fit get the classic 44 byte header instead.
+ *
+ * @see wav_writer_append()
+ * @see wav_writer_close()
+ * @param cfg Configuration for the wav writer, cfg.ns is the expected number of samples, 0 if unknown
+ * @param path Destination path for the output file
+ * @return Writer or NULL on failure
+ */
+wav_writer *wav_writer_open(wav_config cfg, const char *path);
 
-    check_error(n != 25, "Header must equal 25 bytes.", n);
+/**
+ * @brief Start writing a wav file to an open stream that can't seek, like a pipe
+ *
+ * @see wav_writer_append()
+ * @see wav_writer_close()
+ * @param cfg Configuration for the wav writer, cfg.ns must be the total number of samples that will be appended,
+ *            WAV_AUTO picks RF64 when they don't fit in 4 GiB
+ * @param file Output stream opened in binary mode, it stays open after wav_writer_close()
+ * @return Writer or NULL on failure
+ */
+wav_writer *wav_writer_open_stream(wav_config cfg, FILE *file);
 
-    // append our actual audio data
-    n = 0;
-    switch (cfg.bd) {
-        case 32:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++) {
-                    n += write_val(data[ch][i], file);
-                }
-            }
-            break;
-        case 24:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++) {
-                    const int32_t v = lround(data[ch][i] * 0x7FFFFF) & 0xFFFFFF;
-                    n += fwrite(&v, 24 / 8 /* 3 bytes */, 1, file);
-                }
-            }
-            break;
-        case 16:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++) {
-                    int32_t v = (int32_t) (data[ch][i] * 32768.0f);
-                    // clamp v between [-32768, 32767]
-                    if (v < -32768) v = -32768;
-                    if (v > 32767) v = 32767;
-                    n += fwrite(&v, sizeof(int16_t), 1, file);
-                }
-            }
-            break;
-        case 8:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++) {
-                    uint8_t v = (uint8_t) (128 + ((uint8_t) (data[ch][i] * (127.0f))));
-                    n += fwrite(&v, sizeof(uint8_t), 1, file);
-                }
-            }
-            break;
-    }
+/**
+ * @brief Append audio data multiplied by a factor to a wav file opened with wav_writer_open()
+ *
+ * @param writer Writer to append to
+ * @param data Deinterleaved multi-channel audio data
+ * @param ns Number of samples per channel to append
+ * @param scale Factor applied to every sample while it is encoded
+ * @return Number of samples written
+ */
+size_t wav_writer_append_scaled(wav_writer *writer, float *const *data, size_t ns, float scale);
 
-    // pad an extra byte if needed
-    char padding = 0;
-    if (header->data.size % 2 != 0) write_val(padding, file);
+/**
+ * @brief Append audio data to a wav file opened with wav_writer_open()
+ *
+ * @param writer Writer to append to
+ * @param data Deinterleaved multi-channel audio data
+ * @param ns Number of samples per channel to append
+ * @return Number of samples written
+ */
+size_t wav_writer_append(wav_writer *writer, float *const *data, size_t ns);
 
-    wav_header_free(header);
+/**
+ * @brief Push the samples appended so far out of the stdio buffers
+ *
+ * A reader of the file or pipe gets them right away instead of once a buffer fills up.
+ *
+ * @param writer Writer to flush
+ * @return 1 on success, 0 on failure
+ */
+int wav_writer_flush(wav_writer *writer);
 
-    fclose(file);
+/**
+ * @brief Finish a wav file, patch the RIFF and data sizes into its header and free the writer
+ *
+ * A RIFF file with a reserved JUNK chunk whose data passed 4 GiB is rewritten as RF64.
+ * Streams opened with wav_writer_open_stream() are flushed instead of patched and closed.
+ *
+ * @param writer Writer to close
+ * @return Number of samples in the file, 0 on failure
+ */
+size_t wav_writer_close(wav_writer *writer);
 
-    return n / cfg.nc;
-}
+/**
+ * @brief Seek to a 64-bit offset from the start of a file (internal use only)
+ *
+ * @param file File stream to seek
+ * @param offset Offset in bytes
+ * @return 0 on success, like fseek()
+ */
+int wav_fseek64(FILE *file, uint64_t offset);
 
 /**
  * @brief Read a wav file configuration
+ *
+ * RIFF, RF64 and Wave64 files are understood. Chunks other than fmt, ds64 and data,
+ * like the JUNK chunk of files written by wav_writer_open(), are skipped.
  * 
  * @see wav_read()
- * @param cfg Pointer to store wav file configuration
+ * @param cfg Pointer to store wav file configuration, cfg->format and cfg->offset tell where the samples are
  * @param path Path to the wav file to read
- * @return int Number of data entries read;
+ * @return WAV_HEADER_SIZE on success, 0 on failure
  */
-int wav_get_header(wav_config *cfg, const char *path) {
-    wav_header header;
-    char key[4];
-    int n = 0;
+int wav_get_header(wav_config *cfg, const char *path);
 
-    check_error(!cfg, "Wav config must not be NULL!", n);
-    check_error(!path, "Path pointer must not be NULL!", n);
-
-    FILE *file = wav_fopen(path, "rb");
+/** Read only memory mapping of a byte range of a file */
+struct wav_view {
+    const uint8_t *data;//!< First byte of the requested range
+    void *base;         //!< Start of the mapping, aligned to the mapping granularity
+    size_t length;      //!< Length of the mapping from base
+};
+typedef struct wav_view wav_view;
 
-    // RIFF
-    n += read_key(key, file);
-    check_error(strncmp(key, "RIFF", 4) != 0, "Invalid RIFF section.", n);
-    n += read_val(header.riff.size, file);
+/**
+ * @brief Size of a file (internal use only)
+ *
+ * @param path Path of the file
+ * @param size Pointer to store the size in bytes
+ * @return 1 on success, 0 on failure
+ */
+int wav_file_size(const char *path, uint64_t *size);
 
-    // WAVE
-    n += read_key(key, file);
-    check_error(strncmp(key, "WAVE", 4) != 0, "Invalid WAVE section.", n);
-    n += read_key(key, file);
-    check_error(strncmp(key, "fmt\x20", 4) != 0, "Invalid WAVE section.", n);
-    n += read_val(header.wave.cksize, file);
-    n += read_val(header.wave.WAVE_FORMAT_EXTENSIBLE, file);
-    n += read_val(header.wave.num_channels, file);
-    n += read_val(header.wave.sample_rate, file);
-    n += read_val(header.wave.avg_bytes_per_sec, file);
-    n += read_val(header.wave.n_block_align, file);
-    n += read_val(header.wave.bits_per_sample, file);
+/**
+ * @brief Map a byte range of a file into memory (internal use only)
+ *
+ * Only the requested range is mapped so large files never have to fit in the address space.
+ *
+ * @param view Pointer to store the mapping
+ * @param path Path of the file
+ * @param offset Offset in bytes of the range
+ * @param length Length in bytes of the range, must be greater than 0
+ * @return 1 on success, 0 if the file couldn't be mapped
+ */
+int wav_map(wav_view *view, const char *path, uint64_t offset, size_t length);
 
-    // DATA
-    n += read_key(key, file);
-    check_error(strncmp(key, "data", 4) != 0, "Invalid data section.", n);
-    n += read_val(header.data.size, file);
+/**
+ * @brief Unmap a range mapped with wav_map() (internal use only)
+ *
+ * @param view Mapping to release
+ */
+void wav_unmap(wav_view *view);
 
-    check_error(n != WAV_HEADER_SIZE, "Invalid wave header size", n);
+/**
+ * @brief Deinterleave and decode encoded samples into channel data
+ *
+ * Generic kernel of every channel count, wav_get_decoder() picks faster ones for mono and stereo.
+ *
+ * @param cfg Configuration for the wav reader
+ * @param src Encoded interleaved samples, ns * cfg.nc * cfg.bd / 8 bytes
+ * @param ns Number of samples per channel to decode
+ * @param data Array of channels to write data to
+ * @param offset Index in every channel of the first decoded sample
+ */
+void wav_decode_block(wav_config cfg, const uint8_t *src, size_t ns, float **data, size_t offset);
 
-    cfg->nc = header.wave.num_channels;
-    cfg->bd = header.wave.bits_per_sample;
-    cfg->sr = header.wave.sample_rate;
-    cfg->ns = header.data.size / (cfg->nc * cfg->bd / 8);// ns = size / (nc * M)
+/** Decoder of one bit depth and channel count, same parameters as wav_decode_block() */
+typedef void (*wav_decoder)(wav_config cfg, const uint8_t *src, size_t ns, float **data, size_t offset);
 
-    fclose(file);
+/**
+ * @brief Pick the decoder of a configuration once, before a run of blocks is decoded
+ *
+ * Mono and stereo files of every bit depth get a specialized kernel, other channel counts wav_decode_block().
+ *
+ * @param cfg Configuration for the wav reader
+ * @return Decoder to call with cfg for every block
+ */
+wav_decoder wav_get_decoder(wav_config cfg);
 
-    return n;
-}
+/**
+ * @brief Read a range of audio data from a wav file
+ *
+ * The range is decoded straight from a memory mapping of just that part of the file,
+ * falling back to buffered reads when the file can't be mapped.
+ *
+ * @see wav_get_header()
+ * @param cfg Configuration for the wav reader
+ * @param path Path for the input file
+ * @param offset Index of the first sample to read
+ * @param count Number of samples per channel to read
+ * @param data Array of channels to write data to, sample offset is stored at data[ch][0]
+ * @return Number of samples read, less than count if the file ends before the range
+ */
+size_t wav_read_range(wav_config cfg, const char *path, size_t offset, size_t count, float **data);
 
 /**
  * @brief Read audio data from a wav file
  * 
  * @see wav_get_header()
+ * @see wav_read_range()
  * @param cfg Configuration for the wav reader
  * @param path Path for the input file
  * @param data Array of channels to write data to
  * @return Number of samples read
  */
-int wav_read(wav_config cfg, const char *path, float **data) {
-    uint16_t M = cfg.bd / 8;
-    int n      = 0;
-    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", n);
-    check_error(cfg.ns == 0, "Number of samples must be greater than 0.", n);
-    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", n);
-    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", n);
-    check_error(!path, "Path pointer must not be NULL!", n);
-    check_error(!data, "Data pointer must not be NULL!", n);
-    for (size_t ch = 0; ch < cfg.nc; ch++)
-        check_error(!data[ch], "Data channel pointers must not be NULL!", n);
+size_t wav_read(wav_config cfg, const char *path, float **data);
 
-    FILE *file = wav_fopen(path, "rb");
-
-    // Move to start of our float data
-    wav_fseek(file, WAV_DATA_OFFSET, SEEK_SET);
+/**
+ * @brief Overwrite a range of audio data of an existing wav file in place
+ *
+ * Only the bytes of the range are written, the header and every other sample are left as they are.
+ *
+ * @see wav_get_header()
+ * @param cfg Configuration of the file from wav_get_header()
+ * @param path Path of the wav file to modify
+ * @param offset Index of the first sample to overwrite
+ * @param count Number of samples per channel to overwrite
+ * @param data Deinterleaved multi-channel audio data, sample offset is stored at data[ch][0]
+ * @param scale Factor applied to every sample while it is encoded
+ * @return Number of samples written, less than count if the range passes the end of the file
+ */
+size_t wav_write_range(wav_config cfg, const char *path, size_t offset, size_t count, float *const *data, float scale);
 
-    // Memory map the channel data for fast processing
-    uint8_t *map = wav_malloc(sizeof(*map) * (size_t) cfg.ns * (size_t) cfg.nc * (size_t) M);
-    uint8_t *mp  = map;
+#ifdef WAV_IMPLEMENTATION
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
-    // Read channel data into memory
-    n = fread(map, sizeof(*map), cfg.ns * cfg.nc * M, file);
-    check_error(n != cfg.ns * cfg.nc * M, "Failed to read into map.", n);
-    n /= M * cfg.nc;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define WAV_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #define WAV_NEON
+    #include <arm_neon.h>
+#endif
 
-    switch (cfg.bd) {
-        case 32:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
-                    memcpy(&data[ch][i], mp, M);
-                }
-            }
-            break;
-        case 24:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
-                    int32_t v = 0;
-                    long l1   = 0;
-                    memcpy(&v, mp, M);
-                    memcpy(((unsigned char *) &l1) + 1, &v, M);
-                    data[ch][i] = (float) l1 * 0x1p-31f;
-                }
-            }
-            break;
-        case 16:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
-                    int16_t v = 0;
-                    memcpy(&v, mp, M);
-                    data[ch][i] = v * 0x1p-15f;
-                }
-            }
-            break;
-        case 8:
-            for (size_t i = 0; i < cfg.ns; i++) {
-                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
-                    uint8_t v = 0;
-                    memcpy(&v, mp, M);
-                    data[ch][i] = (v - 128) * 0x1p-7f;
-                }
-            }
-            break;
-    }
+#define WAV_VALUE_SIZE  1          //!< Number of values to read each read_val call
 
-    free(map);
+#define check_error(error, description, retval)                                 \
+    do {                                                                        \
+        if ((error)) {                                                          \
+            fprintf(stderr, "%s [%s:%d]\n", (description), __FILE__, __LINE__); \
+            return (retval);                                                    \
+        }                                                                       \
+    } while (0);
 
-    return n;
-}
+#define die(msg)                                                                         \
+    do {                                                                                 \
+        fprintf(stderr, "%s: %s [%s:%d]\n", (msg), strerror(errno), __FILE__, __LINE__); \
+        exit(EXIT_FAILURE);                                                              \
+    } while (0);
+
+#define read_val(val, file) fread(&(val), sizeof((val)), WAV_VALUE_SIZE, (file))//!< Read a value from the wav file
+
+void *wav_malloc(size_t size) {
+    void *v;
+    if (!(v = malloc(size)))
+        die("malloc()");
+
+    return v;
+}
+
+/**
+ * @brief Error checked version of fopen
+ * 
+ * @param filename File name to associate the file stream to 
+ * @param mode NULL-terminated character string determining file access mode
+ * @return Pointer to the new file stream
+ */
+FILE *wav_fopen(const char *filename, const char *mode) {
+    FILE *f;
+    if (!(f = fopen(filename, mode)))
+        die("fopen()");
+
+    return f;
+}
+
+void wav_fseek(FILE *stream, long offset, int origin) {
+    if (fseek(stream, offset, origin) != 0)
+        die("fseek()");
+}
+
+void wav_header_init(wav_header *header, uint16_t nc, uint64_t ns, uint32_t sr, uint16_t bd) {
+    uint16_t M = bd / 8;
+
+    // RIFF
+    header->riff.title = "RIFF";
+    header->riff.size  = 28 + 8 + ((uint64_t) M * nc * ns);
+    // if our file size is odd we padd it with one byte
+    if (header->riff.size % 2 != 0) header->riff.size++;
+
+    // WAVE
+    header->wave.title                  = "WAVE";
+    header->wave.marker                 = "fmt\x20";
+    header->wave.cksize                 = 16;
+    header->wave.WAVE_FORMAT_EXTENSIBLE = (bd == 32) ? 3 : 1;
+    header->wave.num_channels           = nc;
+    header->wave.sample_rate            = sr;
+    header->wave.avg_bytes_per_sec      = (sr * bd * nc) / 8;
+    header->wave.n_block_align          = M * nc;
+    header->wave.bits_per_sample        = bd;
+
+    // DATA
+    header->data.title = "data";
+    header->data.size  = (uint64_t) M * nc * ns;
+}
+
+wav_header *wav_header_new(uint16_t nc, uint64_t ns, uint32_t sr, uint16_t bd) {
+    wav_header *header = wav_malloc(sizeof(*header));
+    wav_header_init(header, nc, ns, sr, bd);
+
+    return header;
+}
+
+void wav_header_free(wav_header *header) {
+    if (header)
+        free(header), header = NULL;
+    else
+        fprintf(stderr, "Failed to free WaveHeader!\n");
+}
+
+/** GUIDs of the Wave64 chunks, the first 4 bytes spell the matching RIFF tag */
+static const uint8_t wav_w64_riff[16] = {'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t wav_w64_wave[16] = {'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t wav_w64_fmt[16]  = {'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t wav_w64_data[16] = {'d', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+/** Copy n bytes to p and return the byte after them (internal use only) */
+uint8_t *wav_put(uint8_t *p, const void *src, size_t n) {
+    memcpy(p, src, n);
+
+    return p + n;
+}
+
+/** Store a little-endian 32-bit value (internal use only) */
+uint8_t *wav_put_32(uint8_t *p, uint32_t v) {
+    return wav_put(p, &v, sizeof(v));
+}
+
+/** Store a little-endian 64-bit value (internal use only) */
+uint8_t *wav_put_64(uint8_t *p, uint64_t v) {
+    return wav_put(p, &v, sizeof(v));
+}
+
+size_t wav_pad_size(wav_config cfg, enum wav_format format, uint64_t ns) {
+    const uint64_t data = (uint64_t) cfg.bd / 8 * cfg.nc * ns;
+
+    return (format == WAV_W64) ? (size_t) ((8 - data % 8) % 8) : (size_t) (data % 2);
+}
+
+int wav_fits_riff(wav_config cfg, uint64_t ns, int reserve) {
+    // the largest ns doesn't overflow: 2^64 / (65535 channels * 4 bytes) samples are far beyond any file
+    wav_header h;
+    wav_header_init(&h, cfg.nc, ns, cfg.sr, cfg.bd);
+
+    return h.riff.size + (reserve ? WAV_DS64_SIZE : 0) <= WAV_RIFF_MAX;
+}
+
+/** Container wav_write() and streams of cfg.ns samples are written in (internal use only) */
+enum wav_format wav_resolve_format(wav_config cfg) {
+    if (cfg.format != WAV_AUTO) return cfg.format;
+
+    return wav_fits_riff(cfg, cfg.ns, 0) ? WAV_RIFF : WAV_RF64;
+}
+
+size_t wav_header_encode(wav_config cfg, enum wav_format format, uint64_t ns, int reserve, uint8_t *out) {
+    wav_header h;
+    wav_header_init(&h, cfg.nc, ns, cfg.sr, cfg.bd);
+
+    // fmt payload shared by every container
+    uint8_t fmt[16];
+    uint8_t *f = fmt;
+    f          = wav_put(f, &h.wave.WAVE_FORMAT_EXTENSIBLE, 2);
+    f          = wav_put(f, &h.wave.num_channels, 2);
+    f          = wav_put(f, &h.wave.sample_rate, 4);
+    f          = wav_put(f, &h.wave.avg_bytes_per_sec, 4);
+    f          = wav_put(f, &h.wave.n_block_align, 2);
+    wav_put(f, &h.wave.bits_per_sample, 2);
+
+    uint8_t *p = out;
+    if (format == WAV_W64) {
+        // sizes count the 24 bytes of GUID and size, the riff size is the whole file
+        p = wav_put(p, wav_w64_riff, 16);
+        p = wav_put_64(p, WAV_W64_HEADER + h.data.size + wav_pad_size(cfg, format, ns));
+        p = wav_put(p, wav_w64_wave, 16);
+        p = wav_put(p, wav_w64_fmt, 16);
+        p = wav_put_64(p, 24 + sizeof(fmt));
+        p = wav_put(p, fmt, sizeof(fmt));
+        p = wav_put(p, wav_w64_data, 16);
+        p = wav_put_64(p, 24 + h.data.size);
+
+        return (size_t) (p - out);
+    }
+
+    const int rf64      = format == WAV_RF64;
+    const uint64_t riff = h.riff.size + ((rf64 || reserve) ? WAV_DS64_SIZE : 0);
+    p                   = wav_put(p, rf64 ? "RF64" : h.riff.title, 4);
+    p                   = wav_put_32(p, rf64 ? WAV_RIFF_MAX : (uint32_t) riff);
+    p                   = wav_put(p, h.wave.title, 4);
+    if (rf64 || reserve) {
+        p = wav_put(p, rf64 ? "ds64" : "JUNK", 4);
+        p = wav_put_32(p, WAV_DS64_SIZE - 8);
+        p = wav_put_64(p, rf64 ? riff : 0);
+        p = wav_put_64(p, rf64 ? h.data.size : 0);
+        p = wav_put_64(p, rf64 ? ns : 0);
+        p = wav_put_32(p, 0);// no table of other chunk sizes
+    }
+    p = wav_put(p, h.wave.marker, 4);
+    p = wav_put_32(p, h.wave.cksize);
+    p = wav_put(p, fmt, sizeof(fmt));
+    p = wav_put(p, h.data.title, 4);
+    p = wav_put_32(p, rf64 ? WAV_RIFF_MAX : (uint32_t) h.data.size);
+
+    return (size_t) (p - out);
+}
+
+int wav_write_header(wav_config cfg, FILE *file) {
+    const enum wav_format format = wav_resolve_format(cfg);
+    check_error(format == WAV_RIFF && !wav_fits_riff(cfg, cfg.ns, 0), "Data larger than 4 GiB needs RF64 or Wave64.", 0);
+
+    uint8_t header[WAV_MAX_HEADER];
+    const size_t n = wav_header_encode(cfg, format, cfg.ns, 0, header);
+
+    return fwrite(header, 1, n, file) == n ? WAV_HEADER_SIZE : 0;
+}
+
+/** Quantize one sample to 16-bit PCM, x is multiplied by q (internal use only) */
+int16_t wav_sample_16(float x, float q) {
+    int32_t v = (int32_t) (x * q);
+    // clamp v between [-32768, 32767]
+    if (v < -32768) v = -32768;
+    if (v > 32767) v = 32767;
+
+    return (int16_t) v;
+}
+
+void wav_quantize_16(const float *src, int16_t *dst, size_t n, size_t stride, float scale) {
+    const float q = 32768.0f * scale;
+    size_t i      = 0;
+#if defined(WAV_SSE2)
+    const __m128 k = _mm_set1_ps(q);
+    for (; i + 8 <= n; i += 8) {
+        // truncate like the scalar cast, packs clamps to [-32768, 32767]
+        const __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), k));
+        const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), k));
+        const __m128i v = _mm_packs_epi32(a, b);
+        if (stride == 1) {
+            _mm_storeu_si128((__m128i *) (dst + i), v);
+        } else {
+            int16_t tmp[8];
+            _mm_storeu_si128((__m128i *) tmp, v);
+            for (size_t j = 0; j < 8; j++) dst[(i + j) * stride] = tmp[j];
+        }
+    }
+#elif defined(WAV_NEON)
+    const float32x4_t k = vdupq_n_f32(q);
+    for (; i + 8 <= n; i += 8) {
+        const int32x4_t a = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i), k));
+        const int32x4_t b = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i + 4), k));
+        const int16x8_t v = vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+        if (stride == 1) {
+            vst1q_s16(dst + i, v);
+        } else {
+            int16_t tmp[8];
+            vst1q_s16(tmp, v);
+            for (size_t j = 0; j < 8; j++) dst[(i + j) * stride] = tmp[j];
+        }
+    }
+#endif
+    for (; i < n; i++)
+        dst[i * stride] = wav_sample_16(src[i], q);
+}
+
+/** Quantize one sample to 24-bit PCM in the low bytes of an int, x is multiplied by q (internal use only) */
+int32_t wav_sample_24(float x, float q) {
+    x *= q;
+    if (x < -8388608.0f) x = -8388608.0f;
+    if (x > 8388607.0f) x = 8388607.0f;
+
+    return lround(x) & 0xFFFFFF;
+}
+
+#if defined(WAV_SSE2) || defined(WAV_NEON)
+/** Quantize 4 samples like wav_sample_24(), except that the values keep their sign bits (internal use only) */
+void wav_round_24(const float *src, float q, int32_t *dst) {
+    #if defined(WAV_SSE2)
+    // x - trunc(x) is exact in float, so adjusting the truncated value matches lround()
+    const __m128 s   = _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(q));
+    const __m128 x   = _mm_min_ps(_mm_max_ps(s, _mm_set1_ps(-8388608.0f)), _mm_set1_ps(8388607.0f));
+    const __m128i t  = _mm_cvttps_epi32(x);
+    const __m128 f   = _mm_sub_ps(x, _mm_cvtepi32_ps(t));
+    const __m128i up = _mm_castps_si128(_mm_cmpge_ps(f, _mm_set1_ps(0.5f)));
+    const __m128i dn = _mm_castps_si128(_mm_cmple_ps(f, _mm_set1_ps(-0.5f)));
+    _mm_storeu_si128((__m128i *) dst, _mm_add_epi32(_mm_sub_epi32(t, up), dn));
+    #else
+    const float32x4_t s = vmulq_f32(vld1q_f32(src), vdupq_n_f32(q));
+    const float32x4_t x = vminq_f32(vmaxq_f32(s, vdupq_n_f32(-8388608.0f)), vdupq_n_f32(8388607.0f));
+    const int32x4_t t   = vcvtq_s32_f32(x);
+    const float32x4_t f = vsubq_f32(x, vcvtq_f32_s32(t));
+    const int32x4_t up  = vreinterpretq_s32_u32(vcgeq_f32(f, vdupq_n_f32(0.5f)));
+    const int32x4_t dn  = vreinterpretq_s32_u32(vcleq_f32(f, vdupq_n_f32(-0.5f)));
+    vst1q_s32(dst, vaddq_s32(vsubq_s32(t, up), dn));
+    #endif
+}
+#endif
+
+void wav_quantize_24(const float *src, uint8_t *dst, size_t n, size_t stride, float scale) {
+    const float q = (float) 0x7FFFFF * scale;
+    size_t i      = 0;
+#if defined(WAV_SSE2) || defined(WAV_NEON)
+    int32_t tmp[4];
+    for (; i + 4 <= n; i += 4) {
+        wav_round_24(src + i, q, tmp);
+        for (size_t j = 0; j < 4; j++) memcpy(dst + (i + j) * stride * 3, &tmp[j], 3);
+    }
+#endif
+    for (; i < n; i++) {
+        const int32_t v = wav_sample_24(src[i], q);
+        memcpy(dst + i * stride * 3, &v, 3);
+    }
+}
+
+/** Quantize one sample to 8-bit PCM, x is multiplied by q (internal use only) */
+uint8_t wav_sample_8(float x, float q) {
+    // convert through int so negative samples wrap instead of being undefined
+    return (uint8_t) (128 + (int32_t) (x * q));
+}
+
+void wav_encode_block(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    const size_t nc = cfg.nc;
+    const float q8  = 127.0f * scale;
+
+    for (size_t ch = 0; ch < nc; ch++) {
+        const float *src = data[ch] + offset;
+        switch (cfg.bd) {
+            case 32:
+                if (nc == 1 && scale == 1.0f) {
+                    memcpy(block, src, ns * sizeof(*src));
+                } else {
+                    for (size_t i = 0; i < ns; i++) {
+                        const float v = src[i] * scale;
+                        memcpy(block + (i * nc + ch) * 4, &v, 4);
+                    }
+                }
+                break;
+            case 24:
+                wav_quantize_24(src, block + ch * 3, ns, nc, scale);
+                break;
+            case 16:
+                wav_quantize_16(src, (int16_t *) block + ch, ns, nc, scale);
+                break;
+            case 8:
+                for (size_t i = 0; i < ns; i++) block[i * nc + ch] = wav_sample_8(src[i], q8);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Define wav_encode_<BD>_<NC>(), encoding frames of NC channels with the scalar quantizer of BD bits
+ *
+ * NC is a constant, so the channel loop is unrolled and every frame is stored with fixed offsets.
+ * Q is the quantization step before the scale is applied.
+ */
+#define WAV_DEFINE_ENCODER(BD, NC, Q)                                                                                    \
+    void wav_encode_##BD##_##NC(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) { \
+        (void) cfg;                                                                                                      \
+        const float q = (Q) * scale;                                                                                     \
+        for (size_t ch = 0; ch < NC; ch++) {                                                                             \
+            const float *restrict src = data[ch] + offset;                                                               \
+            uint8_t *restrict dst     = block + ch * (BD / 8);                                                           \
+            for (size_t i = 0; i < ns; i++) wav_store_##BD(dst + i * (NC * BD / 8), src[i], q);                          \
+        }                                                                                                                \
+    }
+
+/** Store one 8-bit sample (internal use only) */
+void wav_store_8(uint8_t *dst, float x, float q) {
+    *dst = wav_sample_8(x, q);
+}
+
+/** Store one 32-bit float sample, q is the scale (internal use only) */
+void wav_store_32(uint8_t *dst, float x, float q) {
+    const float v = x * q;
+    memcpy(dst, &v, sizeof(v));
+}
+
+WAV_DEFINE_ENCODER(8, 1, 127.0f)
+WAV_DEFINE_ENCODER(32, 2, 1.0f)
+
+/** Encode stereo 8-bit PCM, both channels are quantized together and interleaved in registers (internal use only) */
+void wav_encode_8_2(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    const float *restrict l = data[0] + offset;
+    const float *restrict r = data[1] + offset;
+    uint8_t *restrict dst   = block;
+    const float q           = 127.0f * scale;
+    size_t i                = 0;
+#if defined(WAV_SSE2)
+    // keeping the low byte before packing wraps like the scalar conversion instead of saturating
+    const __m128 k     = _mm_set1_ps(q);
+    const __m128i bias = _mm_set1_epi32(128);
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    for (; i + 8 <= ns; i += 8) {
+        __m128i v[4];
+        for (size_t j = 0; j < 4; j++) {
+            const float *src = (j < 2 ? l : r) + i + (j % 2) * 4;
+            v[j]             = _mm_and_si128(_mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src), k)), bias), mask);
+        }
+        const __m128i a = _mm_packs_epi32(v[0], v[1]);
+        const __m128i b = _mm_packs_epi32(v[2], v[3]);
+        _mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_packus_epi16(_mm_unpacklo_epi16(a, b), _mm_unpackhi_epi16(a, b)));
+    }
+#elif defined(WAV_NEON)
+    // narrowing keeps the low byte, which wraps like the scalar conversion
+    const float32x4_t k  = vdupq_n_f32(q);
+    const int32x4_t bias = vdupq_n_s32(128);
+    for (; i + 8 <= ns; i += 8) {
+        uint8x8x2_t v;
+        for (size_t j = 0; j < 2; j++) {
+            const float *src   = j == 0 ? l : r;
+            const int32x4_t lo = vaddq_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i), k)), bias);
+            const int32x4_t hi = vaddq_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i + 4), k)), bias);
+            v.val[j]           = vmovn_u16(vreinterpretq_u16_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi))));
+        }
+        vst2_u8(dst + 2 * i, v);
+    }
+#endif
+    for (; i < ns; i++) {
+        dst[2 * i]     = wav_sample_8(l[i], q);
+        dst[2 * i + 1] = wav_sample_8(r[i], q);
+    }
+}
+
+/** Encode mono 32-bit floats, a plain copy unless the samples are scaled (internal use only) */
+void wav_encode_32_1(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    const float *restrict src = data[0] + offset;
+    float *restrict dst       = (float *) block;
+    if (scale == 1.0f) {
+        memcpy(dst, src, ns * sizeof(*src));
+        return;
+    }
+    for (size_t i = 0; i < ns; i++) dst[i] = src[i] * scale;
+}
+
+/** Encode mono 16-bit PCM (internal use only) */
+void wav_encode_16_1(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    wav_quantize_16(data[0] + offset, (int16_t *) block, ns, 1, scale);
+}
+
+/** Encode mono 24-bit PCM (internal use only) */
+void wav_encode_24_1(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    wav_quantize_24(data[0] + offset, block, ns, 1, scale);
+}
+
+/** Encode stereo 16-bit PCM, both channels are quantized together and interleaved in registers (internal use only) */
+void wav_encode_16_2(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    const float *restrict l = data[0] + offset;
+    const float *restrict r = data[1] + offset;
+    int16_t *restrict dst   = (int16_t *) block;
+    const float q           = 32768.0f * scale;
+    size_t i                = 0;
+#if defined(WAV_SSE2)
+    const __m128 k = _mm_set1_ps(q);
+    for (; i + 8 <= ns; i += 8) {
+        const __m128i a = _mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(l + i), k)),
+                                          _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(l + i + 4), k)));
+        const __m128i b = _mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(r + i), k)),
+                                          _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(r + i + 4), k)));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+    }
+#elif defined(WAV_NEON)
+    const float32x4_t k = vdupq_n_f32(q);
+    for (; i + 8 <= ns; i += 8) {
+        int16x8x2_t v;
+        v.val[0] = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(l + i), k))),
+                                vqmovn_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(l + i + 4), k))));
+        v.val[1] = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(r + i), k))),
+                                vqmovn_s32(vcvtq_s32_f32(vmulq_f32(vld1q_f32(r + i + 4), k))));
+        vst2q_s16(dst + 2 * i, v);
+    }
+#endif
+    for (; i < ns; i++) {
+        dst[2 * i]     = wav_sample_16(l[i], q);
+        dst[2 * i + 1] = wav_sample_16(r[i], q);
+    }
+}
+
+/** Encode stereo 24-bit PCM, 4 frames of both channels are rounded before they are packed (internal use only) */
+void wav_encode_24_2(wav_config cfg, float *const *data, size_t offset, size_t ns, float scale, uint8_t *block) {
+    (void) cfg;
+    const float *restrict l = data[0] + offset;
+    const float *restrict r = data[1] + offset;
+    uint8_t *restrict dst   = block;
+    const float q           = (float) 0x7FFFFF * scale;
+    size_t i                = 0;
+#if defined(WAV_SSE2) || defined(WAV_NEON)
+    int32_t a[4], b[4];
+    for (; i + 4 <= ns; i += 4) {
+        wav_round_24(l + i, q, a);
+        wav_round_24(r + i, q, b);
+        for (size_t j = 0; j < 4; j++) {
+            memcpy(dst + (i + j) * 6, &a[j], 3);
+            memcpy(dst + (i + j) * 6 + 3, &b[j], 3);
+        }
+    }
+#endif
+    for (; i < ns; i++) {
+        const int32_t a = wav_sample_24(l[i], q);
+        const int32_t b = wav_sample_24(r[i], q);
+        memcpy(dst + i * 6, &a, 3);
+        memcpy(dst + i * 6 + 3, &b, 3);
+    }
+}
+
+wav_encoder wav_get_encoder(wav_config cfg) {
+    static const wav_encoder encoders[2][4] = {
+            {wav_encode_8_1, wav_encode_16_1, wav_encode_24_1, wav_encode_32_1},
+            {wav_encode_8_2, wav_encode_16_2, wav_encode_24_2, wav_encode_32_2},
+    };
+    if (cfg.nc < 1 || cfg.nc > 2 || cfg.bd % 8 != 0 || cfg.bd < 8 || cfg.bd > 32) return wav_encode_block;
+
+    return encoders[cfg.nc - 1][cfg.bd / 8 - 1];
+}
+
+size_t wav_block_samples(wav_config cfg) {
+    const size_t per_block = (cfg.block ? cfg.block : WAV_BLOCK_SIZE) / ((size_t) cfg.nc * (cfg.bd / 8));
+
+    return per_block > 0 ? per_block : 1;
+}
+
+/** Encode samples into block one wav_block_samples() chunk at a time and write each chunk (internal use only) */
+size_t wav_write_blocks(wav_config cfg, FILE *file, float *const *data, size_t ns, float scale, uint8_t *block) {
+    const size_t frame       = (size_t) cfg.nc * (cfg.bd / 8);
+    const size_t per_block   = wav_block_samples(cfg);
+    const wav_encoder encode = wav_get_encoder(cfg);
+
+    size_t n = 0;
+    for (size_t i = 0; i < ns; i += per_block) {
+        const size_t count = (ns - i < per_block) ? ns - i : per_block;
+        encode(cfg, data, i, count, scale, block);
+        const size_t written = fwrite(block, frame, count, file);
+        n += written;
+        if (written != count) break;
+    }
+
+    return n;
+}
+
+size_t wav_write_samples_scaled(wav_config cfg, FILE *file, float *const *data, size_t ns, float scale) {
+    const size_t per_block = wav_block_samples(cfg);
+    uint8_t *block         = wav_malloc(per_block * cfg.nc * (cfg.bd / 8));
+    const size_t n         = wav_write_blocks(cfg, file, data, ns, scale, block);
+    free(block);
+
+    return n;
+}
+
+size_t wav_write_samples(wav_config cfg, FILE *file, float *const *data, size_t ns) {
+    return wav_write_samples_scaled(cfg, file, data, ns, 1.0f);
+}
+
+void wav_write_pad(wav_config cfg, FILE *file) {
+    static const char padding[8] = {0};
+    fwrite(padding, 1, wav_pad_size(cfg, cfg.format, cfg.ns), file);
+}
+
+size_t wav_write(wav_config cfg, const char *path, float *const *data) {
+    size_t n = 0;
+
+    check_error(!path, "Path pointer must not be NULL!", n);
+    check_error(!data, "Data pointer must not be NULL!", n);
+    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", n);
+    check_error(cfg.ns == 0, "Number of samples must be greater than 0.", n);
+    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", n);
+    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", n);
+
+    FILE *file = fopen(path, "wb");
+    check_error(!file, "Failed to open file for writing.", n);
+
+    cfg.format     = wav_resolve_format(cfg);
+    const int head = wav_write_header(cfg, file);
+    if (head != WAV_HEADER_SIZE) fclose(file);
+    check_error(head != WAV_HEADER_SIZE, "Failed to write the wav header.", n);
+
+    // append our actual audio data
+    n = wav_write_samples(cfg, file, data, (size_t) cfg.ns);
+
+    wav_write_pad(cfg, file);
+
+    fclose(file);
+
+    return n;
+}
+
+/** Wav file written incrementally, the header sizes are patched in by wav_writer_close() */
+struct wav_writer {
+    FILE *file;    //!< Output file stream
+    wav_config cfg;//!< Configuration of the file, cfg.ns counts the samples appended so far and cfg.format is never WAV_AUTO
+    int stream;    //!< Sizes were written up front and the stream is neither seeked nor closed
+    int reserve;   //!< The RIFF header holds a JUNK chunk that becomes ds64 if the data passes 4 GiB
+    uint64_t ns;   //!< Number of samples announced in the header of a stream
+    uint8_t *block;//!< Encoding buffer reused by every append, allocated along with the writer
+};
+
+/** Allocate a writer and its encoding buffer in one block (internal use only) */
+wav_writer *wav_writer_new(wav_config cfg) {
+    wav_writer *writer = wav_malloc(sizeof(*writer) + wav_block_samples(cfg) * cfg.nc * (cfg.bd / 8));
+    writer->cfg        = cfg;
+    writer->block      = (uint8_t *) (writer + 1);
+
+    return writer;
+}
+
+wav_writer *wav_writer_open(wav_config cfg, const char *path) {
+    check_error(!path, "Path pointer must not be NULL!", NULL);
+    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", NULL);
+    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", NULL);
+    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", NULL);
+
+    FILE *file = fopen(path, "wb");
+    check_error(!file, "Failed to open file for writing.", NULL);
+
+    const int reserve = cfg.format == WAV_AUTO && !(cfg.ns > 0 && wav_fits_riff(cfg, cfg.ns, 0));
+    if (cfg.format == WAV_AUTO) cfg.format = WAV_RIFF;
+
+    // sizes are unknown until the writer is closed, start with an empty data section
+    uint8_t header[WAV_MAX_HEADER];
+    cfg.ns         = 0;
+    const size_t n = wav_header_encode(cfg, cfg.format, 0, reserve, header);
+    const int ok   = fwrite(header, 1, n, file) == n;
+    if (!ok) fclose(file);
+    check_error(!ok, "Failed to write the wav header.", NULL);
+
+    wav_writer *writer = wav_writer_new(cfg);
+    writer->file       = file;
+    writer->stream     = 0;
+    writer->reserve    = reserve;
+    writer->ns         = 0;
+
+    return writer;
+}
+
+wav_writer *wav_writer_open_stream(wav_config cfg, FILE *file) {
+    check_error(!file, "File pointer must not be NULL!", NULL);
+    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", NULL);
+    check_error(cfg.ns == 0, "Number of samples must be greater than 0.", NULL);
+    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", NULL);
+    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", NULL);
+
+    cfg.format  = wav_resolve_format(cfg);
+    const int n = wav_write_header(cfg, file);
+    check_error(n != WAV_HEADER_SIZE, "Failed to write the wav header.", NULL);
+
+    wav_writer *writer = wav_writer_new(cfg);
+    writer->file       = file;
+    writer->cfg.ns     = 0;
+    writer->stream     = 1;
+    writer->reserve    = 0;
+    writer->ns         = cfg.ns;
+
+    return writer;
+}
+
+size_t wav_writer_append_scaled(wav_writer *writer, float *const *data, size_t ns, float scale) {
+    check_error(!writer, "Writer must not be NULL!", 0);
+    check_error(!data, "Data pointer must not be NULL!", 0);
+
+    const size_t n = wav_write_blocks(writer->cfg, writer->file, data, ns, scale, writer->block);
+    writer->cfg.ns += n;
+
+    return n;
+}
+
+size_t wav_writer_append(wav_writer *writer, float *const *data, size_t ns) {
+    return wav_writer_append_scaled(writer, data, ns, 1.0f);
+}
+
+int wav_writer_flush(wav_writer *writer) {
+    check_error(!writer, "Writer must not be NULL!", 0);
+
+    return fflush(writer->file) == 0;
+}
+
+size_t wav_writer_close(wav_writer *writer) {
+    check_error(!writer, "Writer must not be NULL!", 0);
+
+    FILE *file        = writer->file;
+    wav_config cfg    = writer->cfg;
+    const uint64_t ns = writer->ns;
+    const int pipe    = writer->stream;
+    const int reserve = writer->reserve;
+    free(writer);
+
+    wav_write_pad(cfg, file);
+
+    if (pipe) {
+        const int ok = fflush(file) == 0;
+        check_error(!ok, "Failed to flush the wav stream.", 0);
+        check_error(cfg.ns != ns, "Number of samples appended differs from the header.", 0);
+
+        return (size_t) cfg.ns;
+    }
+
+    // rewrite the whole header now that ns is known, the reserved RIFF and the RF64 layouts match
+    const int fits = cfg.format != WAV_RIFF || wav_fits_riff(cfg, cfg.ns, reserve);
+    if (!fits && reserve) cfg.format = WAV_RF64;
+
+    uint8_t header[WAV_MAX_HEADER];
+    const size_t n = wav_header_encode(cfg, cfg.format, cfg.ns, reserve, header);
+    int ok         = (fits || reserve) && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, n, file) == n;
+
+    ok = (fclose(file) == 0) && ok;
+    check_error(!fits && !reserve, "Data larger than 4 GiB doesn't fit in a RIFF header, open the writer with RF64 or Wave64.", 0);
+    check_error(!ok, "Failed to patch the wav header.", 0);
+
+    return (size_t) cfg.ns;
+}
+
+int wav_fseek64(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (long long) offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+int wav_get_header(wav_config *cfg, const char *path) {
+    wav_header header;
+    uint8_t chunk[24];
+
+    check_error(!cfg, "Wav config must not be NULL!", 0);
+    check_error(!path, "Path pointer must not be NULL!", 0);
+
+    FILE *file = wav_fopen(path, "rb");
+
+    // RIFF or RF64 tag followed by WAVE, or the riff GUID, a 64-bit size and the wave GUID
+    const int head = fread(chunk, 1, 12, file) == 12;
+    const int w64  = head && memcmp(chunk, wav_w64_riff, 12) == 0;
+    const int rf64 = head && memcmp(chunk, "RF64", 4) == 0;
+    int ok         = head && (w64 || ((rf64 || memcmp(chunk, "RIFF", 4) == 0) && memcmp(chunk + 8, "WAVE", 4) == 0));
+    ok             = ok && (!w64 || (fread(chunk + 12, 1, 12, file) == 12 && memcmp(chunk, wav_w64_riff, 16) == 0));
+    ok             = ok && (!w64 || (fread(chunk, 1, 16, file) == 16 && memcmp(chunk, wav_w64_wave, 16) == 0));
+    if (!ok) fclose(file);
+    check_error(!ok, "Invalid RIFF section.", 0);
+
+    // walk the chunks until the data chunk, Wave64 ids are GUIDs and its sizes count the 24 byte chunk header
+    const size_t id     = w64 ? 16 : 4;
+    const size_t hdr    = w64 ? 24 : 8;
+    uint64_t pos        = w64 ? 40 : 12;
+    uint64_t ds64_data  = WAV_RIFF_MAX;
+    uint64_t data_start = 0;
+    int fmt             = 0;
+    header.data.size    = 0;
+    while (ok && !data_start) {
+        ok = wav_fseek64(file, pos) == 0 && fread(chunk, 1, hdr, file) == hdr;
+        if (!ok) break;
+
+        uint64_t size = 0;
+        if (w64) {
+            memcpy(&size, chunk + 16, 8);
+            ok = size >= hdr;
+            size -= hdr;
+        } else {
+            uint32_t size32;
+            memcpy(&size32, chunk + 4, 4);
+            size = size32;
+        }
+
+        if (memcmp(chunk, w64 ? wav_w64_fmt : (const uint8_t *) "fmt\x20", id) == 0) {
+            ok = ok && size >= 16;
+            ok = ok && read_val(header.wave.WAVE_FORMAT_EXTENSIBLE, file) == 1;
+            ok = ok && read_val(header.wave.num_channels, file) == 1;
+            ok = ok && read_val(header.wave.sample_rate, file) == 1;
+            ok = ok && read_val(header.wave.avg_bytes_per_sec, file) == 1;
+            ok = ok && read_val(header.wave.n_block_align, file) == 1;
+            ok = ok && read_val(header.wave.bits_per_sample, file) == 1;
+            fmt = ok;
+        } else if (rf64 && memcmp(chunk, "ds64", 4) == 0) {
+            ok = ok && size >= 24 && read_val(header.riff.size, file) == 1 && read_val(ds64_data, file) == 1;
+        } else if (memcmp(chunk, w64 ? wav_w64_data : (const uint8_t *) "data", id) == 0) {
+            // RF64 stores -1 in place of the real size kept in ds64
+            header.data.size = (rf64 && size == WAV_RIFF_MAX) ? ds64_data : size;
+            data_start       = pos + hdr;
+        }
+
+        // chunks are padded to an even size, Wave64 chunks to a multiple of 8
+        pos += hdr + size + (w64 ? (8 - size % 8) % 8 : size % 2);
+    }
+    fclose(file);
+    check_error(!ok || !data_start, "Invalid data section.", 0);
+    check_error(!fmt || header.wave.num_channels == 0 || header.wave.bits_per_sample < 8, "Invalid WAVE section.", 0);
+
+    cfg->nc     = header.wave.num_channels;
+    cfg->bd     = header.wave.bits_per_sample;
+    cfg->sr     = header.wave.sample_rate;
+    cfg->ns     = header.data.size / ((uint64_t) cfg->nc * (cfg->bd / 8));// ns = size / (nc * M)
+    cfg->format = w64 ? WAV_W64 : rf64 ? WAV_RF64 : WAV_RIFF;
+    cfg->offset = data_start;
+    cfg->block  = 0;
+
+    return WAV_HEADER_SIZE;
+}
+
+int wav_file_size(const char *path, uint64_t *size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attr)) return 0;
+    *size = ((uint64_t) attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    *size = (uint64_t) st.st_size;
+#endif
+    return 1;
+}
+
+int wav_map(wav_view *view, const char *path, uint64_t offset, size_t length) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const uint64_t aligned = offset - offset % info.dwAllocationGranularity;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return 0;
+
+    view->length = (size_t) (offset - aligned) + length;
+    view->base   = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD) (aligned >> 32), (DWORD) aligned, view->length);
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (!view->base) return 0;
+#else
+    const uint64_t page    = (uint64_t) sysconf(_SC_PAGESIZE);
+    const uint64_t aligned = offset - offset % page;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    view->length = (size_t) (offset - aligned) + length;
+    view->base   = mmap(NULL, view->length, PROT_READ, MAP_PRIVATE, fd, (off_t) aligned);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (view->base == MAP_FAILED) return 0;
+    madvise(view->base, view->length, MADV_SEQUENTIAL);
+#endif
+    view->data = (const uint8_t *) view->base + (offset - aligned);
+
+    return 1;
+}
+
+void wav_unmap(wav_view *view) {
+#ifdef _WIN32
+    UnmapViewOfFile(view->base);
+#else
+    munmap(view->base, view->length);
+#endif
+}
+
+/** Decode one 8-bit sample (internal use only) */
+float wav_load_8(const uint8_t *src) {
+    return (*src - 128) * 0x1p-7f;
+}
+
+/** Decode one 16-bit sample (internal use only) */
+float wav_load_16(const uint8_t *src) {
+    int16_t v = 0;
+    memcpy(&v, src, sizeof(v));
+    return v * 0x1p-15f;
+}
+
+/** Decode one 24-bit sample, its bytes become the high bytes of an int so the sign is kept (internal use only) */
+float wav_load_24(const uint8_t *src) {
+    const int32_t v = (int32_t) ((uint32_t) src[0] << 8 | (uint32_t) src[1] << 16 | (uint32_t) src[2] << 24);
+    return (float) v * 0x1p-31f;
+}
+
+/** Decode one 32-bit float sample (internal use only) */
+float wav_load_32(const uint8_t *src) {
+    float v = 0.0f;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+void wav_decode_block(wav_config cfg, const uint8_t *src, size_t ns, float **data, size_t offset) {
+    const size_t M    = cfg.bd / 8;
+    const uint8_t *mp = src;
+
+    switch (cfg.bd) {
+        case 32:
+            if (cfg.nc == 1) {
+                memcpy(data[0] + offset, src, ns * M);
+                break;
+            }
+            for (size_t i = offset; i < offset + ns; i++) {
+                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
+                    memcpy(&data[ch][i], mp, M);
+                }
+            }
+            break;
+        case 24:
+            for (size_t i = offset; i < offset + ns; i++) {
+                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
+                    data[ch][i] = wav_load_24(mp);
+                }
+            }
+            break;
+        case 16:
+            for (size_t i = offset; i < offset + ns; i++) {
+                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
+                    data[ch][i] = wav_load_16(mp);
+                }
+            }
+            break;
+        case 8:
+            for (size_t i = offset; i < offset + ns; i++) {
+                for (size_t ch = 0; ch < cfg.nc; ch++, mp += M) {
+                    data[ch][i] = wav_load_8(mp);
+                }
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Define wav_decode_<BD>_<NC>(), decoding frames of NC channels with the scalar decoder of BD bits
+ *
+ * NC is a constant, so every channel is a loop with a fixed stride the compiler can vectorize.
+ */
+#define WAV_DEFINE_DECODER(BD, NC)                                                                               \
+    void wav_decode_##BD##_##NC(wav_config cfg, const uint8_t *src, size_t ns, float **data, size_t offset) {    \
+        (void) cfg;                                                                                              \
+        for (size_t ch = 0; ch < NC; ch++) {                                                                     \
+            const uint8_t *restrict mp = src + ch * (BD / 8);                                                    \
+            float *restrict dst        = data[ch] + offset;                                                      \
+            for (size_t i = 0; i < ns; i++) dst[i] = wav_load_##BD(mp + i * (NC * BD / 8));                      \
+        }                                                                                                        \
+    }
+
+WAV_DEFINE_DECODER(8, 1)
+WAV_DEFINE_DECODER(8, 2)
+WAV_DEFINE_DECODER(16, 1)
+WAV_DEFINE_DECODER(16, 2)
+WAV_DEFINE_DECODER(24, 1)
+WAV_DEFINE_DECODER(24, 2)
+WAV_DEFINE_DECODER(32, 2)
+
+/** Decode mono 32-bit floats, a plain copy (internal use only) */
+void wav_decode_32_1(wav_config cfg, const uint8_t *src, size_t ns, float **data, size_t offset) {
+    (void) cfg;
+    memcpy(data[0] + offset, src, ns * sizeof(float));
+}
+
+wav_decoder wav_get_decoder(wav_config cfg) {
+    static const wav_decoder decoders[2][4] = {
+            {wav_decode_8_1, wav_decode_16_1, wav_decode_24_1, wav_decode_32_1},
+            {wav_decode_8_2, wav_decode_16_2, wav_decode_24_2, wav_decode_32_2},
+    };
+    if (cfg.nc < 1 || cfg.nc > 2 || cfg.bd % 8 != 0 || cfg.bd < 8 || cfg.bd > 32) return wav_decode_block;
+
+    return decoders[cfg.nc - 1][cfg.bd / 8 - 1];
+}
+
+size_t wav_read_range(wav_config cfg, const char *path, size_t offset, size_t count, float **data) {
+    const size_t M = cfg.bd / 8;
+    size_t n       = 0;
+    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", n);
+    check_error(cfg.ns == 0, "Number of samples must be greater than 0.", n);
+    check_error(cfg.sr == 0, "Sample rate must be greater than 0.", n);
+    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", n);
+    check_error(!path, "Path pointer must not be NULL!", n);
+    check_error(!data, "Data pointer must not be NULL!", n);
+    for (size_t ch = 0; ch < cfg.nc; ch++)
+        check_error(!data[ch], "Data channel pointers must not be NULL!", n);
+
+    const uint64_t data_start = cfg.offset ? cfg.offset : WAV_DATA_OFFSET;
+    uint64_t size             = 0;
+    check_error(!wav_file_size(path, &size) || size < data_start, "Failed to open file.", n);
+
+    // clamp the range to the samples in both the header and the file
+    const size_t frame = M * cfg.nc;
+    uint64_t available = (size - data_start) / frame;
+    if (available > cfg.ns) available = cfg.ns;
+    if (offset >= available) return n;
+    if (count > available - offset) count = (size_t) (available - offset);
+    if (count == 0) return n;
+
+    const uint64_t start = data_start + (uint64_t) offset * frame;
+
+    const wav_decoder decode = wav_get_decoder(cfg);
+
+    wav_view view;
+    if (wav_map(&view, path, start, count * frame)) {
+        decode(cfg, view.data, count, data, 0);
+        wav_unmap(&view);
+
+        return count;
+    }
+
+    // pipes and other files that can't be mapped are read one block at a time
+    FILE *file = fopen(path, "rb");
+    check_error(!file, "Failed to open file.", n);
+    const int seek = wav_fseek64(file, start);
+    if (seek != 0) fclose(file);
+    check_error(seek != 0, "Failed to seek to the range.", n);
+
+    const size_t per_block = wav_block_samples(cfg);
+    uint8_t *block         = wav_malloc(per_block * frame);
+
+    size_t i = 0;
+    while (i < count) {
+        const size_t want = (count - i < per_block) ? count - i : per_block;
+        const size_t got  = fread(block, frame, want, file);
+        decode(cfg, block, got, data, i);
+        i += got;
+        if (got != want) break;
+    }
+
+    free(block);
+    fclose(file);
+
+    return i;
+}
+
+size_t wav_read(wav_config cfg, const char *path, float **data) {
+    return wav_read_range(cfg, path, 0, (size_t) cfg.ns, data);
+}
+
+size_t wav_write_range(wav_config cfg, const char *path, size_t offset, size_t count, float *const *data, float scale) {
+    size_t n = 0;
+    check_error(cfg.nc == 0, "Number of channels must be greater than 0.", n);
+    check_error(cfg.bd != 32 && cfg.bd != 24 && cfg.bd != 16 && cfg.bd != 8, "Bit depth must be either 32, 24, 16 or 8.", n);
+    check_error(!path, "Path pointer must not be NULL!", n);
+    check_error(!data, "Data pointer must not be NULL!", n);
+    for (size_t ch = 0; ch < cfg.nc; ch++)
+        check_error(!data[ch], "Data channel pointers must not be NULL!", n);
+
+    // samples past the header's size would land in the padding or the chunks after the data
+    if (offset >= cfg.ns) return n;
+    if (count > cfg.ns - offset) count = (size_t) (cfg.ns - offset);
+    if (count == 0) return n;
+
+    FILE *file = fopen(path, "r+b");
+    check_error(!file, "Failed to open file.", n);
+    const size_t frame        = (size_t) cfg.nc * (cfg.bd / 8);
+    const uint64_t data_start = cfg.offset ? cfg.offset : WAV_DATA_OFFSET;
+    const int seek            = wav_fseek64(file, data_start + (uint64_t) offset * frame);
+    if (seek != 0) fclose(file);
+    check_error(seek != 0, "Failed to seek to the range.", n);
+
+    uint8_t *block = wav_malloc(wav_block_samples(cfg) * frame);
+    n              = wav_write_blocks(cfg, file, data, count, scale, block);
+    free(block);
+
+    return fclose(file) == 0 ? n : 0;
+}
 
 #undef check_error
 #undef die
-#undef write_key
-#undef write_val
-#undef read_key
 #undef read_val
-#undef WAV_KEY_SIZE
 #undef WAV_VALUE_SIZE
-#undef WAV_DATA_OFFSET
+#undef WAV_SSE2
+#undef WAV_NEON
+#undef WAV_DEFINE_ENCODER
+#undef WAV_DEFINE_DECODER
+#endif
 #endif
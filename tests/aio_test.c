@@ -0,0 +1,95 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define AIO_IMPLEMENTATION
+#include "../src/aio.h"
+
+#define CHANNELS 3
+#define SAMPLES  64
+#define BLOCKS   40
+
+/** Samples received by the write function */
+struct sink {
+    int nc;                               //!< Channels of every block
+    float out[CHANNELS][BLOCKS * SAMPLES];//!< Scaled samples of every channel in the order they were written
+    size_t ns;                            //!< Samples per channel received
+    size_t fail_at;                       //!< Samples past which writes fall short, 0 never fails
+    int calls;                            //!< Number of writes
+};
+
+size_t sink_write(void *user, float *const *data, size_t ns, float scale) {
+    struct sink *s = user;
+    s->calls++;
+    size_t n = ns;
+    if (s->fail_at && s->ns + n > s->fail_at) n = s->fail_at - s->ns;
+    for (int ch = 0; ch < s->nc; ch++)
+        for (size_t i = 0; i < n; i++)
+            s->out[ch][s->ns + i] = data[ch][i] * scale;
+    s->ns += n;
+
+    return n;
+}
+
+/** Submit BLOCKS blocks of a ramp that is different for every channel, the last block is shorter */
+size_t fill(aio *a, int nc) {
+    size_t total = 0;
+    for (int b = 0; b < BLOCKS; b++) {
+        const size_t ns    = b == BLOCKS - 1 ? SAMPLES / 2 : SAMPLES;
+        float *const *data = aio_acquire(a);
+        for (int ch = 0; ch < nc; ch++)
+            for (size_t i = 0; i < ns; i++)
+                data[ch][i] = (float) (ch * 100000 + total + i);
+        aio_submit(a, ns, 2.0f);
+        total += ns;
+    }
+
+    return total;
+}
+
+int main() {
+    aio_free(NULL);
+
+    static struct sink s;
+    for (int depth = 0; depth <= 4; depth++) {
+        aio *a = aio_new(depth);
+        assert(a != NULL);
+        assert(aio_depth(a) == (depth < 1 ? 1 : depth));
+
+        // every block reaches the write function in order, scaled, on any depth
+        for (int nc = 1; nc <= CHANNELS; nc += 2) {
+            s = (struct sink) {.nc = nc};
+            const int ok = aio_begin(a, nc, SAMPLES, sink_write, &s);
+            assert(ok);
+            const size_t total   = fill(a, nc);
+            const size_t written = aio_end(a);
+            assert(written == total);
+            assert(s.ns == total && s.calls == BLOCKS);
+            for (int ch = 0; ch < nc; ch++)
+                for (size_t i = 0; i < total; i++)
+                    assert(s.out[ch][i] == 2.0f * (float) (ch * 100000 + i));
+            (void) ok;
+            (void) written;
+        }
+
+        // a short write drops the blocks after it
+        s = (struct sink) {.nc = 1};
+        s.fail_at = SAMPLES * 5 + 7;
+        const int ok = aio_begin(a, 1, SAMPLES, sink_write, &s);
+        assert(ok);
+        fill(a, 1);
+        const size_t written = aio_end(a);
+        assert(written == s.fail_at);
+        assert(s.calls == 6);
+
+        const aio_stats st = aio_get_stats(a);
+        assert(st.blocks == 2 * BLOCKS + 6);
+        assert(st.stall_s >= 0.0 && st.write_s >= 0.0);
+        (void) ok;
+        (void) written;
+        (void) st;
+        aio_free(a);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_IMPLEMENTATION
+#include "../src/arena.h"
+
+#define BLOCK (1 << 20)
+
+/** Allocations of one fake conversion, some of them larger than a block */
+int convert(arena *a) {
+    int ok = 1;
+    for (size_t i = 1; i <= 8; i++) {
+        unsigned char *p = arena_alloc(a, i * BLOCK / 3);
+        ok               = ok && p && ((uintptr_t) p % 64) == 0;
+        if (p) memset(p, (int) i, i * BLOCK / 3);
+    }
+
+    return ok;
+}
+
+int main() {
+    arena *a = arena_new(0);
+    assert(a != NULL);
+    assert(arena_capacity(a) == 0);
+
+    // the last allocation grows and shrinks in place, earlier ones are copied
+    char *first = arena_alloc(a, 100);
+    char *last  = arena_alloc(a, 100);
+    assert(first && last && last > first);
+    memset(first, 'f', 100);
+    memset(last, 'l', 100);
+    char *grown = arena_realloc(a, last, 100, 1000);
+    assert(grown == last);
+    char *shrunk = arena_realloc(a, last, 1000, 10);
+    assert(shrunk == last);
+    char *moved = arena_realloc(a, first, 100, 200);
+    assert(moved != first && moved > last);
+    for (int i = 0; i < 100; i++)
+        assert(moved[i] == 'f' && last[i % 10] == 'l');
+
+    // releasing the last allocation hands its memory to the next one
+    char *tmp = arena_alloc(a, 4096);
+    arena_release(a, tmp);
+    char *reused = arena_alloc(a, 64);
+    assert(reused == tmp);
+    arena_release(a, first);// not the last one, nothing happens
+
+    assert(arena_owns(a, first) && arena_owns(a, tmp + 63));
+    int local;
+    assert(!arena_owns(a, &local));
+
+    // blocks added while growing are merged on reset, the next conversion needs no new block
+    int ok = convert(a);
+    assert(ok);
+    const size_t blocks = arena_blocks(a);
+    assert(blocks > 1);
+    for (int i = 0; i < 3; i++) {
+        arena_reset(a);
+        ok = convert(a);
+        assert(ok);
+    }
+    assert(arena_blocks(a) == blocks + 1);
+
+    // reserving on an empty arena swaps the block, not adding another one
+    arena_reset(a);
+    const size_t capacity = arena_capacity(a);
+    ok                    = arena_reserve(a, capacity * 2);
+    assert(ok);
+    assert(arena_capacity(a) >= capacity * 2 && arena_capacity(a) < capacity * 3);
+    ok = arena_reserve(a, capacity);
+    assert(ok);
+    assert(arena_blocks(a) == blocks + 2);
+    (void) grown;
+    (void) shrunk;
+    (void) moved;
+    (void) reused;
+    (void) local;
+    (void) ok;
+    (void) capacity;
+    (void) blocks;
+
+    arena_free(a);
+
+    printf("arena tests passed\n");
+
+    return EXIT_SUCCESS;
+}
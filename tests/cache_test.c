@@ -0,0 +1,139 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_IMPLEMENTATION
+#include "../src/cache.h"
+
+#define CACHE_DIR "cache_test_dir"
+
+/** One shot hash of a string */
+uint64_t hash_string(const char *s) {
+    cache_hash h;
+    cache_hash_init(&h, 0);
+    cache_hash_update(&h, s, strlen(s));
+    return cache_hash_digest(&h);
+}
+
+/** Write a file of size bytes of value to a temporary path of the cache and move it in */
+int put(cache *c, uint64_t key, size_t size, int value) {
+    char temp[CACHE_PATH_MAX];
+    const int named = cache_temp(c, key, temp, sizeof(temp));
+    assert(named);
+    if (!named) return 0;
+    FILE *file = fopen(temp, "wb");
+    assert(file != NULL);
+    for (size_t i = 0; i < size; i++)
+        fputc(value, file);
+    const int closed = fclose(file);
+    assert(closed == 0);
+    (void) closed;
+
+    return cache_put(c, key, temp);
+}
+
+/** Look up an entry and check its contents, 0 on a miss */
+int get(cache *c, uint64_t key, size_t size, int value) {
+    FILE *file = cache_get(c, key);
+    if (!file) return 0;
+
+    FILE *copy = tmpfile();
+    assert(copy != NULL);
+    int ok = cache_copy(file, copy);
+    fclose(file);
+    ok = ok && ftell(copy) == (long) size;
+    rewind(copy);
+    for (size_t i = 0; ok && i < size; i++)
+        ok = fgetc(copy) == value;
+    fclose(copy);
+    assert(ok);
+
+    return ok;
+}
+
+/** Remove the entries a run left behind */
+void cleanup(void) {
+    char path[CACHE_PATH_MAX];
+    for (uint64_t key = 1; key <= 4; key++) {
+        snprintf(path, sizeof(path), CACHE_DIR "/%016llx.wav", (unsigned long long) key);
+        remove(path);
+    }
+}
+
+int main() {
+    // xxHash64 reference values, short inputs and one covering the 32 byte stripes
+    assert(hash_string("") == 0xEF46DB3751D8E999ull);
+    assert(hash_string("a") == 0xD24EC4F1A98C6E5Bull);
+    assert(hash_string("abc") == 0x44BC2CF5AD770999ull);
+    assert(hash_string("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ull);
+
+    // streaming in uneven pieces gives the one shot hash
+    unsigned char data[1000];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char) (i * 7 + (i >> 3));
+    cache_hash whole, parts;
+    cache_hash_init(&whole, 42);
+    cache_hash_update(&whole, data, sizeof(data));
+    cache_hash_init(&parts, 42);
+    for (size_t i = 0, step = 1; i < sizeof(data); i += step, step = step * 3 % 61 + 1)
+        cache_hash_update(&parts, data + i, (sizeof(data) - i < step) ? sizeof(data) - i : step);
+    assert(cache_hash_digest(&whole) == cache_hash_digest(&parts));
+    cache_hash_init(&parts, 43);
+    cache_hash_update(&parts, data, sizeof(data));
+    assert(cache_hash_digest(&whole) != cache_hash_digest(&parts));
+
+    //// Test lookups, eviction and reopening
+    cleanup();
+    cache *c = cache_open(CACHE_DIR, 3000);
+    assert(c != NULL);
+    assert(cache_get_stats(c).entries == 0);
+    int ok = !get(c, 1, 1000, 'a');
+    assert(ok);
+
+    ok = put(c, 1, 1000, 'a') && put(c, 2, 1000, 'b') && put(c, 3, 1000, 'c');
+    assert(ok);
+    ok = get(c, 1, 1000, 'a') && get(c, 2, 1000, 'b');
+    assert(ok);
+
+    // 3 is the least recently used entry, putting 4 evicts it
+    ok = put(c, 4, 1000, 'd');
+    assert(ok);
+    ok = !get(c, 3, 1000, 'c') && get(c, 4, 1000, 'd');
+    assert(ok);
+
+    // an entry larger than the cap isn't kept
+    ok = !put(c, 3, 4000, 'e') && !get(c, 3, 4000, 'e');
+    assert(ok);
+
+    // replacing an entry doesn't count it twice
+    ok = put(c, 4, 500, 'f') && get(c, 4, 500, 'f');
+    assert(ok);
+
+    cache_stats st = cache_get_stats(c);
+    assert(st.hits == 4 && st.misses == 3 && st.evictions == 1);
+    assert(st.entries == 3 && st.bytes == 2500);
+    cache_free(c);
+
+    // the entries are found again, a smaller cap evicts down to it
+    c = cache_open(CACHE_DIR, 2500);
+    assert(c != NULL);
+    st = cache_get_stats(c);
+    assert(st.entries == 3 && st.bytes == 2500 && st.hits == 0 && st.evictions == 0);
+    ok = get(c, 1, 1000, 'a');
+    assert(ok);
+    cache_free(c);
+
+    c = cache_open(CACHE_DIR, 1000);
+    assert(c != NULL);
+    st = cache_get_stats(c);
+    assert(st.bytes <= 1000 && st.evictions > 0);
+    cache_free(c);
+    (void) ok;
+    (void) st;
+
+    cleanup();
+    remove(CACHE_DIR);
+
+    return EXIT_SUCCESS;
+}
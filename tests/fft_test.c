@@ -0,0 +1,79 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FFT_IMPLEMENTATION
+#include "../src/fft.h"
+
+int compare_dft(size_t n, int direction) {
+    float *re  = malloc(n * sizeof(*re));
+    float *im  = malloc(n * sizeof(*im));
+    double *xr = malloc(n * sizeof(*xr));
+    double *xi = malloc(n * sizeof(*xi));
+    assert(re && im && xr && xi);
+
+    for (size_t i = 0; i < n; i++) {
+        xr[i] = re[i] = (float) sin(0.37 * i) + 0.25f;
+        xi[i] = im[i] = (float) cos(1.91 * i);
+    }
+
+    fft_plan *plan = fft_plan_new(n);
+    assert(plan != NULL);
+    fft_execute(plan, re, im, direction);
+
+    // compare against a direct O(n^2) transform
+    const double sign = (direction == FFT_INVERSE) ? 1.0 : -1.0;
+    int ok            = 1;
+    for (size_t k = 0; k < n && ok; k++) {
+        double sr = 0.0, si = 0.0;
+        for (size_t t = 0; t < n; t++) {
+            const double theta = sign * 2.0 * M_PI * (double) ((k * t) % n) / n;
+            sr += xr[t] * cos(theta) - xi[t] * sin(theta);
+            si += xr[t] * sin(theta) + xi[t] * cos(theta);
+        }
+        const double epsilon = 1e-4 * n;
+        if (!(fabs(sr - re[k]) <= epsilon && fabs(si - im[k]) <= epsilon)) {
+            fprintf(stderr, "no match: (%f, %f) != (%f, %f) @ [%zu] n=%zu\n", re[k], im[k], sr, si, k, n);
+            ok = 0;
+        }
+    }
+
+    fft_plan_free(plan);
+    free(re);
+    free(im);
+    free(xr);
+    free(xi);
+
+    return ok;
+}
+
+int main() {
+    //// Test invalid sizes
+    assert(fft_plan_new(0) == NULL);
+    assert(fft_plan_new(1) == NULL);
+    assert(fft_plan_new(12) == NULL);
+
+    //// Test both directions against a direct transform
+    for (size_t n = 2; n <= 1024; n <<= 1) {
+        assert(compare_dft(n, FFT_FORWARD));
+        assert(compare_dft(n, FFT_INVERSE));
+    }
+
+    //// Test a single bin synthesizes a sine wave like the additive engine
+    const size_t n = 256;
+    const size_t k = 17;
+    float re[256]  = {0};
+    float im[256]  = {0};
+    re[k]          = 0.5f;
+
+    fft_plan *plan = fft_plan_new(n);
+    assert(plan != NULL);
+    fft_execute(plan, re, im, FFT_INVERSE);
+    for (size_t t = 0; t < n; t++)
+        assert(fabs(im[t] - 0.5 * sin(2.0 * M_PI * k * t / n)) <= 1e-5);
+    fft_plan_free(plan);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GPU_IMPLEMENTATION
+#include "../src/gpu.h"
+
+#define WIDTH  5
+#define HEIGHT 64
+#define TARGET 1000
+#define FADE   200
+
+/** Sample t of a column whose rows are all at phase 0 at t = 0 */
+double reference(const int *start, const int *row, const float *amp, const uint32_t *inc, int x, uint32_t t) {
+    double sum = 0.0;
+    for (int i = start[x]; i < start[x + 1]; i++)
+        sum += amp[i] * sin(2.0 * M_PI * (uint32_t) (inc[row[i]] * t) / 4294967296.0);
+
+    return sum;
+}
+
+int main() {
+    gpu_synth *g = gpu_synth_new();
+    if (!g) {
+        printf("skipping, no OpenCL device\n");
+        return EXIT_SUCCESS;
+    }
+    printf("device: %s\n", gpu_synth_device(g));
+
+    // column x lights every (x + 1)th row, the last column is empty
+    int start[WIDTH + 1], row[WIDTH * HEIGHT];
+    float amp[WIDTH * HEIGHT];
+    uint32_t inc[HEIGHT];
+    int n = 0;
+    for (int x = 0; x < WIDTH; x++) {
+        start[x] = n;
+        for (int y = 0; x < WIDTH - 1 && y < HEIGHT; y += x + 1) {
+            row[n]   = y;
+            amp[n++] = (y % 5 + 1) / 5.0f;
+        }
+    }
+    start[WIDTH] = n;
+    for (int y = 0; y < HEIGHT; y++)
+        inc[y] = (uint32_t) (y * 56599u * 1031u);
+
+    assert(gpu_synth_upload(g, WIDTH, start, row, amp, HEIGHT, inc));
+
+    float *out = calloc(WIDTH * TARGET, sizeof(*out));
+    assert(out != NULL);
+
+    // render in two calls, the second one starting mid image
+    assert(gpu_synth_render(g, 0, 2, TARGET, 0, 0, out));
+    assert(gpu_synth_render(g, 2, WIDTH - 2, TARGET, 0, 0, out + 2 * TARGET));
+    assert(!gpu_synth_render(g, 1, WIDTH, TARGET, 0, 0, out));
+    assert(!gpu_synth_render(g, 0, WIDTH, TARGET, 0, TARGET + 1, out));
+
+    int ok = 1;
+    for (int x = 0; x < WIDTH && ok; x++) {
+        for (int t = 0; t < TARGET && ok; t++) {
+            const double expected = reference(start, row, amp, inc, x, t);
+            if (!(fabs(expected - out[x * TARGET + t]) <= 1e-4)) {
+                fprintf(stderr, "no match: %f != %f @ [%d, %d]\n", out[x * TARGET + t], expected, x, t);
+                ok = 0;
+            }
+        }
+    }
+
+    // continuous phase, the start of every column but the first fades in from the previous one
+    assert(gpu_synth_render(g, 0, WIDTH, TARGET, 1, FADE, out));
+    for (int x = 0; x < WIDTH && ok; x++) {
+        for (int t = 0; t < TARGET && ok; t++) {
+            const uint32_t n = x * TARGET + t;
+            double expected  = reference(start, row, amp, inc, x, n);
+            if (x > 0 && t < FADE) {
+                const double w = 0.5 - 0.5 * cos(M_PI * (t + 0.5) / FADE);
+                expected       = w * expected + (1.0 - w) * reference(start, row, amp, inc, x - 1, n);
+            }
+            if (!(fabs(expected - out[n]) <= 1e-4)) {
+                fprintf(stderr, "no match: %f != %f @ [%d, %d] continuous\n", out[n], expected, x, t);
+                ok = 0;
+            }
+        }
+    }
+
+    free(out);
+    gpu_synth_free(g);
+    assert(ok);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/img2wav.h"
+#include "../src/osc.h"
+#include "../src/pool.h"
+
+#define WIDTH   32
+#define HEIGHT  16
+#define IMAGES  4
+#define WORKERS 2
+
+/** Binary PGM of a gradient that differs for every seed */
+size_t make_image(uint8_t *buf, int width, int height, int seed) {
+    const int n = sprintf((char *) buf, "P5\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            buf[n + y * width + x] = (uint8_t) ((x * 7 + y * 13 + seed * 29) % 256);
+
+    return n + (size_t) width * height;
+}
+
+/** Heat of pixel (x, y) of a plane, a single lit pixel per column keeps every plane quiet enough to skip normalization */
+uint8_t plane_pixel(int x, int y, int height, int plane) {
+    return y == (x * (plane + 1) + plane) % height ? (uint8_t) (200 - 3 * x - 20 * plane) : 0;
+}
+
+/** Binary PGM of columns [first, first + columns) of a plane, dark past width, or PPM of the three planes if plane < 0 */
+size_t make_planes(uint8_t *buf, int width, int height, int first, int columns, int plane) {
+    const int n = sprintf((char *) buf, "%s\n%d %d\n255\n", plane < 0 ? "P6" : "P5", columns, height);
+    size_t i    = n;
+    for (int y = 0; y < height; y++)
+        for (int x = first; x < first + columns; x++)
+            for (int c = plane < 0 ? 0 : plane; c <= (plane < 0 ? 2 : plane); c++)
+                buf[i++] = x < width ? plane_pixel(x, y, height, c) : 0;
+
+    return i;
+}
+
+/** Samples of a wav file, interleaved nc channels of bytes each */
+const uint8_t *wav_samples(const uint8_t *wav, size_t size, int *nc, int *bytes, size_t *length) {
+    size_t i = 12;
+    while (i + 8 <= size) {
+        const size_t chunk = wav[i + 4] | wav[i + 5] << 8 | wav[i + 6] << 16 | (size_t) wav[i + 7] << 24;
+        if (memcmp(wav + i, "fmt ", 4) == 0) {
+            *nc    = wav[i + 10] | wav[i + 11] << 8;
+            *bytes = (wav[i + 20] | wav[i + 21] << 8) / *nc;
+        } else if (memcmp(wav + i, "data", 4) == 0) {
+            *length = chunk;
+            return wav + i + 8;
+        }
+        i += 8 + chunk + (chunk & 1);
+    }
+    assert(0);
+
+    return NULL;
+}
+
+/** Bytes written to a stream, rewound and read back */
+size_t read_back(FILE *file, uint8_t **data) {
+    const long size = ftell(file);
+    assert(size > 0);
+    *data = malloc(size);
+    assert(*data != NULL);
+    rewind(file);
+    const size_t got = fread(*data, 1, size, file);
+    assert(got == (size_t) size);
+    (void) got;
+    fclose(file);
+
+    return size;
+}
+
+/** Convert an encoded image in memory to a wav file in memory */
+size_t convert_image(img2wav_ctx *ctx, const struct options *defaults, const uint8_t *image, size_t length, uint8_t **wav) {
+    struct options opts     = *defaults;
+    opts.out                = tmpfile();
+    struct image_source src = {.data = image, .length = length};
+    assert(opts.out != NULL);
+    const int written = convert_source(ctx, &opts, &src, "-", now());
+    assert(written == (int) (opts.sample_rate * opts.time_s));
+    (void) written;
+
+    return read_back(opts.out, wav);
+}
+
+/** Images converted by the contexts of concurrent workers */
+struct run {
+    img2wav_ctx *ctx[WORKERS];  //!< Context of every worker
+    const struct options *opts; //!< Options of every image
+    uint8_t image[IMAGES][1024];//!< Encoded images
+    size_t length[IMAGES];      //!< Size of every image
+    uint8_t *wav[IMAGES];       //!< Wav file of every image
+    size_t size[IMAGES];        //!< Size of every wav file
+};
+
+void run_image(void *ctx, int worker, size_t task) {
+    struct run *r = ctx;
+    r->size[task] = convert_image(r->ctx[worker], r->opts, r->image[task], r->length[task], &r->wav[task]);
+}
+
+int main() {
+    struct options opts;
+    options_default(&opts);
+    opts.sample_rate  = 8000.0f;
+    opts.time_s       = 0.5f;
+    opts.synth.engine = SYNTH_SINF;
+    img2wav_ctx_free(NULL);
+
+    struct run r = {.opts = &opts};
+    for (int i = 0; i < IMAGES; i++)
+        r.length[i] = make_image(r.image[i], WIDTH, HEIGHT, i);
+
+    // a context converts one image after the other and reuses what it set up
+    img2wav_ctx *ctx = img2wav_ctx_new(1);
+    assert(ctx != NULL);
+    uint8_t *expected[IMAGES];
+    size_t expected_size[IMAGES];
+    for (int i = 0; i < IMAGES; i++)
+        expected_size[i] = convert_image(ctx, &opts, r.image[i], r.length[i], &expected[i]);
+    uint8_t *again;
+    const size_t again_size = convert_image(ctx, &opts, r.image[0], r.length[0], &again);
+    assert(again_size == expected_size[0]);
+    assert(memcmp(again, expected[0], expected_size[0]) == 0);
+    (void) again_size, (void) expected_size;
+    free(again);
+
+    // streams match the buffered conversions whether they are written on the rendering thread or the writer thread
+    for (int depth = 1; depth <= 3; depth++) {
+        struct options streamed = opts;
+        streamed.stream         = 1;
+        streamed.ring           = 3;
+        streamed.io_depth       = depth;
+        streamed.io_block       = 100;
+        const size_t streamed_size = convert_image(ctx, &streamed, r.image[1], r.length[1], &again);
+        assert(streamed_size == expected_size[1]);
+        assert(memcmp(again, expected[1], expected_size[1]) == 0);
+        (void) streamed_size;
+        free(again);
+    }
+
+    // contexts on other threads convert concurrently without sharing anything
+    pool *p = pool_new(WORKERS);
+    assert(p != NULL && pool_size(p) == WORKERS);
+    for (int w = 0; w < WORKERS; w++) {
+        r.ctx[w] = img2wav_ctx_new(2);
+        assert(r.ctx[w] != NULL);
+    }
+    pool_run(p, IMAGES, NULL, run_image, &r);
+    for (int i = 0; i < IMAGES; i++) {
+        assert(r.size[i] == expected_size[i]);
+        assert(memcmp(r.wav[i], expected[i], expected_size[i]) == 0);
+        free(r.wav[i]);
+    }
+
+    // images of the same options and size rendered together match the ones converted on their own
+    struct image_source src[IMAGES];
+    struct options item_opts[IMAGES];
+    struct convert_item items[IMAGES];
+    for (int i = 0; i < IMAGES; i++) {
+        src[i]           = (struct image_source) {.data = r.image[i], .length = r.length[i]};
+        item_opts[i]     = opts;
+        item_opts[i].out = tmpfile();
+        items[i]         = (struct convert_item) {&item_opts[i], &src[i], 0};
+        assert(convert_options_key(&item_opts[i], WIDTH, HEIGHT) == convert_options_key(&opts, WIDTH, HEIGHT));
+    }
+    const int converted = convert_batch(ctx, items, IMAGES);
+    assert(converted == IMAGES);
+    for (int i = 0; i < IMAGES; i++) {
+        uint8_t *wav;
+        assert(items[i].written == (int) (opts.sample_rate * opts.time_s));
+        const size_t size = read_back(item_opts[i].out, &wav);
+        assert(size == expected_size[i]);
+        assert(memcmp(wav, expected[i], expected_size[i]) == 0);
+        (void) size;
+        free(wav);
+    }
+
+    // another size or a longer time gives another key, a batch of different sizes fails
+    assert(convert_options_key(&opts, WIDTH, HEIGHT * 2) != convert_options_key(&opts, WIDTH, HEIGHT));
+    struct options longer = opts;
+    longer.time_s         = 1.0f;
+    assert(convert_options_key(&longer, WIDTH, HEIGHT) != convert_options_key(&opts, WIDTH, HEIGHT));
+
+    // the osc kernel is only part of the key of osc, by the kernel it resolves to, and the fft size only of fft
+    struct options kernel = opts, other = opts;
+    for (int engine = SYNTH_FFT; engine <= SYNTH_GPU; engine++) {
+        kernel.synth.engine = other.synth.engine = engine;
+        kernel.synth.simd = "auto", other.synth.simd = osc_kernel_name("auto");
+        assert(convert_options_key(&kernel, WIDTH, HEIGHT) == convert_options_key(&other, WIDTH, HEIGHT));
+        other.synth.simd = strcmp(other.synth.simd, "scalar") == 0 ? "sse" : "scalar";
+        assert((convert_options_key(&kernel, WIDTH, HEIGHT) == convert_options_key(&other, WIDTH, HEIGHT)) == (engine != SYNTH_OSC));
+        kernel.synth.fft_size = 0, other.synth = kernel.synth, other.synth.fft_size = 256;
+        assert((convert_options_key(&kernel, WIDTH, HEIGHT) == convert_options_key(&other, WIDTH, HEIGHT)) == (engine != SYNTH_FFT));
+    }
+    (void) kernel, (void) other;
+    uint8_t tall[2048];
+    src[0]           = (struct image_source) {.data = r.image[0], .length = r.length[0]};
+    src[1]           = (struct image_source) {.data = tall, .length = make_image(tall, WIDTH, HEIGHT * 2, 0)};
+    item_opts[0].out = item_opts[1].out = NULL;
+    const int mixed = convert_batch(ctx, items, 2);
+    assert(mixed == 0);
+    assert(items[0].written == 0 && items[1].written == 0);
+    (void) converted, (void) longer, (void) mixed;
+
+    // the counters of every context are summed
+    char json[4096];
+    FILE *stats = tmpfile();
+    assert(stats != NULL);
+    stats_print(stats, r.ctx, WORKERS, 1.0);
+    rewind(stats);
+    json[fread(json, 1, sizeof(json) - 1, stats)] = '\0';
+    fclose(stats);
+    assert(strstr(json, "\"images\": 4,") != NULL);
+
+    // an image wider than the number of samples is rejected whether it is buffered, streamed or previewed
+    for (int mode = 0; mode < 3; mode++) {
+        struct options brief    = opts;
+        brief.time_s            = (WIDTH - 1) / opts.sample_rate;
+        brief.stream            = mode == 1;
+        brief.preview           = mode == 2;
+        brief.out               = tmpfile();
+        struct image_source one = {.data = r.image[0], .length = r.length[0]};
+        assert(brief.out != NULL);
+        const int rejected = convert_source(ctx, &brief, &one, "-", now());
+        assert(rejected == 0);
+        (void) rejected;
+        fclose(brief.out);
+    }
+
+    // every channel of rgb and tiles files is the mono file of its plane or strip
+    const int tile_counts[] = {1, 2, 3};
+    for (int k = 0; k < 4; k++) {
+        struct options split = opts;
+        split.channels       = k == 0 ? CHANNELS_RGB : CHANNELS_TILES;
+        split.tiles          = k == 0 ? 2 : tile_counts[k - 1];
+        const int n          = k == 0 ? 3 : split.tiles;
+        const int tile       = k == 0 ? WIDTH : (WIDTH + n - 1) / n;
+        uint8_t image[WIDTH * HEIGHT * 3 + 64];
+        uint8_t *wav;
+        const size_t wav_size = convert_image(ctx, &split, image, make_planes(image, WIDTH, HEIGHT, 0, WIDTH, k == 0 ? -1 : 0), &wav);
+        int nc, bytes;
+        size_t length;
+        const uint8_t *data = wav_samples(wav, wav_size, &nc, &bytes, &length);
+        assert(nc == n);
+        (void) data, (void) length;
+
+        for (int ch = 0; ch < n; ch++) {
+            uint8_t mono_image[WIDTH * HEIGHT + 64];
+            uint8_t *mono_wav;
+            const int first          = k == 0 ? 0 : ch * tile;
+            const size_t mono_length = make_planes(mono_image, WIDTH, HEIGHT, first, tile, k == 0 ? ch : 0);
+            const size_t mono_size   = convert_image(ctx, &opts, mono_image, mono_length, &mono_wav);
+            int mono_nc, mono_bytes;
+            size_t mono_samples;
+            const uint8_t *mono_data = wav_samples(mono_wav, mono_size, &mono_nc, &mono_bytes, &mono_samples);
+            assert(mono_nc == 1 && mono_bytes == bytes && mono_samples * n == length);
+            for (size_t i = 0; i < mono_samples / bytes; i++)
+                assert(memcmp(data + (i * n + ch) * bytes, mono_data + i * bytes, bytes) == 0);
+            (void) mono_data;
+            free(mono_wav);
+        }
+        free(wav);
+    }
+
+    for (int i = 0; i < IMAGES; i++)
+        free(expected[i]);
+    for (int w = 0; w < WORKERS; w++)
+        img2wav_ctx_free(r.ctx[w]);
+    img2wav_ctx_free(ctx);
+    pool_free(p);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OSC_IMPLEMENTATION
+#include "../src/osc.h"
+
+#define NUM_OSC     37
+#define NUM_SAMPLES 4099
+
+int compare(const char *kernel) {
+    osc_bank *bank = osc_bank_new(NUM_OSC);
+    assert(bank != NULL);
+    if (!osc_bank_set_kernel(bank, kernel)) {
+        printf("skipping unsupported kernel %s\n", kernel);
+        osc_bank_free(bank);
+        return 1;
+    }
+
+    double amp[NUM_OSC], omega[NUM_OSC], phase[NUM_OSC];
+    for (int i = 0; i < NUM_OSC; i++) {
+        amp[i]   = 0.001 + (i % 7) / 7.0;
+        omega[i] = 2.0 * M_PI * (40.0 + 1250.0 * i) / 96000.0;
+        phase[i] = (i % 3) * 0.5;
+        assert(osc_bank_add(bank, amp[i], omega[i], phase[i]));
+    }
+
+    // render in uneven pieces so resynchronization lands mid call
+    float *out = calloc(NUM_SAMPLES, sizeof(*out));
+    assert(out != NULL);
+    osc_bank_render(bank, out, 5);
+    osc_bank_render(bank, out + 5, 1000);
+    osc_bank_render(bank, out + 1005, NUM_SAMPLES - 1005);
+
+    int ok = 1;
+    for (int t = 0; t < NUM_SAMPLES && ok; t++) {
+        double expected = 0.0;
+        for (int i = 0; i < NUM_OSC; i++)
+            expected += amp[i] * sin(omega[i] * t + phase[i]);
+        if (!(fabs(expected - out[t]) <= 1e-4)) {
+            fprintf(stderr, "no match: %f != %f @ [%d] kernel=%s\n", out[t], expected, t, kernel);
+            ok = 0;
+        }
+    }
+
+    free(out);
+    osc_bank_free(bank);
+
+    return ok;
+}
+
+int main() {
+    //// Test every kernel against sin()
+    assert(compare("scalar"));
+    assert(compare("sse"));
+    assert(compare("avx2"));
+    assert(compare("avx512"));
+    assert(compare("neon"));
+    assert(compare("auto"));
+
+    //// Test unknown kernels are rejected
+    osc_bank *bank = osc_bank_new(1);
+    assert(bank != NULL);
+    assert(!osc_bank_set_kernel(bank, "mmx"));
+
+    //// Test capacity is enforced
+    for (int i = 0; i < OSC_LANES; i++)
+        assert(osc_bank_add(bank, 1.0f, 0.1, 0.0));
+    assert(!osc_bank_add(bank, 1.0f, 0.1, 0.0));
+
+    //// Test an empty bank adds nothing
+    osc_bank_clear(bank);
+    float out[8] = {0};
+    osc_bank_render(bank, out, 8);
+    for (int t = 0; t < 8; t++)
+        assert(out[t] == 0.0f);
+    osc_bank_free(bank);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/img2wav.h"
+
+#define HEIGHT    3
+#define MAX_WIDTH 40
+
+/** Binary PPM of width x height pixels taken from rgb */
+size_t make_ppm(uint8_t *buf, const uint8_t *rgb, int width, int height) {
+    const int n = sprintf((char *) buf, "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height * 3; i++)
+        buf[n + i] = rgb[i];
+
+    return n + (size_t) width * height * 3;
+}
+
+/** Luma of one pixel decoded on its own, a single pixel never reaches the SIMD kernels */
+int scalar_luma(const uint8_t *px, enum luma_coeffs luma) {
+    uint8_t buf[64];
+    int w, h;
+    const struct decode_config dc = {.luma = luma};
+    uint8_t *pixels               = get_pixels_from_memory(buf, make_ppm(buf, px, 1, 1), &w, &h, &dc);
+    assert(pixels != NULL && w == 1 && h == 1);
+    const int v = pixels[0];
+    free(pixels);
+
+    return v;
+}
+
+int main() {
+    static const double coeffs[][3] = {{0.299, 0.587, 0.114}, {0.2126, 0.7152, 0.0722}};
+    static uint8_t rgb[MAX_WIDTH * HEIGHT * 3], buf[MAX_WIDTH * HEIGHT * 3 + 64];
+
+    // random pixels plus black and white, which must map to 0 and 255
+    uint32_t seed = 1;
+    for (size_t i = 0; i < sizeof(rgb); i++) {
+        seed   = seed * 1664525u + 1013904223u;
+        rgb[i] = (uint8_t) (seed >> 24);
+    }
+    for (int c = 0; c < 3; c++) {
+        rgb[c]     = 0;
+        rgb[3 + c] = 255;
+    }
+
+    // widths around the 16 pixel iterations of the SIMD kernels and the 18 pixels a 16 byte load needs
+    const int widths[] = {1, 2, 15, 16, 17, 18, 19, 31, 32, 33, 34, 35, 40};
+    for (int luma = LUMA_BT601; luma <= LUMA_BT709; luma++) {
+        for (size_t k = 0; k < sizeof(widths) / sizeof(*widths); k++) {
+            for (int column_major = 0; column_major <= 1; column_major++) {
+                const int width               = widths[k];
+                const struct decode_config dc = {.luma = luma, .column_major = column_major};
+                int w, h;
+                uint8_t *pixels = get_pixels_from_memory(buf, make_ppm(buf, rgb, width, HEIGHT), &w, &h, &dc);
+                assert(pixels != NULL && w == width && h == HEIGHT);
+
+                for (int y = 0; y < HEIGHT; y++) {
+                    for (int x = 0; x < width; x++) {
+                        const uint8_t *px   = rgb + (y * width + x) * 3;
+                        const int v         = pixels[column_major ? x * HEIGHT + y : y * width + x];
+                        const int scalar    = scalar_luma(px, luma);
+                        const double exact  = coeffs[luma][0] * px[0] + coeffs[luma][1] * px[1] + coeffs[luma][2] * px[2];
+                        if (v != scalar || fabs(v - exact) > 1.0) {
+                            fprintf(stderr, "no match: %d != %d (%f) @ [%d, %d] width=%d luma=%d column_major=%d\n", v, scalar, exact, x, y, width, luma, column_major);
+                            return EXIT_FAILURE;
+                        }
+                    }
+                }
+                assert(pixels[0] == 0 && (width < 2 || pixels[column_major ? HEIGHT : 1] == 255));
+                free(pixels);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
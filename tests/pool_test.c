@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define POOL_IMPLEMENTATION
+#include "../src/pool.h"
+
+#define NUM_TASKS 1000
+
+struct counts {
+    int runs[NUM_TASKS];
+    int worker[NUM_TASKS];
+};
+
+void count_task(void *ctx, int worker, size_t task) {
+    struct counts *c = ctx;
+    // every task is visited by exactly one worker, so no locking is needed
+    c->runs[task]++;
+    c->worker[task] = worker;
+
+    // uneven busy work so stealing actually happens
+    volatile double x = 0.0;
+    for (size_t i = 0; i < (task % 17) * 1000; i++) x += i;
+}
+
+int run(pool *p, const double *cost) {
+    struct counts *c = calloc(1, sizeof(*c));
+    assert(c != NULL);
+
+    pool_run(p, NUM_TASKS, cost, count_task, c);
+
+    int ok = 1;
+    for (size_t i = 0; i < NUM_TASKS; i++) {
+        if (c->runs[i] != 1 || c->worker[i] < 0 || c->worker[i] >= pool_size(p)) {
+            fprintf(stderr, "task %zu ran %d times on worker %d\n", i, c->runs[i], c->worker[i]);
+            ok = 0;
+        }
+    }
+    free(c);
+
+    return ok;
+}
+
+int main() {
+    double cost[NUM_TASKS];
+    for (size_t i = 0; i < NUM_TASKS; i++)
+        cost[i] = (i % 10 == 0) ? 100.0 : 1.0;
+
+    assert(pool_cpu_count() >= 1);
+
+    //// Test every task runs exactly once for different pool sizes
+    const int sizes[] = {0, 1, 2, 3, 8};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        pool *p = pool_new(sizes[s]);
+        assert(p != NULL);
+        assert(pool_size(p) == (sizes[s] < 1 ? 1 : sizes[s]));
+
+        // reuse the pool for several jobs, with and without costs
+        const int ok = run(p, NULL) & run(p, cost) & run(p, NULL);
+        assert(ok);
+        (void) ok;
+
+        // an empty job returns immediately
+        pool_run(p, 0, NULL, count_task, NULL);
+
+        pool_free(p);
+    }
+
+    //// Test more workers than tasks
+    pool *p = pool_new(16);
+    assert(p != NULL);
+    struct counts *c = calloc(1, sizeof(*c));
+    assert(c != NULL);
+    pool_run(p, 3, NULL, count_task, c);
+    assert(c->runs[0] == 1 && c->runs[1] == 1 && c->runs[2] == 1 && c->runs[3] == 0);
+    free(c);
+    pool_free(p);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SERVE_IMPLEMENTATION
+#include "../src/serve.h"
+
+#define SOCKET_PATH "serve_test.sock"
+
+/** Gate holding the worker after it took its first connection */
+struct gate {
+    pthread_mutex_t lock;//!< Guards taken and open
+    pthread_cond_t cond; //!< Signaled when taken or open changes
+    int taken;           //!< The worker took its first connection
+    int open;            //!< The worker may go on
+};
+
+struct gate g = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0};
+
+/** Reply to a connection with the number of bytes it sent and the size of its batch */
+void reply(int fd, int batch) {
+    char buf[256];
+    ssize_t n, total = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        total += n;
+    n = snprintf(buf, sizeof(buf), "%d %d\n", (int) total, batch);
+    const ssize_t sent = write(fd, buf, n);
+    assert(sent == n);
+    (void) sent;
+    close(fd);
+}
+
+/** Take connections, the first one waits at the gate and the rest are taken together */
+void worker(server *s, void *ctx, int id) {
+    (void) ctx, (void) id;
+    int fd;
+    while ((fd = server_next(s, 1)) >= 0) {
+        pthread_mutex_lock(&g.lock);
+        g.taken = 1;
+        pthread_cond_broadcast(&g.cond);
+        while (!g.open)
+            pthread_cond_wait(&g.cond, &g.lock);
+        pthread_mutex_unlock(&g.lock);
+
+        int batch[8], n = 0;
+        batch[n++] = fd;
+        while (n < 8 && (batch[n] = server_next(s, 0)) >= 0)
+            n++;
+        for (int i = 0; i < n; i++)
+            reply(batch[i], n);
+    }
+}
+
+void *run(void *arg) {
+    const int ok = server_run(arg, 1, worker, NULL);
+    assert(ok);
+    (void) ok;
+    return NULL;
+}
+
+/** Connect to the server and send a message */
+int client(const char *message) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCKET_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    const int connected = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+    assert(connected == 0);
+    const ssize_t n    = strlen(message);
+    const ssize_t sent = n > 0 ? write(fd, message, n) : 0;
+    assert(sent == n);
+    (void) connected, (void) sent;
+    shutdown(fd, SHUT_WR);
+
+    return fd;
+}
+
+/** Read a connection until the server closes it */
+void receive(int fd, char *buf, size_t size) {
+    size_t total = 0;
+    ssize_t n;
+    while (total < size - 1 && (n = read(fd, buf + total, size - 1 - total)) > 0)
+        total += n;
+    buf[total] = '\0';
+    close(fd);
+}
+
+int main() {
+    // a socket path too long for sockaddr_un
+    char path[200];
+    memset(path, 'a', sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    server *s = server_open(path, 2, "");
+    assert(s == NULL);
+
+    // a stale socket is replaced, a regular file isn't
+    remove(SOCKET_PATH);
+    FILE *file = fopen(SOCKET_PATH, "w");
+    assert(file != NULL);
+    fclose(file);
+    s = server_open(SOCKET_PATH, 2, "");
+    assert(s == NULL);
+    assert(access(SOCKET_PATH, F_OK) == 0);
+    remove(SOCKET_PATH);
+    s = server_open(SOCKET_PATH, 2, "busy\n");
+    assert(s != NULL);
+    server_free(s);
+    s = server_open(SOCKET_PATH, 2, "busy\n");
+    assert(s != NULL);
+
+    pthread_t thread;
+    const int started = pthread_create(&thread, NULL, run, s);
+    assert(started == 0);
+    (void) started;
+
+    // the worker holds the first connection, the next two fill the queue
+    char buf[64];
+    int a = client("hello");
+    pthread_mutex_lock(&g.lock);
+    while (!g.taken)
+        pthread_cond_wait(&g.cond, &g.lock);
+    pthread_mutex_unlock(&g.lock);
+    int b = client("ab");
+    int c = client("abcdef");
+
+    // the fourth is turned away, connections are accepted in order and it
+    // sends nothing since the server may close it before it could
+    int d = client("");
+    receive(d, buf, sizeof(buf));
+    assert(strcmp(buf, "busy\n") == 0);
+
+    // the worker takes the queued connections along with the first one
+    pthread_mutex_lock(&g.lock);
+    g.open = 1;
+    pthread_cond_broadcast(&g.cond);
+    pthread_mutex_unlock(&g.lock);
+    receive(a, buf, sizeof(buf));
+    assert(strcmp(buf, "5 3\n") == 0);
+    receive(b, buf, sizeof(buf));
+    assert(strcmp(buf, "2 3\n") == 0);
+    receive(c, buf, sizeof(buf));
+    assert(strcmp(buf, "6 3\n") == 0);
+
+    server_stop(s);
+    pthread_join(thread, NULL);
+    server_stats st = server_get_stats(s);
+    assert(st.accepted == 3 && st.rejected == 1);
+    (void) st;
+
+    server_free(s);
+    assert(access(SOCKET_PATH, F_OK) != 0);
+
+    return EXIT_SUCCESS;
+}
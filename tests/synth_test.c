@@ -0,0 +1,246 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/img2wav.h"
+
+#define WIDTH 20
+#define RATE  8000.0f
+#define ROWS  16
+
+/** Pixels of a noise image, about a quarter of them dark */
+uint8_t *make_pixels(int width, int height, uint32_t seed) {
+    uint8_t *pixels = malloc((size_t) width * height);
+    assert(pixels != NULL);
+    for (int i = 0; i < width * height; i++) {
+        seed      = seed * 1664525u + 1013904223u;
+        pixels[i] = (seed >> 24) < 64 ? 0 : (uint8_t) (seed >> 16);
+    }
+
+    return pixels;
+}
+
+/** Samples of pixels rendered with cfg, the engine must succeed */
+float *render(const void *pixels, int width, int height, float time_s, synth_config cfg, int *n) {
+    float *out = get_freqs(pixels, RATE, time_s, width, height, cfg, n);
+    assert(out != NULL);
+
+    return out;
+}
+
+/** Signal to noise ratio in dB of an engine against SYNTH_ADDITIVE on the same pixels */
+double engine_snr(const uint8_t *pixels, int width, int height, float time_s, synth_config cfg) {
+    int n, ref_n;
+    float *out = get_freqs(pixels, RATE, time_s, width, height, cfg, &n);
+    cfg.engine = SYNTH_ADDITIVE;
+    float *ref = get_freqs(pixels, RATE, time_s, width, height, cfg, &ref_n);
+    assert(out != NULL && ref != NULL && n == ref_n);
+
+    double signal = 0.0, noise = 0.0;
+    for (int i = 0; i < n; i++) {
+        signal += (double) ref[i] * ref[i];
+        noise += (double) (out[i] - ref[i]) * (out[i] - ref[i]);
+    }
+    free(out);
+    free(ref);
+
+    return noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+}
+
+/** Largest difference between a one column image lit at row y only and a unit sine of freq hz, -1 if it is silent */
+double tone_error(int y, int height, float rate, synth_config cfg, double freq) {
+    uint8_t pixels[64] = {0};
+    assert(height <= 64);
+    pixels[y] = 255;
+
+    int n;
+    float *out = get_freqs(pixels, rate, 0.05f, 1, height, cfg, &n);
+    assert(out != NULL && n > 0);
+    double err = -1.0;
+    for (int t = 0; t < n; t++)
+        if (out[t] != 0.0f) err = 0.0;
+    for (int t = 0; err >= 0.0 && t < n; t++)
+        err = fmax(err, fabs(out[t] - sin(M_PI * 2.0 * freq * t / rate)));
+    free(out);
+
+    return err;
+}
+
+int main() {
+    const synth_config base = {.threads = 2};
+
+    // the fft engine plays every row at its own frequency, whether it sits on a bin or not
+    const int heights[] = {64, 50};
+    for (int h = 0; h < 2; h++) {
+        uint8_t *pixels = make_pixels(WIDTH, heights[h], 7 + h);
+        for (int phase = PHASE_RESTART; phase <= PHASE_CONTINUOUS; phase++) {
+            for (int size = 0; size <= 32; size += 32) {
+                for (int fade = 0; fade <= 1; fade++) {
+                    synth_config cfg = base;
+                    cfg.engine       = SYNTH_FFT;
+                    cfg.phase        = phase;
+                    cfg.fft_size     = size;
+                    cfg.crossfade    = fade * 0.25f;
+                    const double snr = engine_snr(pixels, WIDTH, heights[h], 0.5f, cfg);
+                    if (snr < 60.0) {
+                        fprintf(stderr, "fft: %.1f dB @ height=%d phase=%d size=%d crossfade=%.2f\n", snr, heights[h], phase, size, cfg.crossfade);
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+        }
+        free(pixels);
+    }
+
+    // the table engine stays within its interpolation error, cubic reaches it with far smaller tables, and
+    // even long continuous signals keep the phase of the additive sum
+    uint8_t *pixels = make_pixels(WIDTH, 50, 3);
+    const struct {
+        int size;                //!< Wavetable size
+        enum table_interp interp;//!< Interpolation
+        double min, max;         //!< Range of the SNR in dB
+    } tables[] = {
+        {0, TABLE_LINEAR, 75.0, INFINITY},
+        {64, TABLE_CUBIC, 75.0, INFINITY},
+        {64, TABLE_LINEAR, 50.0, 70.0},
+    };
+    for (size_t i = 0; i < sizeof(tables) / sizeof(*tables); i++) {
+        for (int phase = PHASE_RESTART; phase <= PHASE_CONTINUOUS; phase++) {
+            synth_config cfg = base;
+            cfg.engine       = SYNTH_TABLE;
+            cfg.table_size   = tables[i].size;
+            cfg.interp       = tables[i].interp;
+            cfg.phase        = phase;
+            const double snr = engine_snr(pixels, WIDTH, 50, 4.0f, cfg);
+            if (snr < tables[i].min || snr > tables[i].max) {
+                fprintf(stderr, "table: %.1f dB @ size=%d interp=%d phase=%d\n", snr, tables[i].size, tables[i].interp, phase);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    free(pixels);
+
+    // the polynomial sine follows the additive sum in both phases, even over long signals
+    pixels = make_pixels(WIDTH, 50, 4);
+    for (int phase = PHASE_RESTART; phase <= PHASE_CONTINUOUS; phase++) {
+        synth_config cfg = base;
+        cfg.engine       = SYNTH_SINF;
+        cfg.phase        = phase;
+        const double snr = engine_snr(pixels, WIDTH, 50, 4.0f, cfg);
+        if (snr < 75.0) {
+            fprintf(stderr, "sinf: %.1f dB @ phase=%d\n", snr, phase);
+            return EXIT_FAILURE;
+        }
+    }
+    free(pixels);
+
+    // sparse columns read every layout and depth alike and keep only the pixels that sound
+    const int height = 50;
+    const size_t num = (size_t) WIDTH * height;
+    pixels           = make_pixels(WIDTH, height, 5);
+    uint8_t *dim     = malloc(num);
+    uint8_t *column  = malloc(num);
+    uint16_t *wide   = malloc(num * sizeof(*wide));
+    assert(dim != NULL && column != NULL && wide != NULL);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            const uint8_t v        = pixels[y * WIDTH + x];
+            dim[y * WIDTH + x]     = v < 10 ? 9 : v;
+            column[x * height + y] = v;
+            wide[y * WIDTH + x]    = (uint16_t) (v * 257);
+        }
+    }
+    synth_config cfg = base;
+    cfg.engine       = SYNTH_SINF;
+    int n, other_n;
+    float *out = render(pixels, WIDTH, height, 0.5f, cfg, &n);
+
+    float *other = render(dim, WIDTH, height, 0.5f, cfg, &other_n);
+    assert(other_n == n && memcmp(out, other, n * sizeof(*out)) == 0);
+    free(other);
+
+    cfg.column_major = 1;
+    other            = render(column, WIDTH, height, 0.5f, cfg, &other_n);
+    assert(other_n == n && memcmp(out, other, n * sizeof(*out)) == 0);
+    free(other);
+
+    cfg.column_major = 0;
+    cfg.depth        = 16;
+    other            = render(wide, WIDTH, height, 0.5f, cfg, &other_n);
+    assert(other_n == n);
+    for (int i = 0; i < n; i++)
+        assert(fabsf(out[i] - other[i]) <= 1e-5f);
+    free(other);
+
+    // every column only plays its own pixels, as if it were an image of its own
+    cfg.depth = 0;
+    for (int x = 0; x < WIDTH; x++) {
+        for (int y = 0; y < height; y++)
+            column[y] = pixels[y * WIDTH + x];
+        other = render(column, 1, height, 0.5f / WIDTH, cfg, &other_n);
+        assert(other_n == n / WIDTH && memcmp(out + x * other_n, other, other_n * sizeof(*out)) == 0);
+        free(other);
+    }
+
+    // an image without a pixel above the threshold is silent
+    for (size_t i = 0; i < num; i++)
+        dim[i] = (uint8_t) (i % 10);
+    other = render(dim, WIDTH, height, 0.5f, cfg, &other_n);
+    for (int i = 0; i < other_n; i++)
+        assert(other[i] == 0.0f);
+    free(other);
+
+    free(out);
+    free(pixels);
+    free(dim);
+    free(column);
+    free(wide);
+
+    // rows are spread over the range of the sample rate, linear by default
+    cfg                 = base;
+    cfg.engine          = SYNTH_ADDITIVE;
+    const double mel_hi = 2595.0 * log10(1.0 + 4000.0 / 700.0);
+    const struct {
+        float rate, min_freq, max_freq;//!< Sample rate and range of the rows
+        enum freq_scale mapping;       //!< Spacing of the rows
+        int y;                         //!< Lit row
+        double freq;                   //!< Frequency the row must play at, 0 if it is dropped
+    } tones[] = {
+        {8000.0f, 0.0f, 0.0f, FREQ_LINEAR, 5, 5 * 8000.0 / (2 * ROWS)},
+        {44100.0f, 0.0f, 0.0f, FREQ_LINEAR, 5, 5 * 44100.0 / (2 * ROWS)},
+        {8000.0f, 100.0f, 3000.0f, FREQ_LINEAR, 5, 100.0 + 5 * 2900.0 / ROWS},
+        {8000.0f, 0.0f, 0.0f, FREQ_LOG, 8, 20.0 * sqrt(4000.0 / 20.0)},
+        {8000.0f, 0.0f, 0.0f, FREQ_MEL, 8, 700.0 * (pow(10.0, mel_hi / 2 / 2595.0) - 1.0)},
+        {8000.0f, 0.0f, 8000.0f, FREQ_LINEAR, 7, 3500.0},
+        {8000.0f, 0.0f, 8000.0f, FREQ_LINEAR, 8, 0.0},
+        {8000.0f, 0.0f, 8000.0f, FREQ_LINEAR, 15, 0.0},
+    };
+    for (size_t i = 0; i < sizeof(tones) / sizeof(*tones); i++) {
+        cfg.min_freq     = tones[i].min_freq;
+        cfg.max_freq     = tones[i].max_freq;
+        cfg.mapping      = tones[i].mapping;
+        const double err = tone_error(tones[i].y, ROWS, tones[i].rate, cfg, tones[i].freq);
+        if (tones[i].freq > 0.0 ? !(err >= 0.0 && err < 1e-3) : err >= 0.0) {
+            fprintf(stderr, "tone: %g @ row=%d rate=%g range=[%g, %g] mapping=%d\n", err, tones[i].y, tones[i].rate, tones[i].min_freq, tones[i].max_freq, tones[i].mapping);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // rows from the Nyquist frequency on are dropped, the rows below play as if they were the whole image
+    uint8_t lit[WIDTH * ROWS];
+    for (int i = 0; i < WIDTH * ROWS; i++)
+        lit[i] = i < WIDTH * ROWS / 4 ? 200 : 255;
+    cfg.max_freq = 2 * RATE;
+    cfg.mapping  = FREQ_LINEAR;
+    out          = render(lit, WIDTH, ROWS, 0.5f, cfg, &n);
+    cfg.max_freq = RATE / 2;
+    other        = render(lit, WIDTH, ROWS / 4, 0.5f, cfg, &other_n);
+    assert(other_n == n && memcmp(out, other, n * sizeof(*out)) == 0);
+    free(out);
+    free(other);
+
+    return EXIT_SUCCESS;
+}
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdio.h>
 
+#define WAV_IMPLEMENTATION
 #include "../src/wav.h"
 
 int compare(float *const *a, float *const *b, size_t nc, size_t ns, size_t bd) {
@@ -48,48 +49,127 @@ int main() {
 
     //// Test valid file writing
     // Mono test
-    wav_config mono_hdr = {1, ns, sr, bd};
+    wav_config mono_hdr = {.nc = 1, .ns = ns, .sr = sr, .bd = bd};
     assert(wav_write(mono_hdr, "mono.wav", c) == ns);
 
     // Stereo test
-    wav_config stereo_hdr = {2, ns, sr, bd};
+    wav_config stereo_hdr = {.nc = 2, .ns = ns, .sr = sr, .bd = bd};
     assert(wav_write(stereo_hdr, "stereo.wav", c) == ns);
 
     // Multi-channel test
-    wav_config multi_hdr = {nc, ns, sr, bd};
+    wav_config multi_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = bd};
     assert(wav_write(multi_hdr, "multi_32.wav", c) == ns);
 
     // 24-bit test
-    wav_config multi_24_hdr = {nc, ns, sr, 24};
+    wav_config multi_24_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 24};
     assert(wav_write(multi_24_hdr, "multi_24.wav", c) == ns);
 
     // 16-bit test
-    wav_config multi_16_hdr = {nc, ns, sr, 16};
+    wav_config multi_16_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 16};
     assert(wav_write(multi_16_hdr, "multi_16.wav", c) == ns);
 
     // 8-bit test
-    wav_config multi_8_hdr = {nc, ns, sr, 8};
+    wav_config multi_8_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 8};
     assert(wav_write(multi_8_hdr, "multi_8.wav", c) == ns);
 
+    // Incremental writer test, appended in uneven blocks
+    wav_config writer_hdr = {.nc = nc, .ns = 0, .sr = sr, .bd = 24};
+    wav_writer *writer    = wav_writer_open(writer_hdr, "writer_24.wav");
+    assert(writer != NULL);
+    for (size_t i = 0; i < ns;) {
+        const size_t block = (ns - i < 7919) ? ns - i : 7919;
+        float *blocks[3]   = {c[0] + i, c[1] + i, c[2] + i};
+        assert(wav_writer_append(writer, blocks, block) == block);
+        // flushed samples are in the file before the writer is closed
+        if (i == 0) {
+            uint64_t flushed = 0;
+            assert(wav_writer_flush(writer) && wav_file_size("writer_24.wav", &flushed));
+            assert(flushed >= (uint64_t) block * nc * 3);
+        }
+        i += block;
+    }
+    assert(wav_writer_close(writer) == ns);
+
+    // Odd sized data section test, the writer must pad like wav_write()
+    wav_config odd_hdr = {.nc = 1, .ns = 0, .sr = sr, .bd = 8};
+    writer             = wav_writer_open(odd_hdr, "writer_odd.wav");
+    assert(writer != NULL);
+    assert(wav_writer_append(writer, c, 101) == 101);
+    assert(wav_writer_close(writer) == 101);
+
+    // Stream writer test, the sizes are written up front and the stream is never seeked,
+    // the samples are encoded into blocks that aren't a whole number of frames
+    FILE *stream = fopen("stream_24.wav", "wb");
+    assert(stream != NULL);
+    wav_config stream_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 24};
+    stream_hdr.block      = 1000;
+    writer                = wav_writer_open_stream(stream_hdr, stream);
+    assert(writer != NULL);
+    for (size_t i = 0; i < ns;) {
+        const size_t block = (ns - i < 4096) ? ns - i : 4096;
+        float *blocks[3]   = {c[0] + i, c[1] + i, c[2] + i};
+        assert(wav_writer_append(writer, blocks, block) == block);
+        i += block;
+    }
+    assert(wav_writer_close(writer) == ns);
+    assert(fclose(stream) == 0);
+
+    // A stream that receives fewer samples than its header announced must fail
+    stream = fopen("stream_short.wav", "wb");
+    assert(stream != NULL);
+    writer = wav_writer_open_stream(odd_hdr, stream);
+    assert(writer == NULL);
+    odd_hdr.ns = 101;
+    writer     = wav_writer_open_stream(odd_hdr, stream);
+    assert(writer != NULL);
+    assert(wav_writer_append(writer, c, 100) == 100);
+    assert(wav_writer_close(writer) == 0);
+    assert(fclose(stream) == 0);
+
+    //// Test 24-bit samples outside of [-1.0, 1.0] saturate instead of wrapping around
+    float loud[9]       = {1.0000001f, 2.0f, -1.0000001f, -3.0f, 0.5f, 1.0f, -1.0f, 4.0f, 0.0f};
+    float loud_read[9]  = {0};
+    float *loud_ch[1]   = {loud};
+    float *loud_rd[1]   = {loud_read};
+    wav_config loud_hdr = {.nc = 1, .ns = 9, .sr = sr, .bd = 24};
+    assert(wav_write(loud_hdr, "loud_24.wav", loud_ch) == 9);
+    assert(wav_read(loud_hdr, "loud_24.wav", loud_rd) == 9);
+    const float clamped[9] = {1.0f, 1.0f, -1.0f, -1.0f, 0.5f, 1.0f, -1.0f, 1.0f, 0.0f};
+    for (int i = 0; i < 9; i++)
+        assert(fabs(loud_read[i] - clamped[i]) <= 0.000001f);
+
+    // the gain folded into the quantizer scales before clamping
+    float *loud_scaled[1] = {loud};
+    stream                = fopen("loud_scaled_24.wav", "wb");
+    assert(stream != NULL);
+    writer = wav_writer_open_stream(loud_hdr, stream);
+    assert(writer != NULL);
+    assert(wav_writer_append_scaled(writer, loud_scaled, 9, 0.25f) == 9);
+    assert(wav_writer_close(writer) == 9);
+    assert(fclose(stream) == 0);
+    assert(wav_read(loud_hdr, "loud_scaled_24.wav", loud_rd) == 9);
+    for (int i = 0; i < 9; i++)
+        assert(fabs(loud_read[i] - loud[i] * 0.25f) <= 0.000001f);
+
     //// Test invalid headers
     // Invalid number of channels test
-    wav_config ch_hdr = {0, ns, sr, bd};
+    wav_config ch_hdr = {.nc = 0, .ns = ns, .sr = sr, .bd = bd};
     assert(wav_write(ch_hdr, "channels.wav", c) == 0);
 
     // Invalid number of samples test
-    wav_config ns_hdr = {nc, 0, sr, bd};
+    wav_config ns_hdr = {.nc = nc, .ns = 0, .sr = sr, .bd = bd};
     assert(wav_write(ns_hdr, "samples.wav", c) == 0);
 
     // Invalid sample rate test
-    wav_config sr_hdr = {nc, ns, 0, bd};
+    wav_config sr_hdr = {.nc = nc, .ns = ns, .sr = 0, .bd = bd};
     assert(wav_write(sr_hdr, "sample_rate.wav", c) == 0);
 
     // Invalid bit depth test
-    wav_config bd_hdr = {nc, ns, sr, 0};
+    wav_config bd_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 0};
     assert(wav_write(bd_hdr, "bit_depth.wav", c) == 0);
 
     //// Test invalid path
-    wav_config path_hdr = {nc, ns, sr, bd};
+    wav_config path_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = bd};
     assert(wav_write(path_hdr, "", c) == 0);
 
     //// Test valid file header reading
@@ -122,6 +202,23 @@ int main() {
     assert(read_hdr.sr = sr);
     assert(read_hdr.bd = 8);
 
+    // Test the incremental writer patched its header
+    wav_config writer_read_hdr;
+    assert(wav_get_header(&writer_read_hdr, "writer_24.wav") == WAV_HEADER_SIZE);
+    assert(writer_read_hdr.nc == nc && writer_read_hdr.ns == ns && writer_read_hdr.sr == sr && writer_read_hdr.bd == 24);
+    // an unknown number of samples reserves a JUNK chunk in case the file has to become RF64
+    assert(writer_read_hdr.format == WAV_RIFF && writer_read_hdr.offset == WAV_DATA_OFFSET + WAV_DS64_SIZE);
+    assert(wav_get_header(&writer_read_hdr, "writer_odd.wav") == WAV_HEADER_SIZE);
+    assert(writer_read_hdr.nc == 1 && writer_read_hdr.ns == 101 && writer_read_hdr.sr == sr && writer_read_hdr.bd == 8);
+    assert(wav_get_header(&writer_read_hdr, "stream_24.wav") == WAV_HEADER_SIZE);
+    assert(writer_read_hdr.nc == nc && writer_read_hdr.ns == ns && writer_read_hdr.sr == sr && writer_read_hdr.bd == 24);
+    assert(writer_read_hdr.format == WAV_RIFF && writer_read_hdr.offset == WAV_DATA_OFFSET && writer_read_hdr.block == 0);
+
+    // Test invalid writer configurations
+    wav_config bad_writer_hdr = {.nc = 0, .ns = 0, .sr = sr, .bd = 24};
+    assert(wav_writer_open(bad_writer_hdr, "writer_bad.wav") == NULL);
+    assert(wav_writer_open(writer_hdr, "") == NULL);
+
     //// Test valid file data reading
     // Test 32-bit multi-channel header reading
     read_hdr.bd = 32;
@@ -143,6 +240,145 @@ int main() {
     assert(wav_read(read_hdr, "multi_8.wav", b) == ns);
     assert(compare(c, b, read_hdr.nc, read_hdr.ns, read_hdr.bd));
 
+    //// Test partial reads
+    // Test a window in the middle of every bit depth
+    const char *multi_paths[] = {"multi_8.wav", "multi_16.wav", "multi_24.wav", "multi_32.wav"};
+    const int multi_bds[]     = {8, 16, 24, 32};
+    const size_t offset       = 12345;
+    const size_t count        = 4000;
+    for (size_t i = 0; i < 4; i++) {
+        read_hdr.bd = multi_bds[i];
+        assert(wav_read_range(read_hdr, multi_paths[i], offset, count, b) == count);
+        float *window[3] = {c[0] + offset, c[1] + offset, c[2] + offset};
+        assert(compare(window, b, read_hdr.nc, count, read_hdr.bd));
+    }
+
+    // Test a window running past the end is clamped
+    read_hdr.bd = 32;
+    assert(wav_read_range(read_hdr, "multi_32.wav", ns - 10, count, b) == 10);
+    float *tail[3] = {c[0] + ns - 10, c[1] + ns - 10, c[2] + ns - 10};
+    assert(compare(tail, b, read_hdr.nc, 10, read_hdr.bd));
+
+    // Test the incremental writer's samples
+    assert(wav_get_header(&writer_read_hdr, "writer_24.wav") == WAV_HEADER_SIZE);
+    assert(wav_read(writer_read_hdr, "writer_24.wav", b) == ns);
+    assert(compare(c, b, writer_read_hdr.nc, writer_read_hdr.ns, writer_read_hdr.bd));
+    assert(wav_get_header(&writer_read_hdr, "stream_24.wav") == WAV_HEADER_SIZE);
+    assert(wav_read(writer_read_hdr, "stream_24.wav", b) == ns);
+    assert(compare(c, b, writer_read_hdr.nc, writer_read_hdr.ns, writer_read_hdr.bd));
+
+    // Test a window starting past the end reads nothing
+    assert(wav_read_range(read_hdr, "multi_32.wav", ns, count, b) == 0);
+
+    // Test a missing file reads nothing
+    assert(wav_read_range(read_hdr, "missing.wav", 0, count, b) == 0);
+
+    //// Test in place writes
+    // Test a range overwritten with other samples leaves the rest of the file as it was
+    wav_config patch_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 32};
+    assert(wav_write(patch_hdr, "patch_32.wav", c) == ns);
+    assert(wav_get_header(&patch_hdr, "patch_32.wav") == WAV_HEADER_SIZE);
+    assert(wav_write_range(patch_hdr, "patch_32.wav", offset, count, c, 0.5f) == count);
+    assert(wav_write_range(patch_hdr, "patch_32.wav", ns - 10, count, c, 1.0f) == 10);
+    assert(wav_write_range(patch_hdr, "patch_32.wav", ns, count, c, 1.0f) == 0);
+    assert(wav_get_header(&patch_hdr, "patch_32.wav") == WAV_HEADER_SIZE && patch_hdr.ns == ns);
+    assert(wav_read(patch_hdr, "patch_32.wav", b) == ns);
+    for (int ch = 0; ch < nc; ch++) {
+        for (size_t i = 0; i < ns; i++) {
+            const float expected = (i >= offset && i < offset + count) ? c[ch][i - offset] * 0.5f
+                                   : (i >= ns - 10)                   ? c[ch][i - (ns - 10)]
+                                                                      : c[ch][i];
+            assert(b[ch][i] == expected);
+        }
+    }
+
+    //// Test RF64 and Wave64 containers
+    const char *container_paths[2]     = {"rf64_24.wav", "w64_24.w64"};
+    const enum wav_format containers[2] = {WAV_RF64, WAV_W64};
+    for (size_t i = 0; i < 2; i++) {
+        wav_config container_hdr = {.nc = nc, .ns = ns, .sr = sr, .bd = 24, .format = containers[i]};
+        assert(wav_write(container_hdr, container_paths[i], c) == ns);
+
+        wav_config container_read_hdr;
+        assert(wav_get_header(&container_read_hdr, container_paths[i]) == WAV_HEADER_SIZE);
+        assert(container_read_hdr.format == containers[i] && container_read_hdr.nc == nc && container_read_hdr.ns == ns);
+        assert(container_read_hdr.sr == sr && container_read_hdr.bd == 24);
+        assert(container_read_hdr.offset == (containers[i] == WAV_W64 ? WAV_W64_HEADER : WAV_DATA_OFFSET + WAV_DS64_SIZE));
+        assert(wav_read(container_read_hdr, container_paths[i], b) == ns);
+        assert(compare(c, b, nc, ns, 24));
+
+        // the incremental writer patches the 64-bit sizes and pads odd sizes to the chunk alignment
+        wav_config odd_container_hdr = {.nc = 1, .ns = 0, .sr = sr, .bd = 8, .format = containers[i]};
+        writer                       = wav_writer_open(odd_container_hdr, container_paths[i]);
+        assert(writer != NULL);
+        assert(wav_writer_append(writer, c, 101) == 101);
+        assert(wav_writer_close(writer) == 101);
+        assert(wav_get_header(&container_read_hdr, container_paths[i]) == WAV_HEADER_SIZE);
+        assert(container_read_hdr.format == containers[i] && container_read_hdr.nc == 1 && container_read_hdr.ns == 101);
+        assert(wav_read(container_read_hdr, container_paths[i], b) == 101);
+        assert(compare(c, b, 1, 101, 8));
+
+        uint64_t size = 0;
+        assert(wav_file_size(container_paths[i], &size));
+        assert(size == container_read_hdr.offset + 101 + wav_pad_size(container_read_hdr, containers[i], 101));
+    }
+
+    // Test the largest RIFF sizes, one more sample or a reserved JUNK chunk needs RF64
+    wav_config edge_hdr = {.nc = 1, .ns = 0, .sr = sr, .bd = 8};
+    assert(wav_fits_riff(edge_hdr, WAV_RIFF_MAX - 37, 0));
+    assert(!wav_fits_riff(edge_hdr, WAV_RIFF_MAX - 36, 0));
+    assert(!wav_fits_riff(edge_hdr, WAV_RIFF_MAX - 37, 1));
+
+    // Test data past 4 GiB switches WAV_AUTO to RF64 and the sizes are read back from ds64, only the header is written
+    wav_config big_hdr = {.nc = 2, .ns = 3000000000u, .sr = 192000, .bd = 32};
+    FILE *big          = fopen("big_header.wav", "wb");
+    assert(big != NULL);
+    assert(wav_write_header(big_hdr, big) == WAV_HEADER_SIZE);
+    assert(fclose(big) == 0);
+    wav_config big_read_hdr;
+    assert(wav_get_header(&big_read_hdr, "big_header.wav") == WAV_HEADER_SIZE);
+    assert(big_read_hdr.format == WAV_RF64 && big_read_hdr.nc == 2 && big_read_hdr.ns == big_hdr.ns && big_read_hdr.bd == 32);
+
+    // Test a RIFF header refuses sizes it can't hold
+    big_hdr.format = WAV_RIFF;
+    big            = fopen("big_header.wav", "wb");
+    assert(big != NULL);
+    assert(wav_write_header(big_hdr, big) == 0);
+    assert(fclose(big) == 0);
+
+    //// Test the mono and stereo kernels encode and decode exactly like the generic ones
+    // an odd number of samples runs the scalar tails, loud samples check clamping and wrapping
+    const size_t kn   = 1003;
+    uint8_t *kernel   = malloc(kn * 2 * 4);
+    uint8_t *generic  = malloc(kn * 2 * 4);
+    float *kernel_rd  = malloc(kn * 2 * sizeof(*kernel_rd));
+    float *generic_rd = malloc(kn * 2 * sizeof(*generic_rd));
+    assert(kernel && generic && kernel_rd && generic_rd);
+    for (size_t i = 0; i < kn; i++) c[1][i] = (i % 7 == 0) ? 1.5f - (float) (i % 3) * 1.5f : c[0][i] * 0.5f;
+    for (size_t k = 0; k < 8; k++) {
+        const wav_config kernel_hdr = {.nc = k / 4 + 1, .ns = kn, .sr = sr, .bd = multi_bds[k % 4]};
+        const size_t bytes          = kn * kernel_hdr.nc * kernel_hdr.bd / 8;
+        assert(wav_get_encoder(kernel_hdr) != wav_encode_block && wav_get_decoder(kernel_hdr) != wav_decode_block);
+        for (int s = 0; s < 2; s++) {
+            const float scale = s ? 0.75f : 1.0f;
+            wav_get_encoder(kernel_hdr)(kernel_hdr, c, 1, kn - 1, scale, kernel);
+            wav_encode_block(kernel_hdr, c, 1, kn - 1, scale, generic);
+            assert(memcmp(kernel, generic, bytes - bytes / kn) == 0);
+        }
+        float *kernel_ch[2]  = {kernel_rd, kernel_rd + kn};
+        float *generic_ch[2] = {generic_rd, generic_rd + kn};
+        wav_get_decoder(kernel_hdr)(kernel_hdr, generic, kn - 1, kernel_ch, 1);
+        wav_decode_block(kernel_hdr, generic, kn - 1, generic_ch, 1);
+        for (size_t ch = 0; ch < kernel_hdr.nc; ch++)
+            assert(memcmp(kernel_ch[ch] + 1, generic_ch[ch] + 1, (kn - 1) * sizeof(float)) == 0);
+    }
+    wav_config generic_hdr = {.nc = nc, .ns = kn, .sr = sr, .bd = 16};
+    assert(wav_get_encoder(generic_hdr) == wav_encode_block && wav_get_decoder(generic_hdr) == wav_decode_block);
+    free(kernel);
+    free(generic);
+    free(kernel_rd);
+    free(generic_rd);
+
     // Cleanup
     for (size_t ch = 0; ch < nc; ch++) {
         free(c[ch]);